@@ -0,0 +1,58 @@
+#pragma once
+
+//-------------------------------------------------------------------------
+// One monitor tick of the engine for an active script (see script_monitor.hpp),
+// recording what it detected instead of acting on it. The trigger file is
+// ready as soon as it is modified.
+struct engine_tick_t
+{
+    bool reparsed = false;              // an index file changed: the script was re-loaded
+    bool gone = false;                  // the script no longer exists
+    std::vector<std::string> changed;   // the files whose change was detected
+    std::string executed;               // the file the plugin would execute (empty if none)
+
+    bool detected() const { return reparsed || !changed.empty(); }
+};
+
+class recording_monitor_t : public script_monitor_t
+{
+    deps_parser_t &parser;
+    engine_tick_t &r;
+
+protected:
+    void on_change(active_script_info_t &, const char *file, int) override
+    {
+        r.changed.push_back(file);
+    }
+
+    bool on_reparse(active_script_info_t &script) override
+    {
+        r.reparsed = true;
+        parser.load_active_script(script, script.file_path.c_str());
+        return true;
+    }
+
+    void on_gone(active_script_info_t &, const char *) override
+    {
+        r.gone = true;
+    }
+
+    void on_execute(active_script_info_t &, active_script_info_t &work_script, bool, bool) override
+    {
+        r.executed = work_script.file_path.c_str();
+    }
+
+public:
+    recording_monitor_t(deps_parser_t &parser, engine_tick_t &r) : parser(parser), r(r)
+    {
+    }
+};
+
+static engine_tick_t engine_tick(deps_parser_t &parser, active_script_info_t &script)
+{
+    engine_tick_t r;
+    file_stat_tick_t stat_tick;
+    recording_monitor_t monitor(parser, r);
+    monitor.tick(script, 0);
+    return r;
+}
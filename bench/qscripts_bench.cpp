@@ -0,0 +1,308 @@
+/*
+qscripts-bench: measures the QScripts engine (see qscripts_core.hpp) on
+synthetic script trees, without IDA.
+
+The generated tree has a notebook main script with M cells and N dependency
+scripts spread over D levels: the main script's index lists the first level,
+and each script of a level has its own index listing its share of the next
+level. Five costs are measured:
+
+    activation      loading the active script: parsing all the index files
+    idle_tick       one monitor tick when nothing changed
+    detect_dep      the tick that notices a change to a script of the last level
+    detect_cell     the tick that notices a change to the last notebook cell
+    reparse         the tick that notices a change to the main index file, then
+                    reloads the active script
+
+Each line of the output holds one measurement with the tree parameters, in a
+fixed 'key=value' format, so the results of different commits can be compared
+with a diff or a script. The times are in microseconds.
+
+Usage: qscripts-bench [--deps N] [--depth D] [--cells M] [--iterations I] [--dir path]
+*/
+#include <unordered_map>
+#include <string>
+#include <regex>
+#include <filesystem>
+#include <unordered_set>
+#include <map>
+#include <set>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <chrono>
+#include <system_error>
+
+#include "stub_sdk.h"
+#include "qscripts_core.hpp"
+#include "engine_tick.hpp"
+
+namespace fs = std::filesystem;
+
+static constexpr int BENCH_FORMAT_VERSION = 1;
+
+struct bench_params_t
+{
+    int deps = 200;
+    int depth = 4;
+    int cells = 50;
+    int iterations = 200;
+    std::string dir;
+};
+
+//-------------------------------------------------------------------------
+// Synthetic script tree
+class bench_tree_t
+{
+    fs::path root;
+    fs::file_time_type base_time;
+    int ntouches = 0;
+
+    static void write_file(const fs::path &path, const std::string &text)
+    {
+        fs::create_directories(path.parent_path());
+        FILE *fp = qfopen(path.string().c_str(), "w");
+        if (fp == nullptr)
+        {
+            fprintf(stderr, "qscripts-bench: cannot create '%s'\n", path.string().c_str());
+            exit(1);
+        }
+        fwrite(text.data(), 1, text.size(), fp);
+        qfclose(fp);
+    }
+
+    // The index of a script lives in its '.qscripts' folder
+    static fs::path index_of(const fs::path &script)
+    {
+        return script.parent_path() / QSCRIPTS_LOCAL / (script.filename().string() + ".deps");
+    }
+
+public:
+    fs::path main_script;
+    fs::path main_index;
+    fs::path last_dep;
+    fs::path last_cell;
+
+    void generate(const bench_params_t &p)
+    {
+        root = p.dir;
+        fs::remove_all(root);
+        base_time = fs::file_time_type::clock::now() - std::chrono::hours(1);
+
+        // Spread the dependencies over the levels
+        std::vector<std::vector<fs::path>> levels(p.depth);
+        for (int i = 0; i < p.deps; ++i)
+        {
+            int level = int(int64(i) * p.depth / p.deps);
+            char name[64];
+            snprintf(name, sizeof(name), "dep_%04d.py", i);
+            fs::path dep = root / "lib" / ("l" + std::to_string(level)) / name;
+            write_file(dep, "# dependency\n");
+            levels[level].push_back(dep);
+            last_dep = dep;
+        }
+
+        // Each script of a level lists its share of the next level
+        for (int level = 0; level + 1 < p.depth; ++level)
+        {
+            auto &cur = levels[level];
+            auto &next = levels[level + 1];
+            if (cur.empty())
+                continue;
+            std::vector<std::string> indices(cur.size());
+            for (size_t i = 0; i < next.size(); ++i)
+                indices[i % cur.size()] += "../l" + std::to_string(level + 1) + "/" + next[i].filename().string() + "\n";
+            for (size_t i = 0; i < cur.size(); ++i)
+            {
+                if (!indices[i].empty())
+                    write_file(index_of(cur[i]), indices[i]);
+            }
+        }
+
+        // The notebook main script and its cells
+        main_script = root / "nb" / "main.py";
+        main_index = index_of(main_script);
+        write_file(main_script, "# notebook\n");
+        std::string index = "/notebook bench\n/pkgbase ../lib\n/reload import importlib; importlib.reload($pkgmodname$)\n";
+        if (p.depth > 0)
+        {
+            for (auto &dep : levels[0])
+                index += "$pkgbase$/l0/" + dep.filename().string() + "\n";
+        }
+        write_file(main_index, index);
+        for (int i = 0; i < p.cells; ++i)
+        {
+            char name[64];
+            snprintf(name, sizeof(name), "%04d_cell.py", i);
+            last_cell = main_script.parent_path() / name;
+            write_file(last_cell, "# cell\n");
+        }
+    }
+
+    // Gives a file a new modification time. The time-stamps have a one second
+    // resolution, so each touch moves one second further instead of using the clock.
+    void touch(const fs::path &path)
+    {
+        fs::last_write_time(path, base_time + std::chrono::seconds(++ntouches));
+    }
+
+    void remove()
+    {
+        std::error_code ec;
+        fs::remove_all(root, ec);
+    }
+};
+
+//-------------------------------------------------------------------------
+struct bench_result_t
+{
+    std::vector<double> us;
+
+    double percentile(int p) const
+    {
+        std::vector<double> sorted = us;
+        std::sort(sorted.begin(), sorted.end());
+        size_t rank = (p * sorted.size() + 99) / 100;
+        return sorted[rank == 0 ? 0 : rank - 1];
+    }
+
+    double mean() const
+    {
+        double sum = 0;
+        for (double v : us)
+            sum += v;
+        return sum / us.size();
+    }
+};
+
+template <typename F>
+static bench_result_t measure(int iterations, F body)
+{
+    bench_result_t r;
+    for (int i = 0; i < iterations; ++i)
+    {
+        uint64 start = get_nsec_stamp();
+        body();
+        r.us.push_back((get_nsec_stamp() - start) / 1000.0);
+    }
+    return r;
+}
+
+static void report(const char *name, const bench_params_t &p, const bench_result_t &r)
+{
+    printf("bench=%-12s deps=%d depth=%d cells=%d runs=%u min_us=%.1f p50_us=%.1f p95_us=%.1f max_us=%.1f mean_us=%.1f\n",
+        name,
+        p.deps,
+        p.depth,
+        p.cells,
+        uint(r.us.size()),
+        r.percentile(0),
+        r.percentile(50),
+        r.percentile(95),
+        r.percentile(100),
+        r.mean());
+    fflush(stdout);
+}
+
+//-------------------------------------------------------------------------
+static void usage()
+{
+    fprintf(stderr, "Usage: qscripts-bench [--deps N] [--depth D] [--cells M] [--iterations I] [--dir path]\n");
+    exit(2);
+}
+
+static bench_params_t parse_args(int argc, char *argv[])
+{
+    bench_params_t p;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (i + 1 >= argc)
+            usage();
+        const char *val = argv[++i];
+        if (arg == "--deps")
+            p.deps = atoi(val);
+        else if (arg == "--depth")
+            p.depth = atoi(val);
+        else if (arg == "--cells")
+            p.cells = atoi(val);
+        else if (arg == "--iterations")
+            p.iterations = atoi(val);
+        else if (arg == "--dir")
+            p.dir = val;
+        else
+            usage();
+    }
+    if (p.deps < 0 || p.depth < 1 || p.cells < 0 || p.iterations < 1)
+        usage();
+    if (p.dir.empty())
+        p.dir = (fs::temp_directory_path() / ("qscripts-bench-" + std::to_string(getpid()))).string();
+    return p;
+}
+
+int main(int argc, char *argv[])
+{
+    bench_params_t p = parse_args(argc, argv);
+    bench_tree_t tree;
+    tree.generate(p);
+    printf("qscripts-bench format=%d deps=%d depth=%d cells=%d iterations=%d\n",
+        BENCH_FORMAT_VERSION, p.deps, p.depth, p.cells, p.iterations);
+
+    active_script_info_t script;
+    deps_parser_t parser(script);
+    qstring main_script = tree.main_script.string().c_str();
+
+    report("activation", p, measure(p.iterations, [&]
+    {
+        parser.load_active_script(script, main_script.c_str());
+    }));
+    if (script.dep_scripts.size() != size_t(p.deps) || script.notebook.cell_files.size() != size_t(p.cells))
+    {
+        fprintf(stderr, "qscripts-bench: the engine found %u dependencies and %u cells instead of %d and %d\n",
+            uint(script.dep_scripts.size()), uint(script.notebook.cell_files.size()), p.deps, p.cells);
+        tree.remove();
+        return 1;
+    }
+
+    // Settle the time-stamps before measuring the ticks
+    engine_tick(parser, script);
+
+    report("idle_tick", p, measure(p.iterations, [&]
+    {
+        engine_tick(parser, script);
+    }));
+
+    struct { const char *name; const fs::path *file; } changes[] =
+    {
+        { "detect_dep",  &tree.last_dep },
+        { "detect_cell", &tree.last_cell },
+        { "reparse",     &tree.main_index },
+    };
+    for (auto &change : changes)
+    {
+        if (change.file->empty())
+            continue;
+
+        bench_result_t r;
+        for (int i = 0; i < p.iterations; ++i)
+        {
+            tree.touch(*change.file);
+            uint64 start = get_nsec_stamp();
+            bool detected = engine_tick(parser, script).detected();
+            r.us.push_back((get_nsec_stamp() - start) / 1000.0);
+            if (!detected)
+            {
+                fprintf(stderr, "qscripts-bench: %s: the change was not detected\n", change.name);
+                tree.remove();
+                return 1;
+            }
+            // The reparse invalidates all the time-stamps: settle them again
+            engine_tick(parser, script);
+        }
+        report(change.name, p, r);
+    }
+
+    tree.remove();
+    return 0;
+}
@@ -0,0 +1,475 @@
+/*
+qscripts-replay: replays a session journal (see session_journal.hpp) against
+a scratch copy of the recorded script tree, without IDA.
+
+The scratch tree is created from the files the journal snapshots when a script
+is activated (the index files with their content, the other files empty). The
+recorded changes are then applied at their recorded time, with their recorded
+time-stamps, while the engine ticks at the recorded monitor interval. The replay
+reports:
+
+    missed      the changes the engine never detected
+    duplicates  the executions that no change explains (both in the recorded
+                session and in the replay)
+    latency     the time from each change to the tick that detected it
+
+--speed 1 replays at the recorded pace, --speed 10 ten times faster, and
+--speed 0 uses a simulated clock: the ticks happen at their scheduled times
+without waiting, so the replay is deterministic. Each line of the output is in
+a fixed 'key=value' format; the times are in the journal's time scale.
+
+Usage: qscripts-replay journal [--speed X] [--dir path] [--keep]
+*/
+#include <unordered_map>
+#include <string>
+#include <regex>
+#include <filesystem>
+#include <unordered_set>
+#include <map>
+#include <set>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "stub_sdk.h"
+#include "qscripts_core.hpp"
+#include "engine_tick.hpp"
+
+namespace fs = std::filesystem;
+
+static constexpr int REPLAY_FORMAT_VERSION = 1;
+static constexpr int REPLAY_DRAIN_TICKS = 5; // ticks after the last record to let the engine catch up
+
+struct replay_params_t
+{
+    std::string journal;
+    double speed = 1;
+    std::string dir;
+    bool keep = false;
+};
+
+//-------------------------------------------------------------------------
+// Journal time: real time scaled by the speed, or a simulated clock
+class replay_clock_t
+{
+    double speed;
+    uint64 real_start;
+    uint64 sim_us = 0;
+
+public:
+    replay_clock_t(double speed) : speed(speed), real_start(get_nsec_stamp()) {}
+
+    uint64 now() const
+    {
+        return speed > 0 ? uint64((get_nsec_stamp() - real_start) / 1000 * speed) : sim_us;
+    }
+
+    void wait_until(uint64 t_us)
+    {
+        if (speed <= 0)
+        {
+            sim_us = qmax(sim_us, t_us);
+            return;
+        }
+        uint64 cur = now();
+        if (t_us > cur)
+            std::this_thread::sleep_for(std::chrono::microseconds(uint64((t_us - cur) / speed)));
+    }
+};
+
+//-------------------------------------------------------------------------
+class replayer_t
+{
+    struct active_t
+    {
+        std::unique_ptr<active_script_info_t> script;
+        std::unique_ptr<deps_parser_t> parser;
+        int interval_ms = 500;
+        uint64 next_tick_us = 0;
+        bool expect_exec = false;   // the re-parse invalidated everything: the next execution is expected
+    };
+
+    replay_params_t params;
+    std::vector<journal_record_t> records;
+    fs::path root;
+    fs::path scratch;
+    std::map<std::string, active_t> active;     // by recorded path
+    std::set<std::string> created;
+
+    // Recorded path -> journal times of the changes not detected yet
+    std::map<std::string, std::vector<uint64>> pending;
+
+    // Statistics
+    uint64 live_detections = 0, live_execs = 0, live_reloads = 0, live_duplicates = 0;
+    uint64 injected = 0, detected = 0, replay_execs = 0, replay_duplicates = 0, ticks = 0;
+    std::vector<double> latency_ms;
+    std::vector<double> tick_us;
+
+    std::string to_scratch(const std::string &path) const
+    {
+        return (scratch / fs::path(path).lexically_relative(root)).string();
+    }
+
+    std::string to_recorded(const std::string &path) const
+    {
+        return (root / fs::path(path).lexically_relative(scratch)).string();
+    }
+
+    static void set_mtime(const std::string &path, qtime64_t mtime)
+    {
+        struct timespec ts[2];
+        ts[0].tv_sec = ts[1].tv_sec = time_t(mtime);
+        ts[0].tv_nsec = ts[1].tv_nsec = 0;
+        utimensat(AT_FDCWD, path.c_str(), ts, 0);
+    }
+
+    // Writes a file of the scratch tree. The index files refer to the recorded tree.
+    void write_file(const journal_file_t &f)
+    {
+        std::string path = to_scratch(f.path.c_str());
+        std::error_code ec;
+        fs::create_directories(fs::path(path).parent_path(), ec);
+
+        qstring content = f.kind == JF_INDEX ? f.content : qstring("# replayed\n");
+        if (f.kind == JF_INDEX && root != root.root_path())
+            content.replace(root.string().c_str(), scratch.string().c_str());
+        FILE *fp = qfopen(path.c_str(), "wb");
+        if (fp == nullptr)
+            return;
+        qfwrite(fp, content.c_str(), content.length());
+        qfclose(fp);
+        set_mtime(path, f.mtime);
+        created.insert(f.path.c_str());
+    }
+
+    // The common ancestor of all the recorded files
+    void find_root()
+    {
+        bool first = true;
+        auto add = [&](const qstring &file)
+        {
+            fs::path dir = fs::path(file.c_str()).parent_path();
+            if (first)
+            {
+                root = dir;
+                first = false;
+                return;
+            }
+            fs::path common;
+            auto a = root.begin(), b = dir.begin();
+            for (; a != root.end() && b != dir.end() && *a == *b; ++a, ++b)
+                common /= *a;
+            root = common;
+        };
+        for (auto &r : records)
+        {
+            if (!r.path.empty())
+                add(r.path);
+            for (auto &f : r.files)
+                add(f.path);
+        }
+    }
+
+    // Creates the files of all the snapshots, as they were when first seen. The files
+    // that only appear in a change are created just before their first change.
+    void create_tree()
+    {
+        std::error_code ec;
+        fs::remove_all(scratch, ec);
+        fs::create_directories(scratch, ec);
+        for (auto &r : records)
+        {
+            if (r.type == JR_ACTIVATE)
+            {
+                for (auto &f : r.files)
+                {
+                    if (f.mtime != 0 && created.find(f.path.c_str()) == created.end())
+                        write_file(f);
+                }
+            }
+            else if (r.type == JR_CHANGE && r.mtime != 0 && created.find(r.path.c_str()) == created.end())
+            {
+                journal_file_t f;
+                f.path    = r.path;
+                f.kind    = r.kind;
+                f.mtime   = r.mtime - 1;
+                f.content = r.content;
+                write_file(f);
+            }
+        }
+    }
+
+    void activate(const journal_record_t &r, uint64 now)
+    {
+        auto p = active.find(r.path.c_str());
+        if (p != active.end())
+        {
+            // Re-loaded after an index change: the replay re-parses on its own
+            p->second.interval_ms = r.interval_ms;
+            return;
+        }
+
+        active_t &a = active[r.path.c_str()];
+        a.script.reset(new active_script_info_t());
+        a.parser.reset(new deps_parser_t(*a.script));
+        a.interval_ms = r.interval_ms > 0 ? r.interval_ms : 500;
+        a.parser->load_active_script(*a.script, to_scratch(r.path.c_str()).c_str());
+        a.next_tick_us = now + a.interval_ms * 1000ULL;
+    }
+
+    void apply_change(const journal_record_t &r, uint64 now)
+    {
+        ++live_detections;
+        std::string path = to_scratch(r.path.c_str());
+        qtime64_t cur_mtime = 0;
+        bool exists = get_file_modification_time(path.c_str(), &cur_mtime);
+        if (r.mtime == 0)
+        {
+            if (!exists)
+                return;
+            std::error_code ec;
+            fs::remove(path, ec);
+        }
+        else
+        {
+            // Re-detected after a re-parse invalidated the time-stamps: nothing changed on disk
+            if (exists && cur_mtime == r.mtime && r.kind != JF_INDEX)
+                return;
+            journal_file_t f;
+            f.path    = r.path;
+            f.kind    = r.kind;
+            f.mtime   = r.mtime;
+            f.content = r.content;
+            write_file(f);
+        }
+        ++injected;
+        pending[r.path.c_str()].push_back(now);
+    }
+
+    // Returns false if the script is gone
+    bool tick(active_t &a, uint64 now)
+    {
+        uint64 start = get_nsec_stamp();
+        engine_tick_t r = engine_tick(*a.parser, *a.script);
+        tick_us.push_back((get_nsec_stamp() - start) / 1000.0);
+        ++ticks;
+
+        bool covered = false;
+        for (auto &file : r.changed)
+        {
+            auto p = pending.find(to_recorded(file));
+            if (p == pending.end())
+                continue;
+            for (uint64 t : p->second)
+            {
+                latency_ms.push_back((now - t) / 1000.0);
+                ++detected;
+            }
+            pending.erase(p);
+            covered = true;
+        }
+        if (!r.executed.empty())
+        {
+            ++replay_execs;
+            if (!covered && !a.expect_exec)
+                ++replay_duplicates;
+            a.expect_exec = false;
+        }
+        if (r.reparsed)
+            a.expect_exec = true;
+
+        // Like the plugin, come back right away after a re-parse
+        a.next_tick_us = now + (r.reparsed ? 1000ULL : a.interval_ms * 1000ULL);
+        return !r.gone;
+    }
+
+    // Runs the ticks due until the given journal time
+    void run_ticks_until(replay_clock_t &clock, uint64 t_us)
+    {
+        while (true)
+        {
+            auto next = active.end();
+            for (auto it = active.begin(); it != active.end(); ++it)
+            {
+                if (next == active.end() || it->second.next_tick_us < next->second.next_tick_us)
+                    next = it;
+            }
+            if (next == active.end() || next->second.next_tick_us > t_us)
+                return;
+
+            clock.wait_until(next->second.next_tick_us);
+            if (!tick(next->second, qmax(clock.now(), next->second.next_tick_us)))
+                active.erase(next);
+        }
+    }
+
+    static void print_distribution(const char *name, const char *unit, std::vector<double> v)
+    {
+        if (v.empty())
+        {
+            printf("%s runs=0\n", name);
+            return;
+        }
+        std::sort(v.begin(), v.end());
+        auto pct = [&v](int p) { size_t rank = (p * v.size() + 99) / 100; return v[rank == 0 ? 0 : rank - 1]; };
+        double sum = 0;
+        for (double x : v)
+            sum += x;
+        printf("%s runs=%u min_%s=%.1f p50_%s=%.1f p95_%s=%.1f max_%s=%.1f mean_%s=%.1f\n",
+            name,
+            uint(v.size()),
+            unit, v.front(),
+            unit, pct(50),
+            unit, pct(95),
+            unit, v.back(),
+            unit, sum / v.size());
+    }
+
+public:
+    replayer_t(const replay_params_t &p) : params(p) {}
+
+    bool load(qstring *errbuf)
+    {
+        session_journal_reader_t reader;
+        if (!reader.open(params.journal.c_str(), errbuf))
+            return false;
+        journal_record_t r;
+        while (reader.next(&r))
+            records.push_back(std::move(r));
+        if (reader.is_truncated())
+            fprintf(stderr, "qscripts-replay: the journal ends with a truncated record\n");
+
+        if (std::none_of(records.begin(), records.end(), [](const journal_record_t &r) { return r.type == JR_ACTIVATE; }))
+        {
+            errbuf->sprnt("the journal has no active script");
+            return false;
+        }
+        find_root();
+        scratch = params.dir.empty()
+                ? fs::temp_directory_path() / ("qscripts-replay-" + std::to_string(getpid()))
+                : fs::path(params.dir);
+        return true;
+    }
+
+    void run()
+    {
+        create_tree();
+
+        replay_clock_t clock(params.speed);
+        uint64 last_t = 0;
+        bool changed_since_exec = true;
+        for (auto &r : records)
+        {
+            run_ticks_until(clock, r.t_us);
+            clock.wait_until(r.t_us);
+            uint64 now = qmax(clock.now(), r.t_us);
+            last_t = r.t_us;
+            switch (r.type)
+            {
+                case JR_ACTIVATE:
+                    activate(r, now);
+                    break;
+                case JR_DEACTIVATE:
+                    active.erase(r.path.c_str());
+                    break;
+                case JR_CHANGE:
+                    apply_change(r, now);
+                    changed_since_exec = true;
+                    break;
+                case JR_RELOAD:
+                    ++live_reloads;
+                    break;
+                case JR_EXEC:
+                    ++live_execs;
+                    if (!changed_since_exec)
+                        ++live_duplicates;
+                    changed_since_exec = false;
+                    break;
+            }
+        }
+
+        // Give the engine a few more ticks to notice the last changes
+        int max_interval = 0;
+        for (auto &kv : active)
+            max_interval = qmax(max_interval, kv.second.interval_ms);
+        run_ticks_until(clock, qmax(clock.now(), last_t) + uint64(REPLAY_DRAIN_TICKS) * max_interval * 1000);
+
+        if (!params.keep)
+        {
+            std::error_code ec;
+            fs::remove_all(scratch, ec);
+        }
+    }
+
+    void report()
+    {
+        uint64 missed = 0;
+        for (auto &kv : pending)
+            missed += kv.second.size();
+
+        printf("qscripts-replay format=%d speed=%g records=%u duration_ms=%.1f\n",
+            REPLAY_FORMAT_VERSION,
+            params.speed,
+            uint(records.size()),
+            records.empty() ? 0.0 : records.back().t_us / 1000.0);
+        printf("live detections=%" FMT_64 "u executions=%" FMT_64 "u reloads=%" FMT_64 "u duplicates=%" FMT_64 "u\n",
+            live_detections, live_execs, live_reloads, live_duplicates);
+        printf("replay changes=%" FMT_64 "u detected=%" FMT_64 "u missed=%" FMT_64 "u executions=%" FMT_64 "u duplicates=%" FMT_64 "u ticks=%" FMT_64 "u\n",
+            injected, detected, missed, replay_execs, replay_duplicates, ticks);
+        print_distribution("latency", "ms", latency_ms);
+        print_distribution("tick", "us", tick_us);
+        for (auto &kv : pending)
+        {
+            for (uint64 t : kv.second)
+                printf("missed t_ms=%.1f file=%s\n", t / 1000.0, kv.first.c_str());
+        }
+        if (params.keep)
+            printf("scratch dir=%s\n", scratch.string().c_str());
+    }
+};
+
+//-------------------------------------------------------------------------
+static void usage()
+{
+    fprintf(stderr, "Usage: qscripts-replay journal [--speed X] [--dir path] [--keep]\n");
+    exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+    replay_params_t p;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--keep")
+            p.keep = true;
+        else if (arg == "--speed" && i + 1 < argc)
+            p.speed = atof(argv[++i]);
+        else if (arg == "--dir" && i + 1 < argc)
+            p.dir = argv[++i];
+        else if (arg[0] != '-' && p.journal.empty())
+            p.journal = arg;
+        else
+            usage();
+    }
+    if (p.journal.empty() || p.speed < 0)
+        usage();
+
+    replayer_t replayer(p);
+    qstring err;
+    if (!replayer.load(&err))
+    {
+        fprintf(stderr, "qscripts-replay: %s\n", err.c_str());
+        return 1;
+    }
+    replayer.run();
+    replayer.report();
+    return 0;
+}
@@ -0,0 +1,460 @@
+/*
+qscripts-watch: runs the QScripts monitor engine (see qscripts_core.hpp) outside
+IDA, for pipelines that use the dependency index semantics ('/reload',
+'/pkgbase', '/triggerfile', '/notebook', '$pkgmodname$'...) and to profile the
+watcher on its own.
+
+The script's dependency graph is resolved with the plugin's parser and then
+checked every --interval ms with the plugin's tick (see script_monitor.hpp),
+including the trigger file readiness checks and the trigger pipe. Each event
+is printed on its own line:
+
+    t_ms=... event=change  file=...      a file changed
+    t_ms=... event=reload  file=... cmd=...
+                                         a dependency with a reload directive
+                                         changed (the command is expanded)
+    t_ms=... event=reparse file=...      an index file changed: the graph was re-loaded
+    t_ms=... event=exec    file=...      the file the plugin would execute
+    t_ms=... event=gone    file=...      the script no longer exists (the tool exits)
+
+With --exec, a shell command is also run for each event of the kinds given by
+--on (exec and reload by default). $event$, $file$, $script$ and $cmd$ (the
+reload command) are replaced by their values, quoted for the shell.
+
+The tick timings are printed with --ticks (one line per tick) and summarized
+every --report seconds and on exit, in the same 'key=value' format as
+qscripts-bench.
+
+Usage: qscripts-watch script [--interval ms] [--exec cmd] [--on kinds] [--deps]
+                             [--ticks] [--report secs] [--max-ticks N]
+*/
+#include <unordered_map>
+#include <string>
+#include <regex>
+#include <filesystem>
+#include <unordered_set>
+#include <map>
+#include <set>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <system_error>
+
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "stub_sdk.h"
+#include "qscripts_core.hpp"
+
+struct watch_params_t
+{
+    std::string script;
+    int interval_ms = 500;
+    std::string exec_cmd;
+    std::set<std::string> exec_on = { "exec", "reload" };
+    bool print_deps = false;
+    bool print_ticks = false;
+    int report_secs = 0;
+    uint64 max_ticks = 0;
+};
+
+static std::atomic<bool> g_stop{ false };
+
+//-------------------------------------------------------------------------
+// Reads the trigger pipe ('/triggerpipe') on each tick, like the plugin's
+// listener: each line written to the FIFO is a trigger, and a trailing line
+// without a new line character is flushed once nothing more was written.
+class trigger_fifo_t
+{
+    int fd = -1;
+    std::string data;
+    bool pending = false;
+
+public:
+    ~trigger_fifo_t()
+    {
+        close_fifo();
+    }
+
+    bool open_fifo(const char *path)
+    {
+        close_fifo();
+        struct stat st;
+        if (stat(path, &st) != 0 ? mkfifo(path, 0600) != 0 : !S_ISFIFO(st.st_mode))
+            return false;
+
+        // Opening for both reading and writing never blocks and keeps the FIFO
+        // open between writers (no end-of-file after each writer)
+        fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        return fd != -1;
+    }
+
+    void close_fifo()
+    {
+        if (fd != -1)
+        {
+            close(fd);
+            fd = -1;
+        }
+        data.clear();
+        pending = false;
+    }
+
+    // Tells if a trigger was written since the last call
+    bool consume()
+    {
+        if (fd == -1)
+            return false;
+
+        char buf[4096];
+        ssize_t n;
+        bool got_data = false;
+        while ((n = read(fd, buf, sizeof(buf))) > 0)
+        {
+            data.append(buf, size_t(n));
+            got_data = true;
+        }
+
+        size_t nl = data.rfind('\n');
+        if (nl != std::string::npos)
+        {
+            data.erase(0, nl + 1);
+            pending = true;
+        }
+        else if (!got_data && !data.empty())
+        {
+            data.clear();
+            pending = true;
+        }
+
+        bool r = pending;
+        pending = false;
+        return r;
+    }
+};
+
+//-------------------------------------------------------------------------
+// The plugin's monitor tick (see script_monitor.hpp), reporting the events
+class watcher_t : public script_monitor_t
+{
+    watch_params_t params;
+    active_script_info_t script;
+    deps_parser_t parser{ script };
+    file_readiness_t trigger_ready;
+    trigger_fifo_t trigger_fifo;
+    uint64 start_ns = 0;
+    bool gone = false;
+    bool quiet = false;     // the events are not reported
+
+    // Tick durations since the last summary
+    std::vector<double> tick_us;
+    uint64 nticks = 0;
+
+    double elapsed_ms() const
+    {
+        return (get_nsec_stamp() - start_ns) / 1000000.0;
+    }
+
+    // The expanded reload command of a dependency (empty if it has none)
+    qstring reload_command(const script_info_t &dep)
+    {
+        qstring cmd;
+        if (!dep.has_reload_directive())
+            return cmd;
+        expand_ctx_t ctx;
+        ctx.script_file = dep.file_path;
+        ctx.main_file   = false;
+        ctx.script      = &script;
+        ctx.pkg_base    = dep.pkg_base;
+        qstring reload_cmd = dep.reload_cmd;
+        parser.expand_string(reload_cmd, cmd, ctx);
+        return cmd;
+    }
+
+    void emit(const char *event, const std::string &file, const qstring &cmd = qstring())
+    {
+        if (quiet)
+            return;
+        if (cmd.empty())
+            printf("t_ms=%.1f event=%s file=%s\n", elapsed_ms(), event, file.c_str());
+        else
+            printf("t_ms=%.1f event=%s file=%s cmd=%s\n", elapsed_ms(), event, file.c_str(), cmd.c_str());
+        fflush(stdout);
+
+        if (params.exec_cmd.empty() || params.exec_on.find(event) == params.exec_on.end())
+            return;
+        qstring command = params.exec_cmd.c_str();
+        command.replace("$event$",  shell_quote(event).c_str());
+        command.replace("$file$",   shell_quote(file.c_str()).c_str());
+        command.replace("$script$", shell_quote(script.file_path.c_str()).c_str());
+        command.replace("$cmd$",    shell_quote(cmd.c_str()).c_str());
+        int rc = system(command.c_str());
+        if (rc != 0)
+            fprintf(stderr, "qscripts-watch: the command of the %s event exited with %d\n", event, rc);
+    }
+
+    // Sets up the trigger file and pipe of the loaded script, like the plugin's activation
+    void activated()
+    {
+        if (script.trigger_based())
+        {
+            int samples = script.trigger_samples;
+            trigger_ready.watch(
+                script.trigger_file.c_str(),
+                samples == -1 ? TRIGGER_READY_SAMPLES : samples);
+        }
+        else
+        {
+            trigger_ready.unwatch();
+        }
+
+        trigger_fifo.close_fifo();
+        if (script.pipe_triggered() && !trigger_fifo.open_fifo(script.trigger_pipe.c_str()))
+            fprintf(stderr, "qscripts-watch: failed to open the trigger pipe '%s'\n", script.trigger_pipe.c_str());
+    }
+
+    void on_change(active_script_info_t &, const char *file, int kind) override
+    {
+        // The dependencies with a reload directive are reported as a reload
+        if (kind == JF_DEP)
+        {
+            const script_info_t *dep = script.has_dep(file);
+            if (dep != nullptr && dep->has_reload_directive())
+                return;
+        }
+        emit("change", file);
+    }
+
+    bool on_reparse(active_script_info_t &) override
+    {
+        parser.load_active_script(script, script.file_path.c_str());
+        activated();
+        emit("reparse", script.file_path.c_str());
+        return true;
+    }
+
+    bool on_reload(active_script_info_t &, script_info_t &dep_script) override
+    {
+        emit("reload", dep_script.file_path.c_str(), reload_command(dep_script));
+        return true;
+    }
+
+    bool consume_trigger(active_script_info_t &) override
+    {
+        return trigger_fifo.consume();
+    }
+
+    void on_gone(active_script_info_t &, const char *file) override
+    {
+        emit("gone", file);
+        gone = true;
+    }
+
+    void on_execute(active_script_info_t &, active_script_info_t &work_script, bool, bool) override
+    {
+        emit("exec", work_script.file_path.c_str());
+    }
+
+    void report_ticks()
+    {
+        if (tick_us.empty())
+            return;
+        std::vector<double> v = tick_us;
+        std::sort(v.begin(), v.end());
+        auto pct = [&v](int p) { size_t rank = (p * v.size() + 99) / 100; return v[rank == 0 ? 0 : rank - 1]; };
+        double sum = 0;
+        for (double x : v)
+            sum += x;
+        printf("t_ms=%.1f ticks runs=%u deps=%u min_us=%.1f p50_us=%.1f p95_us=%.1f max_us=%.1f mean_us=%.1f\n",
+            elapsed_ms(),
+            uint(v.size()),
+            uint(script.dep_scripts.size()),
+            v.front(),
+            pct(50),
+            pct(95),
+            v.back(),
+            sum / v.size());
+        fflush(stdout);
+        tick_us.clear();
+    }
+
+    // Returns the delay until the next tick (-1 to stop)
+    int timed_tick()
+    {
+        file_stat_tick_t stat_tick;
+        uint64 t0 = get_nsec_stamp();
+        int delay = tick(script, params.interval_ms);
+        double us = (get_nsec_stamp() - t0) / 1000.0;
+        tick_us.push_back(us);
+        ++nticks;
+        if (params.print_ticks)
+            printf("t_ms=%.1f tick n=%" FMT_64 "u us=%.1f\n", elapsed_ms(), nticks, us);
+        return gone ? -1 : delay;
+    }
+
+public:
+    watcher_t(const watch_params_t &p) : script_monitor_t(&trigger_ready), params(p) {}
+
+    bool load()
+    {
+        qstring path = params.script.c_str();
+        make_abs_path(path, std::filesystem::current_path().string().c_str(), true);
+        if (!get_file_modification_time(path.c_str()))
+        {
+            fprintf(stderr, "qscripts-watch: '%s' does not exist\n", path.c_str());
+            return false;
+        }
+        start_ns = get_nsec_stamp();
+        parser.load_active_script(script, path.c_str());
+        activated();
+        printf("t_ms=%.1f load script=%s deps=%u indices=%u\n",
+            elapsed_ms(),
+            script.file_path.c_str(),
+            uint(script.dep_scripts.size()),
+            uint(script.dep_indices.size()));
+        fflush(stdout);
+        return true;
+    }
+
+    // Prints the resolved dependency graph
+    void print_deps()
+    {
+        printf("script=%s\n", script.file_path.c_str());
+        if (!script.pkg_base.empty())
+            printf("pkgbase=%s\n", script.pkg_base.c_str());
+        for (auto &index : script.dep_indices)
+            printf("index=%s\n", index.file_path.c_str());
+
+        std::vector<const script_info_t *> deps;
+        for (auto &kv : script.dep_scripts)
+            deps.push_back(&kv.second);
+        std::sort(deps.begin(), deps.end(), [](auto a, auto b) { return strcmp(a->file_path.c_str(), b->file_path.c_str()) < 0; });
+        for (auto dep : deps)
+        {
+            qstring cmd = reload_command(*dep);
+            if (cmd.empty())
+                printf("dep=%s\n", dep->file_path.c_str());
+            else
+                printf("dep=%s reload=%s\n", dep->file_path.c_str(), cmd.c_str());
+        }
+        if (script.is_notebook())
+            printf("notebook=%s cells=%u\n", script.notebook.title.c_str(), uint(script.notebook.cell_files.size()));
+        if (script.trigger_based())
+            printf("triggerfile=%s keep=%d\n", script.trigger_file.file_path.c_str(), script.b_keep_trigger_file ? 1 : 0);
+        if (script.pipe_triggered())
+            printf("triggerpipe=%s\n", script.trigger_pipe.c_str());
+        if (script.has_build())
+            printf("build=%s\n", script.build_cmd.c_str());
+    }
+
+    int run()
+    {
+        // The first tick settles the time-stamps taken while loading
+        {
+            file_stat_tick_t stat_tick;
+            quiet = true;
+            tick(script, params.interval_ms);
+            quiet = false;
+        }
+
+        uint64 last_report = get_nsec_stamp();
+        int rc = 0;
+        while (!g_stop)
+        {
+            int delay = timed_tick();
+            if (delay < 0)
+            {
+                rc = 1;
+                break;
+            }
+            if (params.max_ticks != 0 && nticks >= params.max_ticks)
+                break;
+            if (params.report_secs > 0 && get_nsec_stamp() - last_report >= params.report_secs * 1000000000ULL)
+            {
+                report_ticks();
+                last_report = get_nsec_stamp();
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+        }
+        report_ticks();
+        return rc;
+    }
+};
+
+//-------------------------------------------------------------------------
+static void usage()
+{
+    fprintf(stderr,
+        "Usage: qscripts-watch script [--interval ms] [--exec cmd] [--on kinds] [--deps]\n"
+        "                             [--ticks] [--report secs] [--max-ticks N]\n");
+    exit(2);
+}
+
+static watch_params_t parse_args(int argc, char *argv[])
+{
+    watch_params_t p;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool has_val = i + 1 < argc;
+        if (arg == "--deps")
+            p.print_deps = true;
+        else if (arg == "--ticks")
+            p.print_ticks = true;
+        else if (arg == "--interval" && has_val)
+            p.interval_ms = atoi(argv[++i]);
+        else if (arg == "--exec" && has_val)
+            p.exec_cmd = argv[++i];
+        else if (arg == "--report" && has_val)
+            p.report_secs = atoi(argv[++i]);
+        else if (arg == "--max-ticks" && has_val)
+            p.max_ticks = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--on" && has_val)
+        {
+            // Comma separated event kinds
+            p.exec_on.clear();
+            std::string kinds = argv[++i];
+            for (size_t pos = 0; pos <= kinds.size();)
+            {
+                size_t end = kinds.find(',', pos);
+                if (end == std::string::npos)
+                    end = kinds.size();
+                if (end > pos)
+                    p.exec_on.insert(kinds.substr(pos, end - pos));
+                pos = end + 1;
+            }
+        }
+        else if (arg[0] != '-' && p.script.empty())
+            p.script = arg;
+        else
+            usage();
+    }
+    if (p.script.empty() || p.interval_ms < 1 || p.report_secs < 0)
+        usage();
+    return p;
+}
+
+int main(int argc, char *argv[])
+{
+    watch_params_t p = parse_args(argc, argv);
+
+    struct sigaction sa = {};
+    sa.sa_handler = [](int) { g_stop = true; };
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+
+    watcher_t watcher(p);
+    if (!watcher.load())
+        return 1;
+    if (p.print_deps)
+    {
+        watcher.print_deps();
+        return 0;
+    }
+    return watcher.run();
+}
@@ -0,0 +1,238 @@
+// Implementation of the IDA SDK stub (see stub_sdk.h)
+#include <chrono>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "stub_sdk.h"
+
+//-------------------------------------------------------------------------
+static size_t vappend(std::string *out, const char *format, va_list va)
+{
+    va_list va2;
+    va_copy(va2, va);
+    int n = vsnprintf(nullptr, 0, format, va2);
+    va_end(va2);
+    if (n <= 0)
+        return out->length();
+
+    size_t old_len = out->length();
+    out->resize(old_len + n);
+    vsnprintf(&(*out)[old_len], n + 1, format, va);
+    return out->length();
+}
+
+size_t qstring::sprnt(const char *format, ...)
+{
+    body.clear();
+    va_list va;
+    va_start(va, format);
+    size_t n = vappend(&body, format, va);
+    va_end(va);
+    return n;
+}
+
+size_t qstring::cat_sprnt(const char *format, ...)
+{
+    va_list va;
+    va_start(va, format);
+    size_t n = vappend(&body, format, va);
+    va_end(va);
+    return n;
+}
+
+qstring &qstring::replace(const char *what, const char *with)
+{
+    size_t what_len = strlen(what);
+    if (what_len == 0)
+        return *this;
+
+    size_t with_len = strlen(with);
+    for (size_t pos = body.find(what); pos != std::string::npos; pos = body.find(what, pos + with_len))
+        body.replace(pos, what_len, with);
+    return *this;
+}
+
+qstring &qstring::trim2()
+{
+    static const char ws[] = " \t\r\n\f\v";
+    size_t end = body.find_last_not_of(ws);
+    if (end == std::string::npos)
+    {
+        body.clear();
+        return *this;
+    }
+    body.erase(end + 1);
+    body.erase(0, body.find_first_not_of(ws));
+    return *this;
+}
+
+//-------------------------------------------------------------------------
+int qstat(const char *path, qstatbuf *buf)
+{
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return -1;
+    buf->qst_mtime = st.st_mtime;
+    buf->qst_size  = st.st_size;
+    return 0;
+}
+
+bool qfileexist(const char *file)
+{
+    struct stat st;
+    return stat(file, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+FILE *qfopen(const char *file, const char *mode)
+{
+    return fopen(file, mode);
+}
+
+int qfclose(FILE *fp)
+{
+    return fp == nullptr ? 0 : fclose(fp);
+}
+
+int qfscanf(FILE *fp, const char *format, ...)
+{
+    va_list va;
+    va_start(va, format);
+    int n = vfscanf(fp, format, va);
+    va_end(va);
+    return n;
+}
+
+char *qfgets(char *s, size_t len, FILE *fp)
+{
+    return fgets(s, int(len), fp);
+}
+
+ssize_t qfread(FILE *fp, void *buf, size_t n)
+{
+    size_t r = fread(buf, 1, n, fp);
+    return r == 0 && ferror(fp) ? -1 : ssize_t(r);
+}
+
+ssize_t qfwrite(FILE *fp, const void *buf, size_t n)
+{
+    size_t r = fwrite(buf, 1, n, fp);
+    return r == 0 && n != 0 ? -1 : ssize_t(r);
+}
+
+int qfflush(FILE *fp)
+{
+    return fflush(fp);
+}
+
+int qfseek(FILE *fp, int64 offset, int whence)
+{
+    return fseeko(fp, offset, whence);
+}
+
+int qunlink(const char *file)
+{
+    return unlink(file);
+}
+
+ssize_t qgetline(qstring *buf, FILE *fp)
+{
+    buf->clear();
+    int c;
+    while ((c = fgetc(fp)) != EOF && c != '\n')
+        buf->append(char(c));
+    if (c == EOF && buf->empty())
+        return -1;
+    if (!buf->empty() && buf->last() == '\r')
+        buf->remove_last();
+    return ssize_t(buf->length());
+}
+
+//-------------------------------------------------------------------------
+bool qisabspath(const char *file)
+{
+    return file != nullptr && file[0] == DIRCHAR;
+}
+
+bool qdirname(char *buf, size_t bufsize, const char *file)
+{
+    if (bufsize == 0)
+        return false;
+
+    const char *sep = strrchr(file, DIRCHAR);
+    if (sep == nullptr)
+    {
+        buf[0] = '\0';
+        return false;
+    }
+    size_t len = qmin(size_t(sep - file), bufsize - 1);
+    memmove(buf, file, len);
+    buf[len] = '\0';
+    return true;
+}
+
+const char *qbasename(const char *path)
+{
+    const char *sep = strrchr(path, DIRCHAR);
+    return sep == nullptr ? path : sep + 1;
+}
+
+char *qsplitfile(char *file, char **ext, char **base)
+{
+    char *name = (char *)qbasename(file);
+    if (base != nullptr)
+        *base = name;
+    char *dot = strrchr(name, '.');
+    if (ext != nullptr)
+        *ext = dot == nullptr ? nullptr : dot + 1;
+    if (dot != nullptr)
+        *dot = '\0';
+    return file;
+}
+
+//-------------------------------------------------------------------------
+bool qgetenv(const char *varname, qstring *buf)
+{
+    const char *val = getenv(varname);
+    if (val == nullptr)
+        return false;
+    if (buf != nullptr)
+        *buf = val;
+    return true;
+}
+
+uint64 get_nsec_stamp()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint32 qtime32()
+{
+    return uint32(time(nullptr));
+}
+
+int msg(const char *format, ...)
+{
+    va_list va;
+    va_start(va, format);
+    int n = vfprintf(stderr, format, va);
+    va_end(va);
+    return n;
+}
+
+//-------------------------------------------------------------------------
+ssize_t for_all_extlangs(extlang_visitor_t &ev, bool /*installed*/)
+{
+    static extlang_t langs[] =
+    {
+        { sizeof(extlang_t), 0, 0, "IDC",    "idc" },
+        { sizeof(extlang_t), 0, 0, "Python", "py" },
+    };
+    for (auto &lang : langs)
+    {
+        ssize_t code = ev.visit_extlang(&lang);
+        if (code != 0)
+            return code;
+    }
+    return 0;
+}
@@ -0,0 +1,194 @@
+#pragma once
+
+//-------------------------------------------------------------------------
+// Stub of the IDA SDK subset used by the QScripts engine (see qscripts_core.hpp).
+//
+// The declarations follow the SDK (names, signatures and semantics, such as
+// qstring::size() counting the terminating zero), so the engine headers build
+// unchanged. Only what the engine uses is provided, on top of the C and C++
+// standard libraries.
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#ifdef __MAC__
+    #include <mach/mach.h>
+#endif
+#ifdef __LINUX__
+    #include <sys/inotify.h>
+#endif
+
+//-------------------------------------------------------------------------
+// Basic types and constants
+typedef unsigned char      uchar;
+typedef unsigned int       uint;
+typedef unsigned int       uint32;
+typedef long long          int64;
+typedef unsigned long long uint64;
+typedef int64              qtime64_t;
+
+#define idaapi
+#define FMT_64      "ll"
+#define QMAXPATH    4096
+#define DIRCHAR     '/'
+#define SDIRCHAR    "/"
+#ifdef __MAC__
+    #define LOADER_DLL "*.dylib"
+#else
+    #define LOADER_DLL "*.so"
+#endif
+
+template <class T> constexpr T qmin(const T &a, const T &b) { return a < b ? a : b; }
+template <class T> constexpr T qmax(const T &a, const T &b) { return a > b ? a : b; }
+
+inline int  qstrcmp(const char *s1, const char *s2) { return strcmp(s1, s2); }
+inline bool streq(const char *s1, const char *s2)   { return strcmp(s1, s2) == 0; }
+inline char *qstrrchr(char *s, char c)              { return strrchr(s, c); }
+
+//-------------------------------------------------------------------------
+// Containers
+template <class T>
+class qvector : public std::vector<T>
+{
+public:
+    using std::vector<T>::vector;
+    using std::vector<T>::push_back;
+
+    T &push_back()
+    {
+        this->emplace_back();
+        return this->back();
+    }
+
+    void qclear() { this->clear(); }
+};
+
+class qstring
+{
+    std::string body;
+
+public:
+    static constexpr size_t npos = size_t(-1);
+
+    qstring() {}
+    qstring(const char *s) : body(s == nullptr ? "" : s) {}
+    qstring(const char *s, size_t len) : body(s, len) {}
+
+    const char *c_str() const { return body.c_str(); }
+    char *begin()             { return &body[0]; }
+    const char *begin() const { return body.c_str(); }
+    char *end()               { return begin() + body.length(); }
+    const char *end() const   { return begin() + body.length(); }
+    size_t length() const     { return body.length(); }
+    // Like the SDK, the size includes the terminating zero of a non-empty string
+    size_t size() const       { return body.empty() ? 0 : body.length() + 1; }
+    bool empty() const        { return body.empty(); }
+    void clear()              { body.clear(); }
+    void qclear()             { body.clear(); }
+    void resize(size_t n)     { body.resize(n); }
+
+    char &operator[](size_t i)       { return body[i]; }
+    char operator[](size_t i) const  { return body[i]; }
+    char last() const                { return body.back(); }
+    void remove_last()               { body.pop_back(); }
+
+    qstring &append(char c)            { body += c; return *this; }
+    qstring &append(const char *s)     { body += s; return *this; }
+    qstring &append(const qstring &s)  { body += s.body; return *this; }
+    qstring &operator+=(char c)            { return append(c); }
+    qstring &operator+=(const char *s)     { return append(s); }
+    qstring &operator+=(const qstring &s)  { return append(s); }
+    qstring &insert(size_t pos, const char *s) { body.insert(pos, s); return *this; }
+
+    size_t find(const char *s, size_t pos = 0) const { return body.find(s, pos); }
+    size_t find(char c, size_t pos = 0) const        { return body.find(c, pos); }
+    size_t rfind(char c, size_t pos = npos) const    { return body.rfind(c, pos); }
+
+    qstring substr(size_t pos, size_t n = npos) const
+    {
+        return pos >= body.length() ? qstring() : qstring(body.c_str() + pos, qmin(n, body.length() - pos));
+    }
+
+    // Replaces all the occurrences of 'what' with 'with'
+    qstring &replace(const char *what, const char *with);
+
+    // Removes the leading and trailing whitespace
+    qstring &trim2();
+
+    size_t sprnt(const char *format, ...);
+    size_t cat_sprnt(const char *format, ...);
+
+    bool operator==(const qstring &r) const { return body == r.body; }
+    bool operator!=(const qstring &r) const { return body != r.body; }
+    bool operator==(const char *r) const    { return body == r; }
+    bool operator!=(const char *r) const    { return body != r; }
+    bool operator<(const qstring &r) const  { return body < r.body; }
+
+    friend qstring operator+(const qstring &l, const qstring &r) { qstring s = l; return s.append(r); }
+    friend qstring operator+(const qstring &l, const char *r)    { qstring s = l; return s.append(r); }
+    friend qstring operator+(const char *l, const qstring &r)    { qstring s = l; return s.append(r); }
+};
+
+typedef qvector<qstring> qstrvec_t;
+
+//-------------------------------------------------------------------------
+// Files and paths
+struct qstatbuf
+{
+    qtime64_t qst_mtime;
+    uint64 qst_size;
+};
+
+int qstat(const char *path, qstatbuf *buf);
+bool qfileexist(const char *file);
+FILE *qfopen(const char *file, const char *mode);
+int qfclose(FILE *fp);
+int qfscanf(FILE *fp, const char *format, ...);
+char *qfgets(char *s, size_t len, FILE *fp);
+ssize_t qfread(FILE *fp, void *buf, size_t n);
+ssize_t qfwrite(FILE *fp, const void *buf, size_t n);
+int qfflush(FILE *fp);
+int qfseek(FILE *fp, int64 offset, int whence);
+int qunlink(const char *file);
+ssize_t qgetline(qstring *buf, FILE *fp);
+
+bool qisabspath(const char *file);
+bool qdirname(char *buf, size_t bufsize, const char *file);
+const char *qbasename(const char *path);
+char *qsplitfile(char *file, char **ext, char **base);
+
+//-------------------------------------------------------------------------
+// Miscellaneous
+bool qgetenv(const char *varname, qstring *buf = nullptr);
+uint64 get_nsec_stamp();
+uint32 qtime32();
+
+// Output window messages go to stderr
+int msg(const char *format, ...);
+
+//-------------------------------------------------------------------------
+// External languages: the stub registers IDC and Python
+struct extlang_t
+{
+    size_t size;
+    uint32 flags;
+    int32_t refcnt;
+    const char *name;
+    const char *fileext;
+};
+typedef qvector<extlang_t *> extlangs_t;
+
+struct extlang_visitor_t
+{
+    virtual ssize_t idaapi visit_extlang(extlang_t *extlang) = 0;
+    virtual ~extlang_visitor_t() {}
+};
+
+ssize_t for_all_extlangs(extlang_visitor_t &ev, bool installed = true);
@@ -0,0 +1,337 @@
+#pragma once
+
+//-------------------------------------------------------------------------
+// Runs the active script against a corpus of databases (see the '/corpus'
+// directives).
+//
+// Each database is processed by a headless worker (see worker_pool.hpp). The
+// database is copied into the job directory only when its worker starts, so
+// that there are no more copies than running jobs. Once all the databases are
+// done, the outcome of each one (status, duration, peak memory usage and
+// output) is written to a JSON and a CSV report.
+static constexpr int CORPUS_MAX_OUTPUT_LINES = 200; // last output lines kept per database
+
+struct corpus_result_t
+{
+    enum status_e
+    {
+        st_pending,
+        st_ok,
+        st_failed,
+        st_timeout,
+        st_cancelled,
+        st_error,       // the job could not be prepared or started
+    };
+
+    qstring database;
+    int status = st_pending;
+    int exit_code = -1;
+    double duration_secs = 0;
+    uint64 peak_rss = 0;
+    std::deque<qstring> output;
+    size_t output_lines = 0;
+    qstring error;
+
+    static const char *status_name(int status)
+    {
+        switch (status)
+        {
+            case st_ok:        return "ok";
+            case st_failed:    return "failed";
+            case st_timeout:   return "timeout";
+            case st_cancelled: return "cancelled";
+            case st_error:     return "error";
+        }
+        return "pending";
+    }
+};
+
+struct corpus_params_t
+{
+    qstring script;
+    qstrvec_t databases;
+    qstring command;         // per database: $idb$, $jobdir$ and $bootstrap$ are expanded
+    std::function<void(qstring &cmd)> expand_cmd; // then the other variables
+    qstring report_base;     // the report is written to <report_base>.json and .csv
+    int jobs = 0;            // 0 for the number of CPUs
+    int timeout_secs = 0;    // 0 for no time limit
+};
+
+class corpus_runner_t
+{
+    worker_pool_t pool;
+    corpus_params_t params;
+    std::vector<corpus_result_t> results;
+    size_t ndone = 0;
+    uint64 start_ns = 0;
+    qstring run_dir;
+    std::function<void()> on_finished;
+
+    static void add_output(corpus_result_t &r, const char *line)
+    {
+        r.output.push_back(line);
+        if (r.output.size() > CORPUS_MAX_OUTPUT_LINES)
+            r.output.pop_front();
+        ++r.output_lines;
+    }
+
+    void on_job_done(worker_job_t &job, size_t idx)
+    {
+        namespace fs = std::filesystem;
+        corpus_result_t &r = results[idx];
+        if (job.start_failed)
+        {
+            r.status = corpus_result_t::st_error;
+            r.error  = job.start_error.empty() ? "the worker failed to start" : job.start_error.c_str();
+        }
+        else
+        {
+            r.exit_code     = job.proc.get_exit_code();
+            r.duration_secs = job.proc.elapsed_secs();
+            r.peak_rss      = job.proc.get_peak_rss();
+            r.status        = job.timed_out      ? corpus_result_t::st_timeout
+                            : r.exit_code == 0   ? corpus_result_t::st_ok
+                            :                      corpus_result_t::st_failed;
+        }
+        msg("QScripts corpus [%u/%u] %s: %s (%.2f s)\n",
+            uint(ndone + 1),
+            uint(results.size()),
+            qbasename(r.database.c_str()),
+            corpus_result_t::status_name(r.status),
+            r.duration_secs);
+
+        std::error_code ec;
+        fs::remove_all(job.work_dir.c_str(), ec);
+        job_finished();
+    }
+
+    void job_finished()
+    {
+        if (++ndone == results.size())
+            finish();
+    }
+
+    // Copies a database into its job directory and builds the worker's command
+    bool prepare(worker_job_t &job, size_t idx, qstring *errbuf)
+    {
+        namespace fs = std::filesystem;
+        corpus_result_t &r = results[idx];
+
+        std::error_code ec;
+        fs::path job_dir(job.work_dir.c_str());
+        fs::create_directories(job_dir, ec);
+        fs::path job_db = job_dir / fs::path(r.database.c_str()).filename();
+        if (!ec)
+            fs::copy_file(r.database.c_str(), job_db, fs::copy_options::overwrite_existing, ec);
+        if (ec)
+        {
+            errbuf->sprnt("failed to copy the database: %s", ec.message().c_str());
+            return false;
+        }
+
+        fs::path bootstrap = job_dir / WORKER_BOOTSTRAP_NAME;
+        FILE *fp = qfopen(bootstrap.string().c_str(), "w");
+        if (fp == nullptr)
+        {
+            errbuf->sprnt("failed to write the worker bootstrap");
+            return false;
+        }
+        qfwrite(fp, PY_WORKER_BOOTSTRAP, strlen(PY_WORKER_BOOTSTRAP));
+        qfclose(fp);
+
+        qstring cmd = params.command;
+        cmd.replace("$bootstrap$", bootstrap.string().c_str());
+        cmd.replace("$idb$",       job_db.string().c_str());
+        cmd.replace("$jobdir$",    job_dir.string().c_str());
+        if (params.expand_cmd)
+            params.expand_cmd(cmd);
+        job.command = cmd;
+        return true;
+    }
+
+    // Queues the worker of a database. Its job directory is prepared when it starts
+    void submit(size_t idx)
+    {
+        namespace fs = std::filesystem;
+        qstring job_name;
+        job_name.sprnt("%04u", uint(idx));
+
+        auto job = std::make_unique<worker_job_t>();
+        job->label.sprnt("corpus %s", qbasename(results[idx].database.c_str()));
+        job->work_dir     = (fs::path(run_dir.c_str()) / job_name.c_str()).string().c_str();
+        job->timeout_secs = params.timeout_secs;
+        job->prepare      = [this, idx](worker_job_t &job, qstring *errbuf) { return prepare(job, idx, errbuf); };
+        job->on_output    = [this, idx](worker_job_t &, const char *line) { add_output(results[idx], line); };
+        job->on_done      = [this, idx](worker_job_t &job) { on_job_done(job, idx); };
+        pool.submit(std::move(job));
+    }
+
+    void finish()
+    {
+        namespace fs = std::filesystem;
+        std::error_code ec;
+        fs::remove_all(run_dir.c_str(), ec);
+
+        int counts[corpus_result_t::st_error + 1] = {};
+        for (auto &r : results)
+            ++counts[r.status];
+
+        qstring errbuf;
+        bool saved = save_report(&errbuf);
+        msg("QScripts corpus run of %s finished in %.2f s: %d ok, %d failed, %d timed out, %d cancelled, %d error(s)\n",
+            qbasename(params.script.c_str()),
+            (get_nsec_stamp() - start_ns) / 1000000000.0,
+            counts[corpus_result_t::st_ok],
+            counts[corpus_result_t::st_failed],
+            counts[corpus_result_t::st_timeout],
+            counts[corpus_result_t::st_cancelled],
+            counts[corpus_result_t::st_error]);
+        if (saved)
+            msg("QScripts corpus report: %s.json\n", params.report_base.c_str());
+        else
+            msg("QScripts failed to write the corpus report: %s\n", errbuf.c_str());
+
+        if (on_finished)
+            on_finished();
+    }
+
+    static void csv_field(qstring &out, const char *s)
+    {
+        out.append('"');
+        for (; *s != '\0'; ++s)
+        {
+            if (*s == '"')
+                out.append('"');
+            out.append(*s == '\n' || *s == '\r' ? ' ' : *s);
+        }
+        out.append('"');
+    }
+
+    static bool write_file(const qstring &path, const qstring &text, qstring *errbuf)
+    {
+        FILE *fp = qfopen(path.c_str(), "wb");
+        if (fp == nullptr)
+        {
+            errbuf->sprnt("cannot create '%s'", path.c_str());
+            return false;
+        }
+        bool ok = qfwrite(fp, text.c_str(), text.length()) == ssize_t(text.length());
+        qfclose(fp);
+        if (!ok)
+            errbuf->sprnt("cannot write '%s'", path.c_str());
+        return ok;
+    }
+
+    bool save_report(qstring *errbuf) const
+    {
+        namespace fs = std::filesystem;
+        std::error_code ec;
+        fs::create_directories(fs::path(params.report_base.c_str()).parent_path(), ec);
+
+        json_t dbs = json_t::array();
+        qstring csv = "database,status,exit_code,duration_secs,peak_rss_kb,output_lines,last_output\n";
+        for (auto &r : results)
+        {
+            json_t output = json_t::array();
+            for (auto &line : r.output)
+                output.push_back(line);
+
+            json_t db = json_t::object();
+            db.set("database", r.database);
+            db.set("status", corpus_result_t::status_name(r.status));
+            db.set("exit_code", r.exit_code);
+            db.set("duration_secs", r.duration_secs);
+            db.set("peak_rss", r.peak_rss);
+            db.set("output_lines", uint64(r.output_lines));
+            db.set("output", std::move(output));
+            if (!r.error.empty())
+                db.set("error", r.error);
+            dbs.push_back(std::move(db));
+
+            csv_field(csv, r.database.c_str());
+            csv.cat_sprnt(",%s,%d,%.3f,%" FMT_64 "u,%u,",
+                corpus_result_t::status_name(r.status),
+                r.exit_code,
+                r.duration_secs,
+                r.peak_rss / 1024,
+                uint(r.output_lines));
+            csv_field(csv, !r.error.empty() ? r.error.c_str() : r.output.empty() ? "" : r.output.back().c_str());
+            csv.append('\n');
+        }
+
+        json_t report = json_t::object();
+        report.set("script", params.script);
+        report.set("command", params.command);
+        report.set("jobs", pool.get_max_jobs());
+        report.set("duration_secs", (get_nsec_stamp() - start_ns) / 1000000000.0);
+        report.set("databases", std::move(dbs));
+
+        return write_file(params.report_base + ".json", report.dump(), errbuf)
+            && write_file(params.report_base + ".csv", csv, errbuf);
+    }
+
+public:
+    // Starts processing the corpus in the background. 'cb' is called once the report is written.
+    bool start(const corpus_params_t &p, std::function<void()> cb, qstring *errbuf)
+    {
+        namespace fs = std::filesystem;
+        if (is_busy())
+        {
+            errbuf->sprnt("a corpus run is already in progress");
+            return false;
+        }
+        if (p.databases.empty())
+        {
+            errbuf->sprnt("no database matches the corpus");
+            return false;
+        }
+
+        params = p;
+        on_finished = std::move(cb);
+        results.clear();
+        results.resize(params.databases.size());
+        ndone = 0;
+        start_ns = get_nsec_stamp();
+
+        std::error_code ec;
+        run_dir.sprnt("%s" SDIRCHAR "qscripts" SDIRCHAR "corpus-%d-%" FMT_64 "u",
+            fs::temp_directory_path(ec).string().c_str(),
+            qgetpid(),
+            start_ns);
+
+        pool.set_max_jobs(params.jobs > 0 ? params.jobs : qmax(1, int(std::thread::hardware_concurrency())));
+        msg("QScripts running %s on %u database(s) with %d job(s)...\n",
+            qbasename(params.script.c_str()),
+            uint(results.size()),
+            pool.get_max_jobs());
+
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            results[i].database = params.databases[i];
+            submit(i);
+        }
+        return true;
+    }
+
+    // Stops the run and writes the report of what was done so far
+    void cancel()
+    {
+        if (!is_busy())
+            return;
+
+        pool.cancel_all();
+        for (auto &r : results)
+        {
+            if (r.status == corpus_result_t::st_pending)
+            {
+                r.status = corpus_result_t::st_cancelled;
+                ++ndone;
+            }
+        }
+        finish();
+    }
+
+    bool is_busy() const      { return ndone < results.size(); }
+    size_t done_count() const { return ndone; }
+    size_t total_count() const { return results.size(); }
+};
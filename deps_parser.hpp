@@ -0,0 +1,507 @@
+#pragma once
+
+//-------------------------------------------------------------------------
+// Dependency index files: parsing of the directives and of the dependency
+// scripts, and expansion of the '$variables$' they contain.
+//
+// Like the rest of the engine (see qscripts_core.hpp), the parser does not
+// use IDA's UI or the database.
+#ifdef __NT__
+static constexpr char DEFAULT_WORKER_CMD[]      = "python \"$bootstrap$\" \"$idb$\" \"$script$\"";
+#else
+static constexpr char DEFAULT_WORKER_CMD[]      = "python3 \"$bootstrap$\" \"$idb$\" \"$script$\"";
+#endif
+static constexpr int  DEFAULT_PROFILE_TOP       = 20;
+
+struct expand_ctx_t
+{
+    // input
+    qstring script_file;
+    bool    main_file;
+    active_script_info_t *script; // the active script that receives the dependencies
+
+    // working
+    qstring base_dir;
+    qstring pkg_base;
+    qstring reload_cmd;
+};
+
+class deps_parser_t
+{
+    const std::regex RE_EXPANDER = std::regex(R"(\$(.+?)\$)");
+
+    // The active script whose package base applies to the files that are not its dependencies
+    const active_script_info_t &pkg_owner;
+
+public:
+    deps_parser_t(const active_script_info_t &pkg_owner) : pkg_owner(pkg_owner)
+    {
+    }
+
+    bool make_meta_filename(
+        const char* filename,
+        const char* extension,
+        qstring& out,
+        bool local_only = false)
+    {
+        // Check the .qscripts folder
+        char dir[2048];
+        if (qdirname(dir, sizeof(dir), filename))
+        {
+            out.sprnt("%s" SDIRCHAR QSCRIPTS_LOCAL SDIRCHAR "%s.%s", dir, qbasename(filename), extension);
+            if (qfileexist(out.c_str()))
+                return true;
+        }
+
+        if (local_only)
+            return false;
+
+        // Check the actual script folder
+        out.sprnt("%s.%s", filename, extension);
+        return qfileexist(out.c_str());
+    }
+
+    bool find_deps_file(
+        const char* filename,
+        qstring& out)
+    {
+        return      make_meta_filename(filename, "deps", out, true)
+                ||  make_meta_filename(filename, "deps.qscripts", out);
+
+    }
+    
+    bool parse_deps_for_script(expand_ctx_t &ctx)
+    {
+        // Parse the dependency index file
+        qstring dep_file;
+        if (!find_deps_file(ctx.script_file.c_str(), dep_file))
+            return false;
+
+        FILE *fp = qfopen(dep_file.c_str(), "r");
+        if (fp == nullptr)
+            return false;
+
+        auto &script = *ctx.script;
+
+        // Get the dependency file directory
+        ctx.base_dir.resize(ctx.script_file.size());
+        qdirname(ctx.base_dir.begin(), ctx.base_dir.size(), ctx.script_file.c_str());
+        ctx.base_dir.resize(strlen(ctx.base_dir.c_str()));
+
+        // Add the dependency file to the active script
+        script.add_dep_index(dep_file.c_str());
+
+        static auto get_value = [](const char* str, const char* key, int key_len) -> const char *
+        {
+            if (strncmp(str, key, key_len) != 0)
+                return nullptr;
+            // Empty value?
+            if (str[key_len] == '\0')
+                return "";
+            else
+                return str + key_len + 1;
+        };
+
+        // Parse each line
+        for (qstring line = dep_file; qgetline(&line, fp) != -1;)
+        {
+            line.trim2();
+
+            // Skip comment lines (';', '//' and '#')
+            if (line.empty() || strncmp(line.c_str(), "//", 2) == 0 || line[0] == '#' || line[0] == ';')
+                continue;
+
+            // Parse special directives (some apply only for the main selected script)
+            if (auto val = get_value(line.c_str(), "/pkgbase", 8))
+            {
+                if (ctx.main_file)
+                {
+                    ctx.pkg_base = val;
+                    expand_file_name(ctx.pkg_base, ctx);
+                    make_abs_path(ctx.pkg_base, ctx.base_dir.c_str(), true);
+                }
+                continue;
+            }
+            else if (auto val = get_value(line.c_str(), "/notebook.cells_re", 18))
+            {
+                if (ctx.main_file)
+                {
+                    script.notebook.cells_re = std::regex(val);
+                    continue;
+                }
+            }
+            else if (auto val = get_value(line.c_str(), "/notebook.activate", 18))
+            {
+                if (ctx.main_file)
+                {
+                    int act;
+                    if (qstrcmp(val, "exec_main") == 0)
+                        act = notebook_ctx_t::act_exec_main;
+                    else if (qstrcmp(val, "exec_all") == 0)
+                        act = notebook_ctx_t::act_exec_all;
+                    else
+                        act = notebook_ctx_t::act_exec_none;
+
+                    script.notebook.activation_action = act;
+                    continue;
+                }
+            }
+            else if (auto val = get_value(line.c_str(), "/notebook", 9))
+            {
+                if (ctx.main_file)
+                {
+                    script.b_is_notebook = true;
+                    script.notebook.title = val;
+                    script.notebook.main_file = ctx.script_file.c_str();
+                    continue;
+                }
+            }
+            else if (get_value(line.c_str(), "/stream", 7) != nullptr)
+            {
+                if (ctx.main_file)
+                    script.b_stream = true;
+                continue;
+            }
+            else if (get_value(line.c_str(), "/hotpatch", 9) != nullptr)
+            {
+                if (ctx.main_file)
+                    script.b_hotpatch = true;
+                continue;
+            }
+            else if (auto val = get_value(line.c_str(), "/profile", 8))
+            {
+                if (ctx.main_file)
+                {
+                    int top = atoi(val);
+                    script.profile_top = top > 0 ? top : DEFAULT_PROFILE_TOP;
+                }
+                continue;
+            }
+            else if (get_value(line.c_str(), "/snapshot", 9) != nullptr)
+            {
+                if (ctx.main_file)
+                    script.b_snapshot = true;
+                continue;
+            }
+            else if (auto val = get_value(line.c_str(), "/worker.jobs", 12))
+            {
+                if (ctx.main_file)
+                    script.worker_jobs = atoi(val);
+                continue;
+            }
+            else if (auto val = get_value(line.c_str(), "/worker.artifacts", 17))
+            {
+                if (ctx.main_file)
+                    script.worker_artifacts_re = val;
+                continue;
+            }
+            else if (auto val = get_value(line.c_str(), "/worker", 7))
+            {
+                if (ctx.main_file)
+                {
+                    script.b_worker = true;
+                    script.worker_cmd = *val == '\0' ? DEFAULT_WORKER_CMD : val;
+                }
+                continue;
+            }
+            else if (auto val = get_value(line.c_str(), "/corpus.jobs", 12))
+            {
+                if (ctx.main_file)
+                    script.corpus.jobs = qmax(0, atoi(val));
+                continue;
+            }
+            else if (auto val = get_value(line.c_str(), "/corpus.timeout", 15))
+            {
+                if (ctx.main_file)
+                    script.corpus.timeout_secs = qmax(0, atoi(val));
+                continue;
+            }
+            else if (auto val = get_value(line.c_str(), "/corpus.report", 14))
+            {
+                if (ctx.main_file)
+                {
+                    script.corpus.report = val;
+                    expand_file_name(script.corpus.report, ctx);
+                }
+                continue;
+            }
+            else if (auto val = get_value(line.c_str(), "/corpus.cmd", 11))
+            {
+                if (ctx.main_file)
+                    script.corpus.cmd = val;
+                continue;
+            }
+            else if (auto val = get_value(line.c_str(), "/corpus", 7))
+            {
+                if (ctx.main_file && *val != '\0')
+                    script.corpus.patterns.push_back(resolve_corpus_pattern(val, ctx));
+                continue;
+            }
+            else if (auto val = get_value(line.c_str(), "/reload", 7))
+            {
+                if (ctx.main_file)
+                    ctx.reload_cmd = val;
+                continue;
+            }
+            else if (auto val = get_value(line.c_str(), "/triggerpipe", 12))
+            {
+                if (ctx.main_file)
+                {
+#ifdef __NT__
+                    // Named pipes live in their own namespace
+                    if (strncmp(val, "\\\\.\\pipe\\", 9) == 0)
+                    {
+                        script.trigger_pipe = val;
+                        continue;
+                    }
+#endif
+                    script.trigger_pipe = val;
+                    expand_file_name(script.trigger_pipe, ctx);
+                }
+                continue;
+            }
+            else if (auto val = get_value(line.c_str(), "/on.window", 10))
+            {
+                if (ctx.main_file)
+                    script.idb_events_window = atoi(val);
+                continue;
+            }
+            else if (strncmp(line.c_str(), "/on ", 4) == 0)
+            {
+                if (ctx.main_file)
+                    parse_idb_event_classes(line.c_str() + 4, ctx);
+                continue;
+            }
+            else if (auto val = get_value(line.c_str(), "/build", 6))
+            {
+                if (ctx.main_file)
+                    script.build_cmd = val;
+                continue;
+            }
+            else if (auto val = get_value(line.c_str(), "/sources", 8))
+            {
+                if (ctx.main_file)
+                {
+                    qstring pattern = val;
+                    expand_file_name(pattern, ctx);
+                    script.build_sources.push_back(pattern);
+                }
+                continue;
+            }
+            else if (auto val = get_value(line.c_str(), "/native", 7))
+            {
+                if (ctx.main_file)
+                {
+                    // The freshly built module is also the trigger file
+                    script.native_module = val;
+                    expand_file_name(script.native_module, ctx);
+                    script.trigger_file.refresh(script.native_module.c_str());
+                    script.b_keep_trigger_file = true;
+                }
+                continue;
+            }
+            else if (auto val = get_value(line.c_str(), "/triggerfile.samples", 20))
+            {
+                if (ctx.main_file)
+                    script.trigger_samples = qmax(0, atoi(val));
+                continue;
+            }
+            else if (auto trigger_file = get_value(line.c_str(), "/triggerfile", 12))
+            {
+                if (auto keep = get_value(trigger_file, "/keep", 5))
+                {
+                    trigger_file = keep;
+                    script.b_keep_trigger_file = true;
+                }
+
+                if (ctx.main_file)
+                {
+                    script.trigger_file.refresh(trigger_file);
+                    expand_file_name(script.trigger_file.file_path, ctx);
+                }
+                continue;
+            }
+
+            // From here on, the *line* variable is an expandable string leading to a script file
+            ctx.script_file = line;
+            expand_file_name(line, ctx);
+            normalize_path_sep(line);
+
+            // Skip dependency scripts that (do not|no longer) exist
+            script_info_t dep_script;
+            if (!get_file_modification_time(line, &dep_script.modified_time))
+                continue;
+
+            // Add script
+            dep_script.file_path  = line.c_str();
+            dep_script.reload_cmd = ctx.reload_cmd;
+            dep_script.pkg_base   = ctx.pkg_base;
+
+            script.dep_scripts[line.c_str()] = std::move(dep_script);
+
+            expand_ctx_t sub_ctx = ctx;
+            sub_ctx.script_file  = line;
+            sub_ctx.main_file    = false;
+            parse_deps_for_script(sub_ctx);
+        }
+        qfclose(fp);
+
+        return true;
+    }
+
+    void expand_file_name(qstring &filename, const expand_ctx_t &ctx)
+    {
+        expand_string(filename, filename, ctx);
+        make_abs_path(filename, ctx.base_dir.c_str(), true);
+    }
+
+    void populate_initial_notebook_cells(active_script_info_t &script)
+    {
+        auto& cell_files = script.notebook.cell_files;
+        auto current_path = std::filesystem::path(script.file_path.c_str()).parent_path();
+        script.notebook.base_path = current_path.string();
+
+        enumerate_files(
+            current_path, 
+            script.notebook.cells_re, 
+            [&cell_files](const std::string& filename)
+            {
+                qtime64_t mtime;
+                get_file_modification_time(filename, &mtime);
+                cell_files[filename] = mtime;
+                return true;
+            }
+        );
+    }
+    
+    // Parses the event classes of an '/on' directive: a list separated by commas or spaces
+    void parse_idb_event_classes(const char *list, const expand_ctx_t &ctx)
+    {
+        auto &script = *ctx.script;
+        for (const char *p = list; *p != '\0'; )
+        {
+            while (*p == ' ' || *p == ',')
+                ++p;
+            const char *end = p;
+            while (*end != '\0' && *end != ' ' && *end != ',')
+                ++end;
+            if (end == p)
+                break;
+
+            qstring name(p, end - p);
+            uint32 cls = parse_idb_event_class(name.c_str());
+            if (cls == 0)
+                msg("QScripts: unknown database event class '%s' in %s\n", name.c_str(), ctx.script_file.c_str());
+            script.idb_events |= cls;
+            p = end;
+        }
+    }
+
+    // (Re-)loads an active script: its dependencies, index files and notebook cells
+    void load_active_script(active_script_info_t &target, const char *file_path)
+    {
+        // The path may belong to the target itself
+        qstring path = file_path;
+        target.clear();
+        target.refresh(path.c_str());
+
+        // Recursively parse the dependencies and the index files
+        expand_ctx_t main_ctx = {};
+        main_ctx.script_file = path;
+        main_ctx.main_file   = true;
+        main_ctx.script      = &target;
+        parse_deps_for_script(main_ctx);
+
+        // If a notebook is selected, let's capture all the cell files
+        if (target.is_notebook())
+            populate_initial_notebook_cells(target);
+    }
+
+    std::string expand_pkgmodname(const expand_ctx_t& ctx)
+    {
+        auto dep_file = pkg_owner.has_dep(ctx.script_file.c_str());
+        qstring pkg_base = dep_file == nullptr ? pkg_owner.pkg_base : dep_file->pkg_base;
+
+        // If the script file is in the package base, then replace the path separators with '.'
+        if (strncmp(ctx.script_file.c_str(), pkg_base.c_str(), pkg_base.length()) == 0)
+        {
+            qstring s = ctx.script_file.c_str() + pkg_base.length() + 1;
+            s.replace(SDIRCHAR, ".");
+            // Drop the extension too
+            auto idx = s.rfind('.');
+            if (idx != -1)
+                s.resize(idx);
+
+            return s.c_str();
+        }
+        return "";
+    }
+    
+    // Dynamic string expansion   Description
+    // ------------------------   -----------
+    // basename                   Returns the basename of the input file
+    // env:Variable_Name          Expands the 'Variable_Name'
+    // pkgbase                    Sets the current pkgbase path
+    // pkgmodname                 Expands the file name using the pkgbase into the form: 'module.submodule1.submodule2'
+    // pkgparentmodname           Expands the file name using the pkgbase into the form up to the parent module: 'module.submodule1'
+    // ext                        Add-on suffix including bitness and extension (example: 64.dll, .so, 64.so, .dylib, etc.)
+    void expand_string(
+        qstring &input, 
+        qstring &output, 
+        const expand_ctx_t& ctx)
+    {
+        output = std::regex_replace(
+            input.c_str(),
+            RE_EXPANDER,
+            [this, ctx](auto &m) -> std::string
+            {
+                qstring match1 = m.str(1).c_str();
+
+                if (strncmp(match1.c_str(), "pkgmodname", 10) == 0)
+                {
+					return expand_pkgmodname(ctx);
+                }
+                else if (strncmp(match1.c_str(), "pkgparentmodname", 16) == 0)
+                {
+                    std::string pkgmodname = expand_pkgmodname(ctx);
+                    size_t pos = pkgmodname.rfind('.');
+                    return pos == std::string::npos ? pkgmodname : pkgmodname.substr(0, pos);
+                }
+                else if (strncmp(match1.c_str(), "ext", 3) == 0)
+                {
+                    static_assert(LOADER_DLL[0] == '*');
+                    return LOADER_DLL + 1;
+                }
+                else if (strncmp(match1.c_str(), "pkgbase", 7) == 0)
+                {
+                    return ctx.pkg_base.c_str();
+                }
+                else if (strncmp(match1.c_str(), "basename", 8) == 0)
+                {
+                    char *basename, *ext;
+                    qstring wrk_str;
+                    get_basename_and_ext(ctx.script_file.c_str(), &basename, &ext, wrk_str);
+                    return basename;
+                }
+                else if (strncmp(match1.c_str(), "env:", 4) == 0)
+                {
+                    qstring env;
+                    if (qgetenv(match1.begin() + 4, &env))
+                        return env.c_str();
+                }
+                return m.str(1);
+            }
+        ).c_str();
+    }
+
+    // Makes a corpus pattern (a glob or '@' followed by a list file) absolute
+    qstring resolve_corpus_pattern(const char *pattern, const expand_ctx_t &ctx)
+    {
+        bool is_list = *pattern == '@';
+        qstring path = pattern + (is_list ? 1 : 0);
+        expand_file_name(path, ctx);
+        if (is_list)
+            path.insert(0, "@");
+        return path;
+    }
+};
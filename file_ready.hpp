@@ -0,0 +1,271 @@
+#pragma once
+
+//-------------------------------------------------------------------------
+// Trigger file readiness: a trigger file (typically a freshly linked binary)
+// is considered ready when:
+// - its size and modification time are stable across a number of samples
+// - no writer holds it open (inotify on Linux, an exclusive open on Windows).
+//   If inotify dropped events, only the size and modification time are checked.
+// - for ELF and PE binaries: the section table and the sections' data are complete
+static constexpr int TRIGGER_READY_INTERVAL = 10;    // ms between samples
+static constexpr int TRIGGER_READY_TIMEOUT  = 10000; // ms before giving up
+static constexpr int TRIGGER_READY_SAMPLES  = 2;
+
+class file_readiness_t
+{
+    qstring path;
+    int samples = TRIGGER_READY_SAMPLES;
+
+    uint64 last_size = 0;
+    std::filesystem::file_time_type last_mtime;
+    int stable_count = 0;
+    uint64 start_ns = 0;
+
+#ifdef __LINUX__
+    int fd_inotify = -1;
+    qstring basename;
+    bool writer_open = false;
+    bool events_lost = false;   // the inotify queue overflowed
+
+    void drain_events()
+    {
+        if (fd_inotify == -1)
+            return;
+
+        alignas(inotify_event) char buf[4096];
+        ssize_t n;
+        while ((n = read(fd_inotify, buf, sizeof(buf))) > 0)
+        {
+            for (char *p = buf; p < buf + n; )
+            {
+                auto ev = (const inotify_event *)p;
+                p += sizeof(inotify_event) + ev->len;
+                if ((ev->mask & IN_Q_OVERFLOW) != 0)
+                {
+                    writer_open = false;
+                    events_lost = true;
+                    continue;
+                }
+                if (ev->len == 0 || basename != ev->name)
+                    continue;
+
+                if ((ev->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) != 0)
+                    writer_open = false;
+                else if ((ev->mask & (IN_CREATE | IN_MODIFY)) != 0)
+                    writer_open = true;
+            }
+        }
+    }
+#endif
+
+    // Is another process still writing the file?
+    bool is_being_written()
+    {
+#ifdef __LINUX__
+        drain_events();
+        return writer_open && !events_lost;
+#elif defined(__NT__)
+        // Fails with a sharing violation while a writer holds the file open
+        HANDLE h = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, 0, nullptr);
+        if (h == INVALID_HANDLE_VALUE)
+            return GetLastError() == ERROR_SHARING_VIOLATION;
+        CloseHandle(h);
+        return false;
+#else
+        return false;
+#endif
+    }
+
+    static uint64 read_uint(const uchar *p, int size, bool big_endian)
+    {
+        uint64 v = 0;
+        for (int i = 0; i < size; ++i)
+            v |= uint64(p[big_endian ? size - 1 - i : i]) << (i * 8);
+        return v;
+    }
+
+    static bool read_at(FILE *fp, uint64 off, void *buf, size_t size)
+    {
+        return qfseek(fp, off, SEEK_SET) == 0 && qfread(fp, buf, size) == ssize_t(size);
+    }
+
+    // Checks that the section table and the sections' data of ELF and PE files are
+    // within the file. Other files are always considered complete.
+    static bool is_binary_complete(FILE *fp, uint64 size)
+    {
+        uchar hdr[64];
+        if (!read_at(fp, 0, hdr, sizeof(hdr)))
+            return true;
+
+        // ELF
+        if (memcmp(hdr, "\x7f" "ELF", 4) == 0)
+        {
+            bool is64 = hdr[4] == 2;
+            bool be   = hdr[5] == 2;
+            uint64 shoff = is64 ? read_uint(hdr + 0x28, 8, be) : read_uint(hdr + 0x20, 4, be);
+            uint64 shentsize = read_uint(hdr + (is64 ? 0x3A : 0x2E), 2, be);
+            uint64 shnum     = read_uint(hdr + (is64 ? 0x3C : 0x30), 2, be);
+            if (shoff == 0 && shnum == 0)
+                return true;
+            if (shoff + shentsize * shnum > size || shentsize < (is64 ? 64 : 40))
+                return false;
+
+            uchar sh[64];
+            for (uint64 i = 0; i < shnum; ++i)
+            {
+                if (!read_at(fp, shoff + i * shentsize, sh, is64 ? 64 : 40))
+                    return false;
+
+                constexpr uint64 SHT_NOBITS_ = 8;
+                if (read_uint(sh + 4, 4, be) == SHT_NOBITS_)
+                    continue;
+
+                uint64 off = is64 ? read_uint(sh + 0x18, 8, be) : read_uint(sh + 0x10, 4, be);
+                uint64 sz  = is64 ? read_uint(sh + 0x20, 8, be) : read_uint(sh + 0x14, 4, be);
+                if (off + sz > size)
+                    return false;
+            }
+            return true;
+        }
+
+        // PE
+        if (hdr[0] == 'M' && hdr[1] == 'Z')
+        {
+            uint64 pe_off = read_uint(hdr + 0x3C, 4, false);
+            uchar fh[24];
+            if (!read_at(fp, pe_off, fh, sizeof(fh)) || memcmp(fh, "PE\0\0", 4) != 0)
+                return false;
+
+            uint64 nsections = read_uint(fh + 6, 2, false);
+            uint64 sec_off   = pe_off + sizeof(fh) + read_uint(fh + 20, 2, false);
+            if (sec_off + nsections * 40 > size)
+                return false;
+
+            uchar sec[40];
+            for (uint64 i = 0; i < nsections; ++i)
+            {
+                if (!read_at(fp, sec_off + i * 40, sec, sizeof(sec)))
+                    return false;
+
+                uint64 raw_size = read_uint(sec + 16, 4, false);
+                uint64 raw_ptr  = read_uint(sec + 20, 4, false);
+                if (raw_size != 0 && raw_ptr + raw_size > size)
+                    return false;
+            }
+            return true;
+        }
+        return true;
+    }
+
+public:
+    enum status_e
+    {
+        st_wait,     // not ready yet: sample again after TRIGGER_READY_INTERVAL
+        st_ready,
+        st_gone,     // the file disappeared
+    };
+
+    // Starts watching the trigger file (before it is modified).
+    // 'nsamples' is the number of identical samples required (0 disables the checks).
+    void watch(const char *file_path, int nsamples)
+    {
+        unwatch();
+        path = file_path;
+        samples = nsamples;
+        if (samples <= 0)
+            return;
+
+#ifdef __LINUX__
+        basename = qbasename(file_path);
+
+        qstring dir = file_path;
+        dir.resize(dir.length() - basename.length());
+        if (dir.empty())
+            dir = ".";
+
+        fd_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (   fd_inotify != -1
+            && inotify_add_watch(fd_inotify, dir.c_str(), IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO) == -1)
+        {
+            close(fd_inotify);
+            fd_inotify = -1;
+        }
+#endif
+    }
+
+    void unwatch()
+    {
+#ifdef __LINUX__
+        if (fd_inotify != -1)
+        {
+            close(fd_inotify);
+            fd_inotify = -1;
+        }
+        writer_open = events_lost = false;
+#endif
+        path.qclear();
+        start_ns = 0;
+    }
+
+    bool enabled() const { return samples > 0; }
+
+    // Called once the trigger file's modification was detected
+    void begin()
+    {
+        stable_count = -1;
+        start_ns = get_nsec_stamp();
+#ifdef __LINUX__
+        // Catch up with the events queued since the previous trigger
+        events_lost = false;
+        drain_events();
+#endif
+    }
+
+    // Samples the file and tells if it is ready
+    status_e check()
+    {
+        if (!enabled())
+            return st_ready;
+
+        bool timed_out = (get_nsec_stamp() - start_ns) / 1000000 >= TRIGGER_READY_TIMEOUT;
+
+        std::error_code ec;
+        std::filesystem::path fs_path(path.c_str());
+        uint64 size = std::filesystem::file_size(fs_path, ec);
+        auto mtime  = ec ? std::filesystem::file_time_type() : std::filesystem::last_write_time(fs_path, ec);
+        if (ec)
+        {
+            // The file may be replaced: wait for it to come back
+            stable_count = -1;
+            return timed_out ? st_gone : st_wait;
+        }
+
+        if (stable_count >= 0 && size == last_size && mtime == last_mtime)
+            ++stable_count;
+        else
+            stable_count = 0;
+        last_size  = size;
+        last_mtime = mtime;
+
+        if (stable_count < samples || is_being_written())
+            return timed_out ? st_ready : st_wait;
+
+        FILE *fp = qfopen(path.c_str(), "rb");
+        bool complete = fp == nullptr || is_binary_complete(fp, size);
+        if (fp != nullptr)
+            qfclose(fp);
+
+        if (!complete)
+        {
+            if (!timed_out)
+                return st_wait;
+            msg("QScripts: the trigger file '%s' still looks incomplete. Proceeding anyway.\n", path.c_str());
+        }
+        return st_ready;
+    }
+
+    ~file_readiness_t()
+    {
+        unwatch();
+    }
+};
@@ -1,5 +1,33 @@
 #pragma once
 
+// OS specific headers (must come before the IDA SDK headers)
+#ifdef __NT__
+    #define WIN32_LEAN_AND_MEAN
+    #define PSAPI_VERSION 2
+    #include <windows.h>
+    #include <psapi.h>
+#else
+    #include <unistd.h>
+    #include <fcntl.h>
+    #include <signal.h>
+    #include <spawn.h>
+    #include <dlfcn.h>
+    #include <errno.h>
+    #include <poll.h>
+    #include <sys/socket.h>
+    #include <sys/un.h>
+    #include <sys/stat.h>
+    #include <sys/wait.h>
+    #include <sys/resource.h>
+    #ifdef __MAC__
+        #include <mach/mach.h>
+    #endif
+    #ifdef __LINUX__
+        #include <sys/inotify.h>
+    #endif
+    extern char **environ;
+#endif
+
 #pragma warning(push)
 #pragma warning(disable: 4267 4244 4146)
 #include <loader.hpp>
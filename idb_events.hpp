@@ -0,0 +1,283 @@
+#pragma once
+
+//-------------------------------------------------------------------------
+// Database events that re-run the active script (see the '/on' directive).
+//
+// The matching IDB events are collected into a batch until no new event came
+// in for the coalescing window, then the whole batch triggers one execution.
+// A bulk operation (applying a signature, importing names, etc.) therefore
+// results in a single run with all the affected addresses.
+//
+// The same events are also counted while QScripts executes a script, to
+// report how much each run changed the database (see idb_mutation_counter_t).
+static constexpr int IDB_EVENTS_WINDOW     = 500;     // ms without new events before the batch is run
+static constexpr int IDB_EVENTS_MAX_DELAY  = 10000;   // ms after the first event to run the batch anyway
+static constexpr int IDB_EVENTS_MAX_EAS    = 1000000; // addresses kept per event class
+
+struct idb_event_batch_t
+{
+    // Event class -> affected addresses (sorted, unique)
+    std::map<uint32, std::set<ea_t>> eas;
+    size_t nevents = 0;
+    bool truncated = false;
+
+    bool empty() const { return nevents == 0; }
+};
+
+class idb_event_batcher_t : public event_listener_t
+{
+    uint32 classes = 0;
+    int window = IDB_EVENTS_WINDOW;
+    qtimer_t timer = nullptr;
+    uint64 first_ns = 0;
+    uint64 last_ns = 0;
+    idb_event_batch_t batch;
+
+    // Tells if the events should be collected (they are not during QScripts' own runs)
+    std::function<bool()> is_listening;
+    std::function<void(idb_event_batch_t &)> on_batch;
+
+    static int idaapi s_timer_cb(void *ud)
+    {
+        return ((idb_event_batcher_t *)ud)->tick();
+    }
+
+    int tick()
+    {
+        // Wait for the events to quiet down, but not forever
+        uint64 now = get_nsec_stamp();
+        int quiet_ms = int((now - last_ns) / 1000000);
+        int total_ms = int((now - first_ns) / 1000000);
+        if (quiet_ms < window && total_ms < IDB_EVENTS_MAX_DELAY)
+            return window - quiet_ms;
+
+        timer = nullptr;
+        idb_event_batch_t ready;
+        std::swap(ready, batch);
+        if (on_batch)
+            on_batch(ready);
+        return -1;
+    }
+
+    void add(uint32 cls, ea_t ea)
+    {
+        if ((classes & cls) == 0 || (is_listening && !is_listening()))
+            return;
+
+        if (ea != BADADDR)
+        {
+            auto &eas = batch.eas[cls];
+            if (eas.size() < IDB_EVENTS_MAX_EAS)
+                eas.insert(ea);
+            else
+                batch.truncated = true;
+        }
+        else
+        {
+            // An event without an address still triggers a run
+            batch.eas[cls];
+        }
+        ++batch.nevents;
+
+        last_ns = get_nsec_stamp();
+        if (timer == nullptr)
+        {
+            first_ns = last_ns;
+            timer = register_timer(window, s_timer_cb, this);
+        }
+    }
+
+public:
+    ssize_t idaapi on_event(ssize_t code, va_list va) override
+    {
+        switch (code)
+        {
+            case idb_event::renamed:
+                add(IDBEV_RENAME, va_arg(va, ea_t));
+                break;
+            case idb_event::ti_changed:
+            case idb_event::op_ti_changed:
+                add(IDBEV_TYPE, va_arg(va, ea_t));
+                break;
+            case idb_event::local_types_changed:
+                add(IDBEV_TYPE, BADADDR);
+                break;
+            case idb_event::func_added:
+            {
+                func_t *pfn = va_arg(va, func_t *);
+                add(IDBEV_FUNC_ADDED, pfn != nullptr ? pfn->start_ea : BADADDR);
+                break;
+            }
+            case idb_event::cmt_changed:
+            case idb_event::extra_cmt_changed:
+                add(IDBEV_CMT, va_arg(va, ea_t));
+                break;
+            case idb_event::range_cmt_changed:
+            {
+                va_arg(va, int); // range_kind_t
+                const range_t *range = va_arg(va, const range_t *);
+                add(IDBEV_CMT, range != nullptr ? range->start_ea : BADADDR);
+                break;
+            }
+        }
+        return 0;
+    }
+
+    bool is_active() const { return classes != 0; }
+    bool is_pending() const { return timer != nullptr; }
+
+    // Installs the IDB hook for the given event classes
+    void start(
+        uint32 event_classes,
+        int window_ms,
+        std::function<bool()> listening_cb,
+        std::function<void(idb_event_batch_t &)> batch_cb)
+    {
+        stop();
+        classes = event_classes;
+        window = window_ms > 0 ? window_ms : IDB_EVENTS_WINDOW;
+        is_listening = std::move(listening_cb);
+        on_batch = std::move(batch_cb);
+        if (classes != 0)
+            hook_event_listener(HT_IDB, this);
+    }
+
+    // Removes the hook and drops the pending batch
+    void stop()
+    {
+        if (classes != 0)
+            unhook_event_listener(HT_IDB, this);
+        classes = 0;
+        if (timer != nullptr)
+        {
+            unregister_timer(timer);
+            timer = nullptr;
+        }
+        batch = idb_event_batch_t();
+    }
+
+    ~idb_event_batcher_t()
+    {
+        stop();
+    }
+};
+
+//-------------------------------------------------------------------------
+// Counts the database changes made during one execution
+enum idb_mutation_e
+{
+    IDBMUT_RENAME,
+    IDBMUT_CMT,
+    IDBMUT_TYPE,
+    IDBMUT_FUNC_ADDED,
+    IDBMUT_SEGM_ADDED,
+    IDBMUT_BYTE_PATCHED,
+    IDBMUT_COUNT
+};
+
+struct idb_mutations_t
+{
+    uint64 counts[IDBMUT_COUNT] = {};
+
+    uint64 total() const
+    {
+        uint64 n = 0;
+        for (auto c : counts)
+            n += c;
+        return n;
+    }
+
+    static const char *name(int kind)
+    {
+        switch (kind)
+        {
+            case IDBMUT_RENAME:       return "renames";
+            case IDBMUT_CMT:          return "comments";
+            case IDBMUT_TYPE:         return "types";
+            case IDBMUT_FUNC_ADDED:   return "functions";
+            case IDBMUT_SEGM_ADDED:   return "segments";
+            case IDBMUT_BYTE_PATCHED: return "byte_patches";
+        }
+        return "?";
+    }
+
+    // Formats the non-zero counts and their rates, for example: "renames: 120 (2400/s), types: 3 (60/s)"
+    qstring summary(double duration_ms) const
+    {
+        qstring out;
+        double secs = duration_ms / 1000.0;
+        for (int kind = 0; kind < IDBMUT_COUNT; ++kind)
+        {
+            if (counts[kind] == 0)
+                continue;
+            if (!out.empty())
+                out.append(", ");
+            out.cat_sprnt("%s: %" FMT_64 "u", name(kind), counts[kind]);
+            if (secs > 0)
+                out.cat_sprnt(" (%.0f/s)", counts[kind] / secs);
+        }
+        return out;
+    }
+};
+
+class idb_mutation_counter_t : public event_listener_t
+{
+    idb_mutations_t mutations;
+    bool hooked = false;
+
+public:
+    ssize_t idaapi on_event(ssize_t code, va_list) override
+    {
+        switch (code)
+        {
+            case idb_event::renamed:
+                ++mutations.counts[IDBMUT_RENAME];
+                break;
+            case idb_event::cmt_changed:
+            case idb_event::extra_cmt_changed:
+            case idb_event::range_cmt_changed:
+                ++mutations.counts[IDBMUT_CMT];
+                break;
+            case idb_event::ti_changed:
+            case idb_event::op_ti_changed:
+            case idb_event::local_types_changed:
+                ++mutations.counts[IDBMUT_TYPE];
+                break;
+            case idb_event::func_added:
+                ++mutations.counts[IDBMUT_FUNC_ADDED];
+                break;
+            case idb_event::segm_added:
+                ++mutations.counts[IDBMUT_SEGM_ADDED];
+                break;
+            case idb_event::byte_patched:
+                ++mutations.counts[IDBMUT_BYTE_PATCHED];
+                break;
+        }
+        return 0;
+    }
+
+    // Resets the counts and installs the IDB hook
+    void start()
+    {
+        mutations = idb_mutations_t();
+        if (!hooked)
+            hooked = hook_event_listener(HT_IDB, this);
+    }
+
+    // Removes the hook and returns the counts since start() (none if it was not started)
+    idb_mutations_t stop()
+    {
+        if (hooked)
+            unhook_event_listener(HT_IDB, this);
+        hooked = false;
+
+        idb_mutations_t r = mutations;
+        mutations = idb_mutations_t();
+        return r;
+    }
+
+    ~idb_mutation_counter_t()
+    {
+        stop();
+    }
+};
@@ -0,0 +1,460 @@
+#pragma once
+
+//-------------------------------------------------------------------------
+// Minimal JSON value with a parser and a serializer (used by the RPC endpoint
+// and the reports). Object members keep their insertion order.
+class json_t
+{
+public:
+    enum type_e { j_null, j_bool, j_number, j_string, j_array, j_object };
+    using member_t = std::pair<qstring, json_t>;
+
+private:
+    type_e type = j_null;
+    bool b = false;
+    double num = 0;
+    qstring str;
+    std::vector<json_t> arr;
+    std::vector<member_t> obj;
+
+    static constexpr int MAX_DEPTH = 64;
+
+    //-------------------------------------------------------------------------
+    struct parser_t
+    {
+        const char *begin;
+        const char *p;
+        const char *end;
+        qstring *errbuf;
+
+        bool fail(const char *what)
+        {
+            errbuf->sprnt("%s at offset %d", what, int(p - begin));
+            return false;
+        }
+
+        void skip_ws()
+        {
+            while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+                ++p;
+        }
+
+        static bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+        // -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)? : strtod() alone would also
+        // accept hexadecimal numbers, 'inf' and 'nan'
+        bool parse_number(json_t &v)
+        {
+            const char *start = p;
+            const char *q = p;
+            if (q < end && *q == '-')
+                ++q;
+            if (q < end && *q == '0')
+                ++q;
+            else if (q < end && is_digit(*q))
+            {
+                while (q < end && is_digit(*q))
+                    ++q;
+            }
+            else
+            {
+                return fail("unexpected character");
+            }
+            if (q < end && *q == '.')
+            {
+                if (++q >= end || !is_digit(*q))
+                    return fail("bad number");
+                while (q < end && is_digit(*q))
+                    ++q;
+            }
+            if (q < end && (*q == 'e' || *q == 'E'))
+            {
+                if (++q < end && (*q == '+' || *q == '-'))
+                    ++q;
+                if (q >= end || !is_digit(*q))
+                    return fail("bad number");
+                while (q < end && is_digit(*q))
+                    ++q;
+            }
+
+            qstring text(start, q - start);
+            double d = strtod(text.c_str(), nullptr);
+            if (!std::isfinite(d))
+                return fail("number out of range");
+            p = q;
+            v = json_t(d);
+            return true;
+        }
+
+        bool literal(const char *lit)
+        {
+            size_t n = strlen(lit);
+            if (size_t(end - p) < n || strncmp(p, lit, n) != 0)
+                return false;
+            p += n;
+            return true;
+        }
+
+        static void append_utf8(qstring &out, uint32 cp)
+        {
+            if (cp < 0x80)
+            {
+                out.append(char(cp));
+            }
+            else if (cp < 0x800)
+            {
+                out.append(char(0xC0 | (cp >> 6)));
+                out.append(char(0x80 | (cp & 0x3F)));
+            }
+            else if (cp < 0x10000)
+            {
+                out.append(char(0xE0 | (cp >> 12)));
+                out.append(char(0x80 | ((cp >> 6) & 0x3F)));
+                out.append(char(0x80 | (cp & 0x3F)));
+            }
+            else
+            {
+                out.append(char(0xF0 | (cp >> 18)));
+                out.append(char(0x80 | ((cp >> 12) & 0x3F)));
+                out.append(char(0x80 | ((cp >> 6) & 0x3F)));
+                out.append(char(0x80 | (cp & 0x3F)));
+            }
+        }
+
+        bool hex4(uint32 *cp)
+        {
+            if (end - p < 4)
+                return false;
+            *cp = 0;
+            for (int i = 0; i < 4; ++i, ++p)
+            {
+                char c = *p;
+                int v = c >= '0' && c <= '9' ? c - '0'
+                      : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                      : c >= 'A' && c <= 'F' ? c - 'A' + 10
+                      : -1;
+                if (v < 0)
+                    return false;
+                *cp = (*cp << 4) | uint32(v);
+            }
+            return true;
+        }
+
+        bool parse_string(qstring &out)
+        {
+            ++p; // opening quote
+            while (p < end && *p != '"')
+            {
+                char c = *p++;
+                if (c != '\\')
+                {
+                    out.append(c);
+                    continue;
+                }
+                if (p >= end)
+                    break;
+
+                c = *p++;
+                switch (c)
+                {
+                    case '"':  out.append('"');  break;
+                    case '\\': out.append('\\'); break;
+                    case '/':  out.append('/');  break;
+                    case 'b':  out.append('\b'); break;
+                    case 'f':  out.append('\f'); break;
+                    case 'n':  out.append('\n'); break;
+                    case 'r':  out.append('\r'); break;
+                    case 't':  out.append('\t'); break;
+                    case 'u':
+                    {
+                        uint32 cp;
+                        if (!hex4(&cp))
+                            return fail("bad unicode escape");
+
+                        // Surrogate pair
+                        if (cp >= 0xD800 && cp <= 0xDBFF && end - p >= 6 && p[0] == '\\' && p[1] == 'u')
+                        {
+                            p += 2;
+                            uint32 lo;
+                            if (!hex4(&lo))
+                                return fail("bad unicode escape");
+                            cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                        }
+                        append_utf8(out, cp);
+                        break;
+                    }
+                    default:
+                        return fail("bad escape");
+                }
+            }
+            if (p >= end)
+                return fail("unterminated string");
+            ++p; // closing quote
+            return true;
+        }
+
+        bool parse_value(json_t &v, int depth)
+        {
+            if (depth > MAX_DEPTH)
+                return fail("nesting too deep");
+
+            skip_ws();
+            if (p >= end)
+                return fail("unexpected end");
+
+            switch (*p)
+            {
+                case '{':
+                {
+                    v = json_t::object();
+                    ++p;
+                    skip_ws();
+                    if (p < end && *p == '}')
+                    {
+                        ++p;
+                        return true;
+                    }
+                    while (true)
+                    {
+                        skip_ws();
+                        if (p >= end || *p != '"')
+                            return fail("expected a member name");
+                        qstring key;
+                        if (!parse_string(key))
+                            return false;
+                        skip_ws();
+                        if (p >= end || *p != ':')
+                            return fail("expected ':'");
+                        ++p;
+                        json_t member;
+                        if (!parse_value(member, depth + 1))
+                            return false;
+                        v.obj.emplace_back(std::move(key), std::move(member));
+                        skip_ws();
+                        if (p < end && *p == ',')
+                        {
+                            ++p;
+                            continue;
+                        }
+                        if (p < end && *p == '}')
+                        {
+                            ++p;
+                            return true;
+                        }
+                        return fail("expected ',' or '}'");
+                    }
+                }
+                case '[':
+                {
+                    v = json_t::array();
+                    ++p;
+                    skip_ws();
+                    if (p < end && *p == ']')
+                    {
+                        ++p;
+                        return true;
+                    }
+                    while (true)
+                    {
+                        json_t item;
+                        if (!parse_value(item, depth + 1))
+                            return false;
+                        v.arr.push_back(std::move(item));
+                        skip_ws();
+                        if (p < end && *p == ',')
+                        {
+                            ++p;
+                            continue;
+                        }
+                        if (p < end && *p == ']')
+                        {
+                            ++p;
+                            return true;
+                        }
+                        return fail("expected ',' or ']'");
+                    }
+                }
+                case '"':
+                    v = json_t(j_string);
+                    return parse_string(v.str);
+                case 't':
+                    v = json_t(true);
+                    return literal("true") || fail("bad literal");
+                case 'f':
+                    v = json_t(false);
+                    return literal("false") || fail("bad literal");
+                case 'n':
+                    v = json_t();
+                    return literal("null") || fail("bad literal");
+                default:
+                    return parse_number(v);
+            }
+        }
+    };
+
+    static void dump_string(qstring &out, const char *s)
+    {
+        out.append('"');
+        for (const uchar *q = (const uchar *)s; *q != '\0'; ++q)
+        {
+            uchar c = *q;
+            switch (c)
+            {
+                case '"':  out.append("\\\""); break;
+                case '\\': out.append("\\\\"); break;
+                case '\n': out.append("\\n");  break;
+                case '\r': out.append("\\r");  break;
+                case '\t': out.append("\\t");  break;
+                default:
+                    if (c < 0x20)
+                        out.cat_sprnt("\\u%04x", c);
+                    else
+                        out.append(char(c));
+                    break;
+            }
+        }
+        out.append('"');
+    }
+
+    explicit json_t(type_e t) : type(t) {}
+
+public:
+    json_t() = default;
+    json_t(bool v) : type(j_bool), b(v) {}
+    json_t(int v) : type(j_number), num(v) {}
+    json_t(int64 v) : type(j_number), num(double(v)) {}
+    json_t(uint64 v) : type(j_number), num(double(v)) {}
+    json_t(double v) : type(j_number), num(v) {}
+    json_t(const char *v) : type(j_string), str(v) {}
+    json_t(const qstring &v) : type(j_string), str(v) {}
+
+    static json_t array()  { return json_t(j_array); }
+    static json_t object() { return json_t(j_object); }
+
+    type_e get_type() const { return type; }
+    bool is_null() const    { return type == j_null; }
+    bool is_string() const  { return type == j_string; }
+    bool is_number() const  { return type == j_number; }
+    bool is_object() const  { return type == j_object; }
+    bool is_array() const   { return type == j_array; }
+
+    const qstring &as_str() const { return str; }
+    double as_num(double def = 0) const { return type == j_number ? num : def; }
+    bool as_bool(bool def = false) const { return type == j_bool ? b : def; }
+
+    const std::vector<json_t> &items() const     { return arr; }
+    const std::vector<member_t> &members() const { return obj; }
+
+    // Returns a member of an object or nullptr
+    const json_t *get(const char *key) const
+    {
+        for (auto &m : obj)
+        {
+            if (m.first == key)
+                return &m.second;
+        }
+        return nullptr;
+    }
+
+    // Returns a string member or 'def'
+    const char *get_str(const char *key, const char *def = nullptr) const
+    {
+        const json_t *v = get(key);
+        return v != nullptr && v->is_string() ? v->str.c_str() : def;
+    }
+
+    double get_num(const char *key, double def = 0) const
+    {
+        const json_t *v = get(key);
+        return v != nullptr ? v->as_num(def) : def;
+    }
+
+    // Sets (or adds) an object member
+    json_t &set(const char *key, json_t value)
+    {
+        type = j_object;
+        for (auto &m : obj)
+        {
+            if (m.first == key)
+            {
+                m.second = std::move(value);
+                return *this;
+            }
+        }
+        obj.emplace_back(key, std::move(value));
+        return *this;
+    }
+
+    json_t &push_back(json_t value)
+    {
+        type = j_array;
+        arr.push_back(std::move(value));
+        return *this;
+    }
+
+    void dump(qstring &out) const
+    {
+        switch (type)
+        {
+            case j_null:
+                out.append("null");
+                break;
+            case j_bool:
+                out.append(b ? "true" : "false");
+                break;
+            case j_number:
+                // JSON has no representation for infinities and NaNs
+                if (!std::isfinite(num))
+                    out.append("null");
+                else if (num == double(int64(num)) && num > -1e15 && num < 1e15)
+                    out.cat_sprnt("%" FMT_64 "d", int64(num));
+                else
+                    out.cat_sprnt("%.17g", num);
+                break;
+            case j_string:
+                dump_string(out, str.c_str());
+                break;
+            case j_array:
+                out.append('[');
+                for (size_t i = 0; i < arr.size(); ++i)
+                {
+                    if (i != 0)
+                        out.append(',');
+                    arr[i].dump(out);
+                }
+                out.append(']');
+                break;
+            case j_object:
+                out.append('{');
+                for (size_t i = 0; i < obj.size(); ++i)
+                {
+                    if (i != 0)
+                        out.append(',');
+                    dump_string(out, obj[i].first.c_str());
+                    out.append(':');
+                    obj[i].second.dump(out);
+                }
+                out.append('}');
+                break;
+        }
+    }
+
+    qstring dump() const
+    {
+        qstring out;
+        dump(out);
+        return out;
+    }
+
+    static bool parse(const char *text, size_t len, json_t &out, qstring *errbuf)
+    {
+        parser_t ps = { text, text, text + len, errbuf };
+        if (!ps.parse_value(out, 0))
+            return false;
+
+        ps.skip_ws();
+        if (ps.p != ps.end)
+            return ps.fail("trailing characters");
+        return true;
+    }
+};
@@ -0,0 +1,165 @@
+#pragma once
+
+//-------------------------------------------------------------------------
+// Memory growth detector across repeated runs (see the "Leak watch" option).
+//
+// A sample is taken before and after each execution: the resident memory of
+// IDA, the Python objects by type and the number of registered hooks, actions
+// and timers. Growth that persists over LEAK_WATCH_RUNS consecutive runs of the
+// same script is flagged, along with the types that grew the most.
+static constexpr int LEAK_WATCH_RUNS      = 5;   // consecutive growing runs before a warning
+static constexpr int LEAK_WATCH_TOP_TYPES = 10;  // growing types listed in a warning
+
+struct leak_sample_t
+{
+    uint64 rss = 0;
+    bool has_py = false;
+    std::map<std::string, int64> types;
+    int64 objects = 0;
+    int64 hooks = 0;
+    int64 actions = 0;
+    int64 timers = 0;
+};
+
+class leak_watch_t
+{
+    // The samples taken after the last runs of each script (oldest first)
+    std::map<std::string, std::deque<leak_sample_t>> history;
+
+    // Tells if a counter grew on each of the kept runs
+    template <typename F>
+    static bool grew_each_run(const std::deque<leak_sample_t> &runs, F value)
+    {
+        for (size_t i = 1; i < runs.size(); ++i)
+        {
+            if (value(runs[i]) <= value(runs[i - 1]))
+                return false;
+        }
+        return true;
+    }
+
+    static qstring top_growing_types(const leak_sample_t &first, const leak_sample_t &last)
+    {
+        std::vector<std::pair<int64, const std::string *>> growth;
+        for (auto &kv : last.types)
+        {
+            auto p = first.types.find(kv.first);
+            int64 delta = kv.second - (p == first.types.end() ? 0 : p->second);
+            if (delta > 0)
+                growth.emplace_back(delta, &kv.first);
+        }
+        std::sort(growth.begin(), growth.end(), [](const auto &a, const auto &b) { return a.first > b.first; });
+
+        qstring out;
+        for (size_t i = 0; i < growth.size() && i < LEAK_WATCH_TOP_TYPES; ++i)
+            out.cat_sprnt("  %s: +%" FMT_64 "d\n", growth[i].second->c_str(), growth[i].first);
+        return out;
+    }
+
+public:
+    // Samples the process (and the Python runtime if 'py' is not null)
+    static leak_sample_t take_sample(extlang_object_t *py, py_helpers_t &py_helpers)
+    {
+        leak_sample_t sample;
+        sample.rss = get_process_rss();
+        if (py == nullptr)
+            return sample;
+
+        qstring errbuf;
+        idc_value_t rv;
+        json_t result;
+        if (   !py_helpers.install(*py, "leakwatch", PY_HELPER_LEAKWATCH, &errbuf)
+            || !py_helpers.eval(*py, "leak_sample()", &rv, &errbuf)
+            || rv.vtype != VT_STR
+            || !json_t::parse(rv.qstr().c_str(), rv.qstr().length(), result, &errbuf))
+        {
+            msg("QScripts leak watch failed to sample the Python objects: %s\n", errbuf.c_str());
+            return sample;
+        }
+
+        sample.has_py  = true;
+        sample.hooks   = int64(result.get_num("hooks"));
+        sample.actions = int64(result.get_num("actions"));
+        sample.timers  = int64(result.get_num("timers"));
+        if (const json_t *types = result.get("types"))
+        {
+            for (auto &m : types->members())
+            {
+                int64 n = int64(m.second.as_num());
+                sample.types[m.first.c_str()] = n;
+                sample.objects += n;
+            }
+        }
+        return sample;
+    }
+
+    // Reports a run and warns about the growth that persisted over the last runs
+    void add_run(const char *file, const leak_sample_t &before, const leak_sample_t &after)
+    {
+        qstring line;
+        line.sprnt("QScripts leak watch %s: RSS %+.2f MB",
+            qbasename(file),
+            (int64(after.rss) - int64(before.rss)) / (1024.0 * 1024.0));
+        if (before.has_py && after.has_py)
+        {
+            line.cat_sprnt(", objects %+" FMT_64 "d, hooks %+" FMT_64 "d, actions %+" FMT_64 "d, timers %+" FMT_64 "d",
+                after.objects - before.objects,
+                after.hooks - before.hooks,
+                after.actions - before.actions,
+                after.timers - before.timers);
+        }
+        msg("%s\n", line.c_str());
+
+        auto &runs = history[file];
+        runs.push_back(after);
+        if (runs.size() > LEAK_WATCH_RUNS + 1)
+            runs.pop_front();
+        if (runs.size() <= LEAK_WATCH_RUNS)
+            return;
+
+        const leak_sample_t &first = runs.front();
+        qstrvec_t growing;
+        if (grew_each_run(runs, [](const leak_sample_t &s) { return int64(s.rss); }))
+            growing.push_back().sprnt("RSS +%.2f MB", (int64(after.rss) - int64(first.rss)) / (1024.0 * 1024.0));
+        if (after.has_py && first.has_py)
+        {
+            static const struct { const char *name; int64 leak_sample_t::*field; } counters[] =
+            {
+                { "objects", &leak_sample_t::objects },
+                { "hooks",   &leak_sample_t::hooks },
+                { "actions", &leak_sample_t::actions },
+                { "timers",  &leak_sample_t::timers },
+            };
+            for (auto &c : counters)
+            {
+                if (grew_each_run(runs, [&c](const leak_sample_t &s) { return s.*c.field; }))
+                    growing.push_back().sprnt("%s +%" FMT_64 "d", c.name, after.*c.field - first.*c.field);
+            }
+        }
+        if (growing.empty())
+            return;
+
+        qstring what;
+        for (auto &g : growing)
+        {
+            if (!what.empty())
+                what.append(", ");
+            what.append(g);
+        }
+        msg("QScripts leak watch: %s kept growing over its last %d runs (%s)\n",
+            qbasename(file),
+            LEAK_WATCH_RUNS,
+            what.c_str());
+        qstring top_types = after.has_py && first.has_py ? top_growing_types(first, after) : qstring();
+        if (!top_types.empty())
+            msg("Top growing types:\n%s", top_types.c_str());
+
+        // Warn again only after another series of growing runs
+        runs.erase(runs.begin(), runs.end() - 1);
+    }
+
+    void clear()
+    {
+        history.clear();
+    }
+};
@@ -0,0 +1,163 @@
+#pragma once
+
+//-------------------------------------------------------------------------
+// Direct execution of native modules (plugins built against the IDA SDK).
+//
+// The module is copied to a unique temporary file that is loaded, run and
+// unloaded, so the build output is never mapped and can be relinked anytime.
+//
+// Entry points, in order of preference:
+// - an exported cooperative task (see qscripts_task.hpp), run by the caller
+// - an exported 'extern "C" bool qscripts_main(size_t arg)' function
+// - the exported 'PLUGIN' descriptor: init(), run(arg), then term() or the
+//   deletion of the returned plugmod_t
+static constexpr char NATIVE_ENTRY_NAME[]  = "qscripts_main";
+static constexpr char NATIVE_PLUGIN_NAME[] = "PLUGIN";
+
+class native_module_t
+{
+    using entry_t = bool (idaapi *)(size_t);
+
+    qstring shadow_path;
+#ifdef __NT__
+    HMODULE h_module = nullptr;
+#else
+    void *h_module = nullptr;
+#endif
+    static inline int s_counter = 0;
+
+    bool make_shadow_copy(const char *module_path, qstring *errbuf)
+    {
+        namespace fs = std::filesystem;
+        std::error_code ec;
+        fs::path src(module_path);
+
+        char name[64];
+        qsnprintf(name, sizeof(name), "qscripts_native_%d_%d", qgetpid(), ++s_counter);
+        fs::path dest = fs::temp_directory_path(ec) / name;
+        dest += src.extension();
+
+        if (ec || !fs::copy_file(src, dest, fs::copy_options::overwrite_existing, ec))
+        {
+            errbuf->sprnt("failed to copy '%s' to '%s': %s",
+                module_path,
+                dest.string().c_str(),
+                ec.message().c_str());
+            return false;
+        }
+        shadow_path = dest.string().c_str();
+        return true;
+    }
+
+    bool load_shadow_copy(qstring *errbuf)
+    {
+#ifdef __NT__
+        h_module = LoadLibraryA(shadow_path.c_str());
+        if (h_module == nullptr)
+        {
+            errbuf->sprnt("LoadLibrary() failed with error %u", GetLastError());
+            return false;
+        }
+#else
+        h_module = dlopen(shadow_path.c_str(), RTLD_NOW | RTLD_LOCAL);
+        if (h_module == nullptr)
+        {
+            *errbuf = dlerror();
+            return false;
+        }
+#endif
+        return true;
+    }
+
+public:
+    native_module_t() = default;
+    native_module_t(const native_module_t &) = delete;
+    native_module_t &operator=(const native_module_t &) = delete;
+
+    // Loads a shadow copy of the module
+    bool load(const char *module_path, qstring *errbuf)
+    {
+        return make_shadow_copy(module_path, errbuf) && load_shadow_copy(errbuf);
+    }
+
+    void *find_symbol(const char *name)
+    {
+#ifdef __NT__
+        return (void *)GetProcAddress(h_module, name);
+#else
+        return dlsym(h_module, name);
+#endif
+    }
+
+    // Returns the cooperative task entry point, if the module has one
+    qscripts_task_start_t find_task_entry()
+    {
+        return (qscripts_task_start_t)find_symbol(QSCRIPTS_TASK_START_NAME);
+    }
+
+    // Runs the module's (non cooperative) entry point
+    bool run(size_t arg, qstring *errbuf)
+    {
+        if (auto entry = (entry_t)find_symbol(NATIVE_ENTRY_NAME))
+            return entry(arg);
+
+        auto plugin = (plugin_t *)find_symbol(NATIVE_PLUGIN_NAME);
+        if (plugin == nullptr)
+        {
+            errbuf->sprnt("the module exports neither '%s' nor '%s'", NATIVE_ENTRY_NAME, NATIVE_PLUGIN_NAME);
+            return false;
+        }
+
+        plugmod_t *pm = plugin->init != nullptr ? plugin->init() : PLUGIN_OK;
+        if (pm == PLUGIN_SKIP)
+        {
+            *errbuf = "the plugin's init() returned PLUGIN_SKIP";
+            return false;
+        }
+
+        bool ok;
+        if ((plugin->flags & PLUGIN_MULTI) != 0)
+        {
+            // A PLUGIN_MULTI plugin must return its plugmod_t object
+            if (pm == nullptr || pm == PLUGIN_OK || pm == PLUGIN_KEEP)
+            {
+                *errbuf = "the PLUGIN_MULTI plugin's init() did not return a plugmod_t object";
+                return false;
+            }
+            ok = pm->run(arg);
+            delete pm;
+        }
+        else
+        {
+            ok = plugin->run != nullptr && plugin->run(arg);
+            if (plugin->term != nullptr)
+                plugin->term();
+        }
+        return ok;
+    }
+
+    // Unloads the module and deletes its shadow copy
+    void unload()
+    {
+        if (h_module != nullptr)
+        {
+#ifdef __NT__
+            FreeLibrary(h_module);
+#else
+            dlclose(h_module);
+#endif
+            h_module = nullptr;
+        }
+        if (!shadow_path.empty())
+        {
+            qunlink(shadow_path.c_str());
+            shadow_path.qclear();
+        }
+    }
+
+
+    ~native_module_t()
+    {
+        unload();
+    }
+};
@@ -0,0 +1,331 @@
+#pragma once
+
+//-------------------------------------------------------------------------
+// Output capture of the Python scripts (see the "Capture the output" option).
+//
+// While a script runs, its sys.stdout and sys.stderr are replaced by a writer
+// that hands the text to capture_sink() (see PY_HELPER_CAPTURE). The text is
+// copied into a lock-free ring buffer that a background thread drains into the
+// log of the run: '.qscripts/logs/<script>.<date>-<time>.log' next to the
+// script. The output window only gets a throttled tail: the latest line every
+// CAPTURE_MIRROR_MS, and the last lines of the run once it ends.
+static constexpr size_t CAPTURE_RING_SIZE  = 1024 * 1024; // must be a power of two
+static constexpr uint64 CAPTURE_MIRROR_MS  = 500;
+static constexpr uint64 CAPTURE_TAIL_LINES = 10;
+static constexpr size_t CAPTURE_MAX_LINE   = 512;         // mirrored characters per line
+static constexpr size_t CAPTURE_KEEP_LOGS  = 20;          // logs kept per script
+
+//-------------------------------------------------------------------------
+// Single producer, single consumer byte ring
+class capture_ring_t
+{
+    std::unique_ptr<char[]> buf{ new char[CAPTURE_RING_SIZE] };
+    std::atomic<size_t> head{ 0 };  // bytes written so far (producer)
+    std::atomic<size_t> tail{ 0 };  // bytes read so far (consumer)
+
+public:
+    // Copies as much as fits and returns the number of copied bytes
+    size_t push(const char *data, size_t size)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        size_t t = tail.load(std::memory_order_acquire);
+        size_t n = qmin(size, CAPTURE_RING_SIZE - (h - t));
+        for (size_t done = 0; done < n;)
+        {
+            size_t pos = (h + done) & (CAPTURE_RING_SIZE - 1);
+            size_t chunk = qmin(n - done, CAPTURE_RING_SIZE - pos);
+            memcpy(&buf[pos], data + done, chunk);
+            done += chunk;
+        }
+        head.store(h + n, std::memory_order_release);
+        return n;
+    }
+
+    // Writes the pending bytes to a file and returns their count
+    size_t drain(FILE *fp)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t h = head.load(std::memory_order_acquire);
+        for (size_t done = 0; done < h - t;)
+        {
+            size_t pos = (t + done) & (CAPTURE_RING_SIZE - 1);
+            size_t chunk = qmin(h - t - done, CAPTURE_RING_SIZE - pos);
+            qfwrite(fp, &buf[pos], chunk);
+            done += chunk;
+        }
+        tail.store(h, std::memory_order_release);
+        return h - t;
+    }
+};
+
+//-------------------------------------------------------------------------
+class output_capture_t
+{
+    capture_ring_t ring;
+    qthread_t writer = nullptr;
+    qsemaphore_t data_sem = nullptr;    // posted by write(), wakes up the writer thread
+    std::atomic<bool> stopping{ false };
+    FILE *fp = nullptr;
+    qstring log_path;
+
+    // stop() waits for the writes in progress: a Python thread may still hold
+    // the writer after the run and call write() without the main thread's GIL
+    std::atomic<bool> enabled{ false };
+    std::atomic<int> nwriters{ 0 };
+
+    // The producer's state: the writes are serialized by Python's GIL
+    uint64 nbytes = 0;
+    uint64 nlines = 0;
+    uint64 unmirrored_lines = 0;
+    uint64 last_mirror_ns = 0;
+    qstring last_line;  // the last complete line
+    qstring cur_line;   // the line being written
+
+    static int idaapi s_writer_cb(void *ud)
+    {
+        ((output_capture_t *)ud)->writer_loop();
+        return 0;
+    }
+
+    void writer_loop()
+    {
+        for (;;)
+        {
+            // Check before draining so that nothing written before stop() is lost
+            bool last = stopping.load(std::memory_order_acquire);
+            if (ring.drain(fp) == 0)
+            {
+                if (last)
+                    break;
+                qsem_wait(data_sem, -1);
+            }
+        }
+        qfflush(fp);
+    }
+
+    static void append_line(qstring &line, const char *data, size_t size)
+    {
+        if (line.length() < CAPTURE_MAX_LINE)
+            line.append(data, qmin(size, CAPTURE_MAX_LINE - line.length()));
+    }
+
+    // Tracks the lines for the mirror without keeping the text
+    void scan_lines(const char *data, size_t size)
+    {
+        const char *end = data + size;
+        const char *last_nl = nullptr;
+        for (const char *p = data; (p = (const char *)memchr(p, '\n', end - p)) != nullptr; ++p)
+        {
+            if (last_nl == nullptr)
+            {
+                // The first line ends the one being written
+                last_line.swap(cur_line);
+                append_line(last_line, data, p - data);
+            }
+            else
+            {
+                last_line.qclear();
+                append_line(last_line, last_nl + 1, p - last_nl - 1);
+            }
+            last_nl = p;
+            ++nlines;
+            ++unmirrored_lines;
+        }
+        if (last_nl == nullptr)
+        {
+            append_line(cur_line, data, size);
+        }
+        else
+        {
+            cur_line.qclear();
+            append_line(cur_line, last_nl + 1, end - last_nl - 1);
+        }
+    }
+
+    // Prints the last lines of the log that were not mirrored yet
+    void print_tail()
+    {
+        uint64 count = unmirrored_lines + (cur_line.empty() ? 0 : 1);
+        if (count == 0)
+            return;
+        uint64 shown = qmin(count, CAPTURE_TAIL_LINES);
+        if (count > shown)
+            msg("... (%" FMT_64 "u more lines in the log)\n", count - shown);
+
+        // The tail lines are read back from the end of the log
+        FILE *log = qfopen(log_path.c_str(), "rb");
+        if (log == nullptr)
+            return;
+        uint64 size = qfsize(log);
+        uint64 span = qmin(size, uint64(shown * CAPTURE_MAX_LINE * 2));
+        qstring text;
+        text.resize(span);
+        qfseek(log, size - span, SEEK_SET);
+        qfread(log, text.begin(), span);
+        qfclose(log);
+
+        // Skip a trailing newline, then walk back 'shown' lines
+        size_t end = text.length();
+        if (end > 0 && text[end - 1] == '\n')
+            --end;
+        size_t start = end;
+        for (uint64 i = 0; i < shown && start > 0; )
+        {
+            if (text[--start] == '\n' && ++i == shown)
+            {
+                ++start;
+                break;
+            }
+        }
+        msg("%.*s\n", int(end - start), text.c_str() + start);
+    }
+
+    static void prune_logs(const std::filesystem::path &log_dir, const std::string &prefix)
+    {
+        namespace fs = std::filesystem;
+        std::vector<std::pair<fs::file_time_type, fs::path>> logs;
+        std::error_code ec;
+        for (auto &entry : fs::directory_iterator(log_dir, ec))
+        {
+            std::string name = entry.path().filename().string();
+            if (name.compare(0, prefix.size(), prefix) == 0 && entry.path().extension() == ".log")
+                logs.emplace_back(entry.last_write_time(ec), entry.path());
+        }
+        if (logs.size() < CAPTURE_KEEP_LOGS)
+            return;
+        std::sort(logs.begin(), logs.end());
+        for (size_t i = 0; i + CAPTURE_KEEP_LOGS <= logs.size(); ++i)
+            fs::remove(logs[i].second, ec);
+    }
+
+public:
+    ~output_capture_t()
+    {
+        stop();
+        if (data_sem != nullptr)
+            qsem_free(data_sem);
+    }
+
+    // Creates the log of a new run of a script and starts the writer thread
+    bool start(const char *script_file, qstring *errbuf)
+    {
+        namespace fs = std::filesystem;
+        stop();
+
+        fs::path script_path(script_file);
+        fs::path log_dir = script_path.parent_path() / QSCRIPTS_LOCAL / "logs";
+        std::error_code ec;
+        fs::create_directories(log_dir, ec);
+
+        // Keep the most recent logs of the script only
+        std::string prefix = script_path.filename().string() + ".";
+        prune_logs(log_dir, prefix);
+
+        char stamp[32];
+        qstrftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", qtime32());
+        log_path = (log_dir / (prefix + stamp + ".log")).string().c_str();
+        for (int n = 2; qfileexist(log_path.c_str()); ++n)
+            log_path.sprnt("%s" SDIRCHAR "%s%s-%d.log", log_dir.string().c_str(), prefix.c_str(), stamp, n);
+
+        fp = qfopen(log_path.c_str(), "wb");
+        if (fp == nullptr)
+        {
+            errbuf->sprnt("cannot create '%s'", log_path.c_str());
+            return false;
+        }
+
+        if (data_sem == nullptr)
+            data_sem = qsem_create(nullptr, 0);
+        stopping = false;
+        writer = qthread_create(s_writer_cb, this);
+        if (writer == nullptr)
+        {
+            qfclose(fp);
+            fp = nullptr;
+            errbuf->sprnt("failed to create the writer thread");
+            return false;
+        }
+
+        nbytes = nlines = unmirrored_lines = 0;
+        last_mirror_ns = get_nsec_stamp();
+        last_line.qclear();
+        cur_line.qclear();
+        enabled.store(true, std::memory_order_release);
+        return true;
+    }
+
+    // Flushes the log, prints the tail of the output and a summary
+    void stop()
+    {
+        if (fp == nullptr)
+            return;
+
+        // Wait for the writes in progress: the next ones go to the output window
+        enabled.store(false);
+        while (nwriters.load() != 0)
+            std::this_thread::yield();
+
+        stopping.store(true, std::memory_order_release);
+        qsem_post(data_sem);
+        qthread_join(writer);
+        qthread_free(writer);
+        writer = nullptr;
+        qfclose(fp);
+        fp = nullptr;
+
+        print_tail();
+        msg("QScripts captured %" FMT_64 "u lines (%" FMT_64 "u bytes) of output to %s\n",
+            nlines + (cur_line.empty() ? 0 : 1),
+            nbytes,
+            log_path.c_str());
+    }
+
+    bool is_enabled() const { return enabled.load(std::memory_order_acquire); }
+    const qstring &get_path() const { return log_path; }
+
+    // Returns false if the capture is not running
+    bool write(const char *data, size_t size)
+    {
+        // Seen by stop() before it checks the writes in progress, or sees the capture stopped
+        nwriters.fetch_add(1);
+        if (!enabled.load())
+        {
+            nwriters.fetch_sub(1);
+            return false;
+        }
+
+        nbytes += size;
+        scan_lines(data, size);
+
+        // The writer thread catches up when the ring is full
+        while (size > 0)
+        {
+            size_t n = ring.push(data, size);
+            data += n;
+            size -= n;
+            qsem_post(data_sem);
+            if (size > 0)
+                std::this_thread::yield();
+        }
+
+        uint64 now = get_nsec_stamp();
+        if (unmirrored_lines > 0 && now - last_mirror_ns >= CAPTURE_MIRROR_MS * 1000000)
+        {
+            msg("%s\n", last_line.c_str());
+            last_mirror_ns = now;
+            unmirrored_lines = 0;
+        }
+        nwriters.fetch_sub(1, std::memory_order_release);
+        return true;
+    }
+};
+
+static output_capture_t g_capture;
+
+// Called by the Python writer through ctypes
+static void capture_sink(const char *data, size_t size)
+{
+    // A thread may still hold the writer after the run
+    if (!g_capture.write(data, size))
+        msg("%.*s", int(size), data);
+}
@@ -0,0 +1,305 @@
+#pragma once
+
+//-------------------------------------------------------------------------
+// A child process whose standard output and error are captured.
+//
+// The output is read without blocking so the process can be polled from
+// a timer on the main thread.
+class child_process_t
+{
+#ifdef __NT__
+    HANDLE h_process = nullptr;
+    HANDLE h_job     = nullptr;
+    HANDLE h_out     = nullptr;
+#else
+    pid_t pid  = -1;
+    int fd_out = -1;
+#endif
+    qstring pending;
+    bool b_started   = false;
+    bool b_exited    = false;
+    int exit_code    = -1;
+    uint64 start_ns  = 0;
+    uint64 end_ns    = 0;
+    uint64 peak_rss  = 0;
+
+    void flush_lines(const std::function<void(const char *)> &cb, bool eof)
+    {
+        size_t start = 0;
+        for (size_t i = 0; i < pending.length(); ++i)
+        {
+            if (pending[i] != '\n')
+                continue;
+
+            size_t end = i;
+            if (end > start && pending[end - 1] == '\r')
+                --end;
+            qstring line(pending.c_str() + start, end - start);
+            cb(line.c_str());
+            start = i + 1;
+        }
+        pending.remove(0, start);
+
+        if (eof && !pending.empty())
+        {
+            cb(pending.c_str());
+            pending.qclear();
+        }
+    }
+
+    void close_output()
+    {
+#ifdef __NT__
+        if (h_out != nullptr)
+        {
+            CloseHandle(h_out);
+            h_out = nullptr;
+        }
+#else
+        if (fd_out != -1)
+        {
+            close(fd_out);
+            fd_out = -1;
+        }
+#endif
+    }
+
+public:
+    child_process_t() = default;
+    child_process_t(const child_process_t &) = delete;
+    child_process_t &operator=(const child_process_t &) = delete;
+
+    // Starts a shell command line in the given working directory
+    bool start(const char *cmdline, const char *work_dir, qstring *errbuf)
+    {
+#ifdef __NT__
+        SECURITY_ATTRIBUTES sa = { sizeof(sa), nullptr, TRUE };
+        HANDLE h_wr;
+        if (!CreatePipe(&h_out, &h_wr, &sa, 0))
+        {
+            errbuf->sprnt("CreatePipe() failed with error %u", GetLastError());
+            return false;
+        }
+        SetHandleInformation(h_out, HANDLE_FLAG_INHERIT, 0);
+
+        STARTUPINFOA si = { sizeof(si) };
+        si.dwFlags    = STARTF_USESTDHANDLES;
+        si.hStdOutput = h_wr;
+        si.hStdError  = h_wr;
+
+        qstring cmd;
+        cmd.sprnt("cmd.exe /S /C \"%s\"", cmdline);
+
+        PROCESS_INFORMATION pi;
+        BOOL ok = CreateProcessA(
+            nullptr,
+            cmd.begin(),
+            nullptr,
+            nullptr,
+            TRUE,
+            CREATE_NO_WINDOW | CREATE_SUSPENDED,
+            nullptr,
+            work_dir,
+            &si,
+            &pi);
+        CloseHandle(h_wr);
+        if (!ok)
+        {
+            errbuf->sprnt("CreateProcess() failed with error %u", GetLastError());
+            close_output();
+            return false;
+        }
+
+        // Use a job object so the whole process tree can be terminated
+        h_job = CreateJobObjectA(nullptr, nullptr);
+        if (h_job != nullptr)
+        {
+            JOBOBJECT_EXTENDED_LIMIT_INFORMATION li = {};
+            li.BasicLimitInformation.LimitFlags = JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE;
+            SetInformationJobObject(h_job, JobObjectExtendedLimitInformation, &li, sizeof(li));
+            AssignProcessToJobObject(h_job, pi.hProcess);
+        }
+        ResumeThread(pi.hThread);
+        CloseHandle(pi.hThread);
+        h_process = pi.hProcess;
+#else
+        int fds[2];
+        if (pipe(fds) != 0)
+        {
+            errbuf->sprnt("pipe() failed: %s", strerror(errno));
+            return false;
+        }
+        fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+        fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+
+        qstring shell_cmd;
+        if (work_dir != nullptr && work_dir[0] != '\0')
+            shell_cmd.sprnt("cd %s && %s", shell_quote(work_dir).c_str(), cmdline);
+        else
+            shell_cmd = cmdline;
+
+        posix_spawn_file_actions_t fa;
+        posix_spawn_file_actions_init(&fa);
+        posix_spawn_file_actions_adddup2(&fa, fds[1], STDOUT_FILENO);
+        posix_spawn_file_actions_adddup2(&fa, fds[1], STDERR_FILENO);
+
+        // Put the child in its own process group so the whole tree can be terminated
+        posix_spawnattr_t attr;
+        posix_spawnattr_init(&attr);
+        posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+        posix_spawnattr_setpgroup(&attr, 0);
+
+        char sh[] = "/bin/sh", dash_c[] = "-c";
+        char *argv[] = { sh, dash_c, shell_cmd.begin(), nullptr };
+        int rc = posix_spawn(&pid, sh, &fa, &attr, argv, environ);
+
+        posix_spawnattr_destroy(&attr);
+        posix_spawn_file_actions_destroy(&fa);
+        close(fds[1]);
+
+        if (rc != 0)
+        {
+            errbuf->sprnt("posix_spawn() failed: %s", strerror(rc));
+            close(fds[0]);
+            pid = -1;
+            return false;
+        }
+        fd_out = fds[0];
+        fcntl(fd_out, F_SETFL, fcntl(fd_out, F_GETFL) | O_NONBLOCK);
+#endif
+        b_started = true;
+        b_exited  = false;
+        start_ns  = get_nsec_stamp();
+        return true;
+    }
+
+    // Reads the available output and calls 'cb' for each complete line
+    void read_output(const std::function<void(const char *)> &cb)
+    {
+        char buf[4096];
+        bool eof = false;
+#ifdef __NT__
+        while (h_out != nullptr)
+        {
+            DWORD avail = 0, nread = 0;
+            if (!PeekNamedPipe(h_out, nullptr, 0, nullptr, &avail, nullptr))
+            {
+                eof = true;
+                break;
+            }
+            if (avail == 0)
+                break;
+            if (!ReadFile(h_out, buf, qmin(DWORD(sizeof(buf)), avail), &nread, nullptr) || nread == 0)
+            {
+                eof = true;
+                break;
+            }
+            pending.append(buf, nread);
+        }
+#else
+        while (fd_out != -1)
+        {
+            ssize_t n = read(fd_out, buf, sizeof(buf));
+            if (n > 0)
+            {
+                pending.append(buf, size_t(n));
+                continue;
+            }
+            if (n < 0 && (errno == EAGAIN || errno == EINTR))
+                break;
+            eof = true;
+            break;
+        }
+#endif
+        flush_lines(cb, eof);
+        if (eof)
+            close_output();
+    }
+
+    // Checks if the process exited (and reaps it)
+    bool poll_exit()
+    {
+        if (!b_started || b_exited)
+            return b_exited;
+#ifdef __NT__
+        if (WaitForSingleObject(h_process, 0) != WAIT_OBJECT_0)
+            return false;
+
+        DWORD code = DWORD(-1);
+        GetExitCodeProcess(h_process, &code);
+        exit_code = int(code);
+
+        // The process is the shell that runs the command: the job object covers the whole tree
+        JOBOBJECT_EXTENDED_LIMIT_INFORMATION li = {};
+        PROCESS_MEMORY_COUNTERS pmc;
+        if (   h_job != nullptr
+            && QueryInformationJobObject(h_job, JobObjectExtendedLimitInformation, &li, sizeof(li), nullptr))
+        {
+            peak_rss = li.PeakProcessMemoryUsed;
+        }
+        else if (GetProcessMemoryInfo(h_process, &pmc, sizeof(pmc)))
+        {
+            peak_rss = pmc.PeakWorkingSetSize;
+        }
+#else
+        int status = 0;
+        struct rusage ru;
+        if (wait4(pid, &status, WNOHANG, &ru) != pid)
+            return false;
+
+        exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    #ifdef __MAC__
+        peak_rss = uint64(ru.ru_maxrss);
+    #else
+        peak_rss = uint64(ru.ru_maxrss) * 1024;
+    #endif
+#endif
+        b_exited = true;
+        end_ns = get_nsec_stamp();
+        return true;
+    }
+
+    // Terminates the process and all of its children
+    void terminate()
+    {
+        if (!b_started || b_exited)
+            return;
+#ifdef __NT__
+        if (h_job != nullptr)
+            TerminateJobObject(h_job, 1);
+        else
+            TerminateProcess(h_process, 1);
+#else
+        kill(-pid, SIGKILL);
+#endif
+    }
+
+    bool is_running() const   { return b_started && !b_exited; }
+    int get_exit_code() const { return exit_code; }
+    uint64 get_peak_rss() const { return peak_rss; }
+
+    double elapsed_secs() const
+    {
+        return ((b_exited ? end_ns : get_nsec_stamp()) - start_ns) / 1000000000.0;
+    }
+
+    ~child_process_t()
+    {
+        if (is_running())
+        {
+            terminate();
+#ifdef __NT__
+            WaitForSingleObject(h_process, INFINITE);
+#else
+            waitpid(pid, nullptr, 0);
+#endif
+        }
+        close_output();
+#ifdef __NT__
+        if (h_process != nullptr)
+            CloseHandle(h_process);
+        if (h_job != nullptr)
+            CloseHandle(h_job);
+#endif
+    }
+};
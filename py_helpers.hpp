@@ -0,0 +1,433 @@
+#pragma once
+
+//-------------------------------------------------------------------------
+// Python helpers used by QScripts.
+//
+// The helpers are installed on demand into a private '__qscripts__' module
+// so that the scripts' namespace is not polluted. They are invoked with
+// the extlang's expression evaluator.
+static constexpr char PY_HELPERS_MODULE[] = "__qscripts__";
+
+//-------------------------------------------------------------------------
+// Function-level hot patching: when only function or class definitions
+// changed, the new code objects are swapped into the live objects.
+static constexpr char PY_HELPER_HOTPATCH[] = R"PY(
+import ast, sys, types
+
+_hotpatch_state = {}
+
+def _hotpatch_parse(path):
+    with open(path, 'rb') as f:
+        tree = ast.parse(f.read(), path)
+    defs, stmts = {}, []
+    for node in tree.body:
+        if isinstance(node, (ast.FunctionDef, ast.AsyncFunctionDef, ast.ClassDef)):
+            defs[node.name] = node
+        else:
+            stmts.append(ast.dump(node))
+    return defs, stmts
+
+def _hotpatch_func(old, new):
+    try:
+        old.__code__ = new.__code__
+    except ValueError:
+        # Different closure layout
+        return False
+    old.__defaults__ = new.__defaults__
+    old.__kwdefaults__ = new.__kwdefaults__
+    old.__annotations__ = new.__annotations__
+    old.__doc__ = new.__doc__
+    old.__dict__.update(new.__dict__)
+    return True
+
+def _hotpatch_class(old, new):
+    for name, value in list(new.__dict__.items()):
+        if name in ('__dict__', '__weakref__'):
+            continue
+        cur = old.__dict__.get(name)
+        if isinstance(cur, types.FunctionType) and isinstance(value, types.FunctionType) and _hotpatch_func(cur, value):
+            continue
+        try:
+            setattr(old, name, value)
+        except (AttributeError, TypeError):
+            return False
+    for name in [n for n, v in old.__dict__.items() if isinstance(v, types.FunctionType) and n not in new.__dict__]:
+        delattr(old, name)
+    return True
+
+def _hotpatch_namespace(namespace):
+    mod = sys.modules.get(namespace or '__main__')
+    return (mod or sys.modules['__main__']).__dict__
+
+def hotpatch_commit(path):
+    defs, stmts = _hotpatch_parse(path)
+    _hotpatch_state[path] = (stmts, {n: ast.dump(d) for n, d in defs.items()})
+
+def hotpatch(path, namespace=None):
+    """Returns the number of patched definitions or -1 if the script has to be fully executed"""
+    prev = _hotpatch_state.get(path)
+    if prev is None:
+        return -1
+    defs, stmts = _hotpatch_parse(path)
+    if stmts != prev[0]:
+        return -1
+
+    g = _hotpatch_namespace(namespace)
+    dumps = {n: ast.dump(d) for n, d in defs.items()}
+    changed = [n for n in defs if prev[1].get(n) != dumps[n]]
+    for name in changed:
+        code = compile(ast.Module(body=[defs[name]], type_ignores=[]), path, 'exec')
+        tmp = {}
+        exec(code, g, tmp)
+        old, new = g.get(name), tmp[name]
+        if isinstance(old, types.FunctionType) and isinstance(new, types.FunctionType) and _hotpatch_func(old, new):
+            continue
+        if isinstance(old, type) and isinstance(new, type) and _hotpatch_class(old, new):
+            continue
+        g[name] = new
+
+    for name in set(prev[1]) - set(defs):
+        g.pop(name, None)
+
+    _hotpatch_state[path] = (stmts, dumps)
+    return len(changed)
+)PY";
+
+//-------------------------------------------------------------------------
+// Namespace isolation: each active script runs in its own module namespace
+// that is torn down before the next run.
+static constexpr char PY_HELPER_NAMESPACE[] = R"PY(
+import gc, sys
+
+def ns_call_unload(name, func_name):
+    mod = sys.modules.get(name)
+    func = getattr(mod, func_name, None) if mod is not None else None
+    if callable(func):
+        func()
+
+def ns_teardown(name):
+    """Returns 'collected_objects released_blocks' or an empty string if the namespace did not exist"""
+    mod = sys.modules.pop(name, None)
+    if mod is None:
+        return ''
+    blocks = sys.getallocatedblocks()
+    mod.__dict__.clear()
+    del mod
+    collected = gc.collect()
+    return '%d %d' % (collected, blocks - sys.getallocatedblocks())
+)PY";
+
+//-------------------------------------------------------------------------
+// Trigger pipe arguments: the payload written to the pipe is split like a
+// shell command line and passed to the script in 'sys.argv'.
+static constexpr char PY_HELPER_TRIGGER[] = R"PY(
+import shlex, sys
+
+def set_trigger_args(script, payload):
+    try:
+        args = shlex.split(payload)
+    except ValueError:
+        args = payload.split()
+    sys.argv = [script] + args
+)PY";
+
+//-------------------------------------------------------------------------
+// IDB event batches: the scripts triggered by database events find the
+// affected addresses by event class in '__qscripts__.idb_events'.
+static constexpr char PY_HELPER_IDB_EVENTS[] = R"PY(
+idb_events = {}
+idb_events_truncated = False
+
+def set_idb_events(events, truncated=False):
+    global idb_events, idb_events_truncated
+    idb_events = events
+    idb_events_truncated = truncated
+)PY";
+
+//-------------------------------------------------------------------------
+// Editor buffers: unsaved text is executed as if it was the given file. The
+// text is padded so that its line numbers match the file's, and it is served
+// to 'linecache' so the tracebacks show the buffer's lines.
+static constexpr char PY_HELPER_BUFFER[] = R"PY(
+import linecache, sys, traceback, types
+
+def exec_buffer(path, text, first_line, namespace=None):
+    """Returns an empty string or the formatted exception"""
+    if namespace:
+        mod = sys.modules.get(namespace)
+        if mod is None:
+            mod = sys.modules[namespace] = types.ModuleType(namespace)
+    else:
+        mod = sys.modules['__main__']
+    g = mod.__dict__
+
+    src = '\n' * (first_line - 1) + text
+    saved_lines = linecache.cache.get(path)
+    linecache.cache[path] = (len(src), None, src.splitlines(True), path)
+    saved_file = g.get('__file__')
+    g['__file__'] = path
+    try:
+        exec(compile(src, path, 'exec'), g)
+        return ''
+    except BaseException:
+        t, v, tb = sys.exc_info()
+        return ''.join(traceback.format_exception(t, v, tb.tb_next))
+    finally:
+        # An isolated namespace keeps its '__file__' like any module
+        if not namespace:
+            if saved_file is None:
+                g.pop('__file__', None)
+            else:
+                g['__file__'] = saved_file
+        if saved_lines is None:
+            linecache.cache.pop(path, None)
+        else:
+            linecache.cache[path] = saved_lines
+)PY";
+
+//-------------------------------------------------------------------------
+// Profiler (see the '/profile' directive): the Python code that runs between
+// profile_start() and profile_stop() is profiled with cProfile. The stats are
+// saved for 'pstats' or snakeviz and the top functions are returned as text.
+static constexpr char PY_HELPER_PROFILE[] = R"PY(
+import cProfile, io, os, pstats
+
+_profiler = None
+
+def profile_start():
+    global _profiler
+    _profiler = cProfile.Profile()
+    _profiler.enable()
+
+def profile_stop(out_path, top):
+    """Returns the top functions by cumulative time or an empty string if not profiling"""
+    global _profiler
+    prof, _profiler = _profiler, None
+    if prof is None:
+        return ''
+    prof.disable()
+    os.makedirs(os.path.dirname(out_path), exist_ok=True)
+    prof.dump_stats(out_path)
+    out = io.StringIO()
+    pstats.Stats(prof, stream=out).sort_stats('cumulative').print_stats(top)
+    return out.getvalue()
+)PY";
+
+//-------------------------------------------------------------------------
+// Output capture (see output_capture.hpp): sys.stdout and sys.stderr write to
+// a native sink whose address is passed to capture_start(). PYFUNCTYPE keeps
+// the GIL during the call, so the writes of several threads reach the sink one
+// at a time.
+static constexpr char PY_HELPER_CAPTURE[] = R"PY(
+import ctypes, sys
+
+_capture_saved = None
+
+class _capture_writer(object):
+    encoding = 'utf-8'
+    errors = 'replace'
+
+    def __init__(self, sink):
+        self._sink = sink
+
+    def write(self, s):
+        b = s.encode('utf-8', 'replace') if isinstance(s, str) else bytes(s)
+        if b:
+            self._sink(b, len(b))
+        return len(s)
+
+    def writelines(self, lines):
+        for s in lines:
+            self.write(s)
+
+    def flush(self):
+        pass
+
+    def isatty(self):
+        return False
+
+def capture_start(sink_addr):
+    global _capture_saved
+    if _capture_saved is None:
+        _capture_saved = (sys.stdout, sys.stderr)
+    sink = ctypes.PYFUNCTYPE(None, ctypes.c_char_p, ctypes.c_size_t)(sink_addr)
+    sys.stdout = sys.stderr = _capture_writer(sink)
+
+def capture_stop():
+    global _capture_saved
+    if _capture_saved is not None:
+        sys.stdout, sys.stderr = _capture_saved
+        _capture_saved = None
+)PY";
+
+//-------------------------------------------------------------------------
+// Leak watch samples (see leak_watch.hpp): the live objects by type, and the
+// hooks, actions and timers that are currently registered. The hooks and the
+// timers are counted by wrapping their (un)registration functions once.
+static constexpr char PY_HELPER_LEAKWATCH[] = R"PY(
+import gc, json, sys, weakref
+
+_leak_hooked = weakref.WeakSet()
+_leak_timers = set()
+_leak_patched = set()
+
+def _leak_hook_bases():
+    for mod, names in (('ida_idp', ('IDP_Hooks', 'IDB_Hooks')),
+                       ('ida_kernwin', ('UI_Hooks', 'View_Hooks')),
+                       ('ida_dbg', ('DBG_Hooks',)),
+                       ('ida_hexrays', ('Hexrays_Hooks',))):
+        m = sys.modules.get(mod)
+        for name in names:
+            cls = getattr(m, name, None)
+            if cls is not None:
+                yield cls
+
+def _leak_patch_hooks(cls):
+    orig_hook, orig_unhook = cls.hook, cls.unhook
+    def hook(self, *args):
+        r = orig_hook(self, *args)
+        if r:
+            _leak_hooked.add(self)
+        return r
+    def unhook(self, *args):
+        _leak_hooked.discard(self)
+        return orig_unhook(self, *args)
+    cls.hook, cls.unhook = hook, unhook
+
+def _leak_patch_timers(mods):
+    kw = sys.modules['ida_kernwin']
+    orig_register, orig_unregister = kw.register_timer, kw.unregister_timer
+    def register_timer(interval, callback):
+        box = []
+        def cb():
+            r = callback()
+            if r == -1 and box:
+                _leak_timers.discard(box[0])
+            return r
+        t = orig_register(interval, cb)
+        if t is not None:
+            box.append(id(t))
+            _leak_timers.add(id(t))
+        return t
+    def unregister_timer(t):
+        _leak_timers.discard(id(t))
+        return orig_unregister(t)
+    for m in mods:
+        m.register_timer, m.unregister_timer = register_timer, unregister_timer
+
+def _leak_patch():
+    for cls in _leak_hook_bases():
+        if cls not in _leak_patched:
+            _leak_patch_hooks(cls)
+            _leak_patched.add(cls)
+    if 'timers' not in _leak_patched and 'ida_kernwin' in sys.modules:
+        _leak_patch_timers([m for m in (sys.modules.get('ida_kernwin'), sys.modules.get('idaapi')) if m is not None])
+        _leak_patched.add('timers')
+
+def leak_sample():
+    """Returns a JSON object: {'types': {name: count}, 'hooks': n, 'actions': n, 'timers': n}"""
+    _leak_patch()
+    gc.collect()
+    by_type = {}
+    for o in gc.get_objects():
+        t = type(o)
+        by_type[t] = by_type.get(t, 0) + 1
+    types = {}
+    for t, n in by_type.items():
+        mod = getattr(t, '__module__', None)
+        name = t.__qualname__ if mod in (None, 'builtins') else '%s.%s' % (mod, t.__qualname__)
+        types[name] = types.get(name, 0) + n
+    try:
+        actions = len(sys.modules['ida_kernwin'].get_registered_actions())
+    except Exception:
+        actions = -1
+    return json.dumps({'types': types, 'hooks': len(_leak_hooked), 'actions': actions, 'timers': len(_leak_timers)})
+)PY";
+
+//-------------------------------------------------------------------------
+// Bootstrap of the out-of-process workers: opens a database copy with idalib,
+// runs the script and exits with the script's status.
+// Usage: qscripts_worker.py <database> <script> [search paths...]
+static constexpr char WORKER_BOOTSTRAP_NAME[] = "qscripts_worker.py";
+static constexpr char PY_WORKER_BOOTSTRAP[] = R"PY(
+import os, sys, runpy, traceback
+db_path, script_path, search_paths = sys.argv[1], sys.argv[2], sys.argv[3:]
+
+import idapro
+if idapro.open_database(db_path, False) != 0:
+    print('QScripts worker: failed to open the database %s' % db_path)
+    sys.exit(2)
+
+status = 0
+try:
+    sys.argv = [script_path]
+    sys.path[0:0] = [os.path.dirname(script_path)] + search_paths
+    runpy.run_path(script_path, run_name='__main__')
+except SystemExit as e:
+    status = e.code if isinstance(e.code, int) else 0
+except BaseException:
+    traceback.print_exc()
+    status = 1
+finally:
+    idapro.close_database(False)
+
+sys.stdout.flush()
+sys.exit(status)
+)PY";
+
+//-------------------------------------------------------------------------
+class py_helpers_t
+{
+    qstrvec_t installed;
+
+public:
+    static bool is_python(extlang_object_t &elang)
+    {
+        return !elang->is_idc() && streq(elang->fileext, "py");
+    }
+
+    // Installs a helper's source code into the helpers module (once)
+    bool install(
+        extlang_object_t &elang,
+        const char *name,
+        const char *src,
+        qstring *errbuf)
+    {
+        if (installed.has(name))
+            return true;
+
+        qstring snippet;
+        snippet.sprnt(
+            "exec(compile(%s, '<qscripts:%s>', 'exec'), "
+            "__import__('sys').modules.setdefault('%s', __import__('types').ModuleType('%s')).__dict__)",
+            make_py_str_literal(src).c_str(),
+            name,
+            PY_HELPERS_MODULE,
+            PY_HELPERS_MODULE);
+
+        if (!elang->eval_snippet(snippet.c_str(), errbuf))
+            return false;
+
+        installed.push_back(name);
+        return true;
+    }
+
+    // Evaluates an expression in the helpers module, for example: "hotpatch('file.py')"
+    bool eval(
+        extlang_object_t &elang,
+        const char *expr,
+        idc_value_t *rv,
+        qstring *errbuf)
+    {
+        qstring full_expr;
+        full_expr.sprnt("__import__('%s').%s", PY_HELPERS_MODULE, expr);
+
+        idc_value_t dummy;
+        return elang->eval_expr(rv == nullptr ? &dummy : rv, BADADDR, full_expr.c_str(), errbuf);
+    }
+
+    void clear()
+    {
+        installed.qclear();
+    }
+};
@@ -11,15 +11,67 @@ scripts in your favorite editor and execute them directly in IDA.
 #include <regex>
 #include <filesystem>
 #include <unordered_set>
+#include <map>
+#include <set>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
 #include "ida.h"
 
-#include "utils_impl.cpp"
-#include "script.hpp"
+#include "qscripts_core.hpp"
+#include "stream_exec.hpp"
+#include "py_helpers.hpp"
+#include "process.hpp"
+#include "worker_pool.hpp"
+#include "trigger_pipe.hpp"
+#include "qscripts_task.hpp"
+#include "native_exec.hpp"
+#include "task_runner.hpp"
+#include "json.hpp"
+#include "rpc_server.hpp"
+#include "watch_client.hpp"
+#include "idb_events.hpp"
+#include "corpus_runner.hpp"
+#include "script_stats.hpp"
+#include "trace.hpp"
+#include "leak_watch.hpp"
+#include "output_capture.hpp"
 
 //-------------------------------------------------------------------------
 // Some constants
 static constexpr int  IDA_MAX_RECENT_SCRIPTS    = 512;
 static constexpr char IDAREG_RECENT_SCRIPTS[]   = "RecentScripts";
+#ifdef __NT__
+static constexpr char DEFAULT_CORPUS_CMD[]      = "python \"$bootstrap$\" \"$idb$\" \"$script$\" $paths$";
+#else
+static constexpr char DEFAULT_CORPUS_CMD[]      = "python3 \"$bootstrap$\" \"$idb$\" \"$script$\" $paths$";
+#endif
+
+//-------------------------------------------------------------------------
+// Baseline database snapshot of the active script (see the /snapshot directive).
+// It lives outside of the plugin instance because restoring a snapshot may
+// reload the database and therefore re-create the plugin instance.
+struct snapshot_ctx_t
+{
+    snapshot_t baseline;
+    qstring script_file;
+    qstring run_file;
+    bool has_baseline = false;
+    bool restore_pending = false;
+    uint64 restore_start = 0;
+
+    void clear()
+    {
+        has_baseline = restore_pending = false;
+        script_file.qclear();
+        run_file.qclear();
+    }
+};
+static snapshot_ctx_t g_snapshot;
 
 //-------------------------------------------------------------------------
 // Non-modal scripts chooser
@@ -33,28 +85,92 @@ private:
 
     bool m_b_filemon_timer_active = false;
     qtimer_t m_filemon_timer = nullptr;
-    const std::regex RE_EXPANDER = std::regex(R"(\$(.+?)\$)");
 
     int opt_change_interval  = 500;
     int opt_clear_log        = 0;
     int opt_show_filename    = 0;
     int opt_exec_unload_func = 0;
     int opt_with_undo        = 0;
+    int opt_stream_threshold = 0;
+    int opt_isolate_ns       = 0;
+    int opt_use_watchd       = 0;
+    int opt_leak_watch       = 0;
+    int opt_run_history      = 1;
+    int opt_capture_output   = 0;
+    qstring opt_rpc_endpoint;
+    qstring opt_trace_file;
+    qstring opt_journal_file;
 
     active_script_info_t selected_script;
     script_info_t* action_active_script = nullptr;
 
-    struct expand_ctx_t
+    // Parses the dependency index files of the active scripts
+    deps_parser_t m_deps{selected_script};
+
+    // Records the changes the monitor detects and what it does about them (see the options)
+    session_journal_t m_journal;
+
+    // Scripts that are active along with the selected script (in activation order)
+    std::vector<std::unique_ptr<active_script_info_t>> m_extra_scripts;
+
+    py_helpers_t py_helpers;
+
+    // Out-of-process execution
+    worker_pool_t m_workers;
+    qstring m_worker_db;
+    int m_worker_job_count = 0;
+
+    // Trigger pipe listener
+    trigger_pipe_t m_trigger_pipe;
+
+    // Trigger file readiness checks
+    file_readiness_t m_trigger_ready;
+
+    // Build stage
+    worker_pool_t m_build;
+    std::unordered_map<std::string, std::filesystem::file_time_type> m_build_sources;
+    uint64 m_build_save_ns = 0;
+
+    // Cooperative task of the active native module
+    native_task_runner_t m_task;
+
+    // Runs of the selected script on a database corpus
+    corpus_runner_t m_corpus;
+
+    // Editor RPC endpoint
+    rpc_server_t m_rpc;
+
+    // Shared watcher daemon client
+    watch_client_t m_watchd;
+    bool m_b_force_scan = false;
+
+    // Database events of the '/on' directives
+    idb_event_batcher_t m_idb_events;
+
+    // Execution statistics of the scripts and the time spent in the reload
+    // directives before the upcoming execution
+    script_stats_db_t m_stats;
+    run_history_t m_history;
+    uint64 m_pending_reload_ns = 0;
+
+    // Outcome of the last execution (reported to the editors)
+    struct last_run_t
     {
-        // input
-        qstring script_file;
-        bool    main_file;
+        qstring file;
+        qstring error;
+        bool ok = false;
+        double duration_ms = 0;
+        qtime64_t when = 0;
+        idb_mutations_t mutations;
+    } m_last_run;
 
-        // working
-        qstring base_dir;
-        qstring pkg_base;
-        qstring reload_cmd;
-    };
+    // Database changes made by the running script
+    idb_mutation_counter_t m_mutations;
+
+    // Memory growth across the runs (when the leak watch is enabled)
+    leak_watch_t m_leak_watch;
+
+    static qscripts_chooser_t *s_instance;
 
     inline int normalize_filemon_interval(const int change_interval) const
     {
@@ -66,214 +182,472 @@ private:
         return selected_script.file_path.c_str();
     }
 
-    bool make_meta_filename(
-        const char* filename,
-        const char* extension,
-        qstring& out,
-        bool local_only = false)
+    void set_selected_script(script_info_t &script)
     {
-        // Check the .qscripts folder
-        char dir[2048];
-        if (qdirname(dir, sizeof(dir), filename))
-        {
-            out.sprnt("%s" SDIRCHAR QSCRIPTS_LOCAL SDIRCHAR "%s.%s", dir, qbasename(filename), extension);
-            if (qfileexist(out.c_str()))
-                return true;
-        }
+        // Activate a new script
+        m_deps.load_active_script(selected_script, script.file_path.c_str());
+        m_journal.activated(selected_script, opt_change_interval);
 
-        if (local_only)
-            return false;
+        // It is no longer an additional active script
+        remove_extra_script(selected_script.file_path.c_str());
 
-        // Check the actual script folder
-        out.sprnt("%s.%s", filename, extension);
-        return qfileexist(out.c_str());
-    }
+        update_trigger_pipe();
 
-    bool find_deps_file(
-        const char* filename,
-        qstring& out)
-    {
-        return      make_meta_filename(filename, "deps", out, true)
-                ||  make_meta_filename(filename, "deps.qscripts", out);
+        if (selected_script.has_build())
+            scan_build_sources();
+
+        if (selected_script.trigger_based())
+        {
+            int samples = selected_script.trigger_samples;
+            m_trigger_ready.watch(
+                selected_script.trigger_file.c_str(),
+                samples == -1 ? TRIGGER_READY_SAMPLES : samples);
+        }
+        else
+        {
+            m_trigger_ready.unwatch();
+        }
 
+        update_watches();
+        update_idb_events();
     }
-    
-    bool parse_deps_for_script(expand_ctx_t &ctx)
+
+    // Installs or removes the database event hooks to match the active script
+    void update_idb_events()
     {
-        // Parse the dependency index file
-        qstring dep_file;
-        if (!find_deps_file(ctx.script_file.c_str(), dep_file))
-            return false;
+        if (!selected_script.idb_triggered())
+        {
+            m_idb_events.stop();
+            return;
+        }
 
-        FILE *fp = qfopen(dep_file.c_str(), "r");
-        if (fp == nullptr)
-            return false;
+        m_idb_events.start(
+            selected_script.idb_events,
+            selected_script.idb_events_window,
+            // The changes made by QScripts' own runs (and native tasks) do not count
+            [this]() { return is_monitor_active() && !m_task.is_running(); },
+            [this](idb_event_batch_t &batch) { on_idb_events(batch); });
 
-        // Get the dependency file directory
-        ctx.base_dir.resize(ctx.script_file.size());
-        qdirname(ctx.base_dir.begin(), ctx.base_dir.size(), ctx.script_file.c_str());
-        ctx.base_dir.resize(strlen(ctx.base_dir.c_str()));
+        // The batch is always defined, even for the runs not caused by events
+        if (!selected_script.b_worker)
+            set_idb_event_args(&selected_script, nullptr);
+    }
 
-        // Add the dependency file to the active script
-        selected_script.add_dep_index(dep_file.c_str());
+    // Executes the active script once for a batch of database events
+    void on_idb_events(idb_event_batch_t &batch)
+    {
+        if (!is_monitor_active() || !has_selected_script() || m_task.is_running())
+            return;
 
-        static auto get_value = [](const char* str, const char* key, int key_len) -> const char *
+        if (opt_show_filename)
         {
-            if (strncmp(str, key, key_len) != 0)
-                return nullptr;
-            // Empty value?
-            if (str[key_len] == '\0')
-                return "";
-            else
-                return str + key_len + 1;
-        };
+            msg("QScripts executing %s on %u database event(s)%s...\n",
+                selected_script.file_path.c_str(),
+                uint(batch.nevents),
+                batch.truncated ? " (truncated)" : "");
+        }
 
-        // Parse each line
-        for (qstring line = dep_file; qgetline(&line, fp) != -1;)
-        {
-            line.trim2();
+        if (!selected_script.b_worker)
+            set_idb_event_args(&selected_script, &batch);
+        execute_script(&selected_script, opt_with_undo);
+        if (!selected_script.b_worker)
+            set_idb_event_args(&selected_script, nullptr);
+    }
 
-            // Skip comment lines (';', '//' and '#')
-            if (line.empty() || strncmp(line.c_str(), "//", 2) == 0 || line[0] == '#' || line[0] == ';')
-                continue;
+    // Exposes a batch of database events to the script: the '__qscripts__.idb_events' dict
+    // for Python scripts and the 'qscripts_idb_events' global variable for IDC scripts.
+    // A null batch resets them.
+    void set_idb_event_args(const script_info_t *script_info, const idb_event_batch_t *batch)
+    {
+        const char *script_ext = get_file_ext(script_info->file_path.c_str());
+        extlang_object_t elang(nullptr);
+        if (script_ext == nullptr || (elang = find_extlang_by_ext(script_ext)) == nullptr)
+            return;
 
-            // Parse special directives (some apply only for the main selected script)
-            if (auto val = get_value(line.c_str(), "/pkgbase", 8))
+        qstring errbuf;
+        if (elang->is_idc())
+        {
+            // One line per event class: "<class> <ea> <ea>..."
+            qstring lines;
+            if (batch != nullptr)
             {
-                if (ctx.main_file)
+                for (auto &kv : batch->eas)
                 {
-                    ctx.pkg_base = val;
-                    expand_file_name(ctx.pkg_base, ctx);
-                    make_abs_path(ctx.pkg_base, ctx.base_dir.c_str(), true);
+                    lines.append(idb_event_class_name(kv.first));
+                    for (ea_t ea : kv.second)
+                        lines.cat_sprnt(" 0x%a", ea);
+                    lines.append('\n');
                 }
-                continue;
             }
-            else if (auto val = get_value(line.c_str(), "/notebook.cells_re", 18))
+            idc_value_t *gvar = add_idc_gvar("qscripts_idb_events");
+            if (gvar != nullptr)
+                gvar->set_string(lines);
+        }
+        else if (py_helpers_t::is_python(elang))
+        {
+            qstring expr = "set_idb_events({";
+            if (batch != nullptr)
             {
-                if (ctx.main_file)
+                for (auto &kv : batch->eas)
                 {
-                    selected_script.notebook.cells_re = std::regex(val);
-                    continue;
+                    expr.cat_sprnt("'%s':[", idb_event_class_name(kv.first));
+                    for (ea_t ea : kv.second)
+                        expr.cat_sprnt("0x%a,", ea);
+                    expr.append("],");
                 }
             }
-            else if (auto val = get_value(line.c_str(), "/notebook.activate", 18))
+            expr.cat_sprnt("}, %s)", batch != nullptr && batch->truncated ? "True" : "False");
+            if (   !py_helpers.install(elang, "idb_events", PY_HELPER_IDB_EVENTS, &errbuf)
+                || !py_helpers.eval(elang, expr.c_str(), nullptr, &errbuf))
             {
-                if (ctx.main_file)
-                {
-                    int act;
-                    if (qstrcmp(val, "exec_main") == 0)
-                        act = notebook_ctx_t::act_exec_main;
-                    else if (qstrcmp(val, "exec_all") == 0)
-                        act = notebook_ctx_t::act_exec_all;
-                    else
-                        act = notebook_ctx_t::act_exec_none;
-
-                    selected_script.notebook.activation_action = act;
-                    continue;
-                }
+                msg("QScripts failed to set the database events:\n%s", errbuf.c_str());
             }
-            else if (auto val = get_value(line.c_str(), "/notebook", 9))
+        }
+    }
+
+    // Starts, restarts or stops the trigger pipe listener to match the active script
+    void update_trigger_pipe()
+    {
+        const qstring &path = selected_script.trigger_pipe;
+        if (path.empty())
+        {
+            m_trigger_pipe.stop();
+            return;
+        }
+        if (m_trigger_pipe.is_active() && m_trigger_pipe.get_path() == path)
+            return;
+
+        qstring err;
+        if (!m_trigger_pipe.start(path.c_str(), [this]() { filemon_timer_cb(); }, &err))
+            msg("QScripts failed to listen on the trigger pipe '%s': %s\n", path.c_str(), err.c_str());
+    }
+
+    // Connects to (or disconnects from) the shared watcher daemon to match the options
+    void update_watch_client()
+    {
+        if (!opt_use_watchd)
+        {
+            m_watchd.stop();
+            return;
+        }
+        if (m_watchd.is_active())
+            return;
+
+        // Prefer a daemon installed along with the plugin, then look it up in the PATH
+        qstring daemon = WATCHD_EXE_NAME;
+        qstring user_plugins;
+        user_plugins.sprnt("%s" SDIRCHAR PLG_SUBDIR, get_user_idadir());
+        for (const char *dir : { user_plugins.c_str(), idadir(PLG_SUBDIR) })
+        {
+            qstring candidate;
+            candidate.sprnt("%s" SDIRCHAR "%s", dir, WATCHD_EXE_NAME);
+            if (qfileexist(candidate.c_str()))
             {
-                if (ctx.main_file)
-                {
-                    selected_script.b_is_notebook = true;
-                    selected_script.notebook.title = val;
-                    continue;
-                }
+                daemon = candidate;
+                break;
             }
-            else if (auto val = get_value(line.c_str(), "/reload", 7))
+        }
+
+        qstring err;
+        if (!m_watchd.start(daemon.c_str(), [this]() { on_watchd_event(); }, &err))
+        {
+            msg("QScripts failed to use the watcher daemon: %s\n", err.c_str());
+            return;
+        }
+        update_watches();
+    }
+
+    // Registers the files of the active script with the watcher daemon
+    void update_watches()
+    {
+        if (!m_watchd.is_active())
+            return;
+
+        // The files shared by several active scripts are watched once
+        std::set<std::string> paths;
+        auto add_paths = [&paths](const active_script_info_t &script)
+        {
+            paths.insert(script.file_path.c_str());
+            for (auto &dep_index : script.dep_indices)
+                paths.insert(dep_index.file_path.c_str());
+            for (auto &kv : script.dep_scripts)
+                paths.insert(kv.first);
+            if (script.trigger_based())
+                paths.insert(script.trigger_file.file_path.c_str());
+            if (script.is_notebook())
+                paths.insert(script.notebook.base_path);
+        };
+        if (has_selected_script())
+            add_paths(selected_script);
+        for (auto &script : m_extra_scripts)
+            add_paths(*script);
+        m_watchd.set_watches(paths);
+        m_watchd.set_active(selected_script.file_path.c_str());
+        m_b_force_scan = true;
+    }
+
+    // The modes that rely on a single resource of the plugin are reserved to the selected script
+    static const char *get_selected_only_directive(const active_script_info_t &script)
+    {
+        return script.has_build()      ? "/build"
+             : script.is_native()      ? "/native"
+             : script.trigger_based()  ? "/triggerfile"
+             : script.pipe_triggered() ? "/triggerpipe"
+             : script.idb_triggered()  ? "/on"
+             : script.b_worker         ? "/worker"
+             : script.b_snapshot       ? "/snapshot"
+             :                           nullptr;
+    }
+
+    // Loads an additional active script. Fails if it uses a mode reserved to the selected script.
+    bool load_extra_script(active_script_info_t &script, const char *file_path)
+    {
+        m_deps.load_active_script(script, file_path);
+        const char *directive = get_selected_only_directive(script);
+        if (directive == nullptr)
+        {
+            m_journal.activated(script, opt_change_interval);
+            return true;
+        }
+
+        msg("QScripts: %s uses the %s directive, it can only be the selected script\n",
+            script.file_path.c_str(),
+            directive);
+        return false;
+    }
+
+    // Tells if any of the active scripts depends on the file
+    bool is_dependency(const qstring &file_path) const
+    {
+        if (selected_script.has_dep(file_path) != nullptr)
+            return true;
+        for (auto &script : m_extra_scripts)
+        {
+            if (script->has_dep(file_path) != nullptr)
+                return true;
+        }
+        return false;
+    }
+
+    active_script_info_t *find_extra_script(const qstring &file_path) const
+    {
+        for (auto &script : m_extra_scripts)
+        {
+            if (script->file_path == file_path)
+                return script.get();
+        }
+        return nullptr;
+    }
+
+    bool remove_extra_script(const char *file_path)
+    {
+        for (auto it = m_extra_scripts.begin(); it != m_extra_scripts.end(); ++it)
+        {
+            if ((*it)->file_path == file_path)
             {
-                if (ctx.main_file)
-                    ctx.reload_cmd = val;
-                continue;
+                m_journal.deactivated(file_path);
+                m_extra_scripts.erase(it);
+                return true;
             }
-            else if (auto trigger_file = get_value(line.c_str(), "/triggerfile", 12))
-            {
-                if (auto keep = get_value(trigger_file, "/keep", 5))
-                {
-                    trigger_file = keep;
-                    selected_script.b_keep_trigger_file = true;
-                }
+        }
+        return false;
+    }
 
-                if (ctx.main_file)
-                {
-                    selected_script.trigger_file.refresh(trigger_file);
-                    expand_file_name(selected_script.trigger_file.file_path, ctx);
-                }
-                continue;
-            }
+    // Activates a script along with the selected script and executes it, or deactivates it
+    void toggle_extra_script(size_t n)
+    {
+        const qstring &file_path = m_scripts[n].file_path;
+        if (remove_extra_script(file_path.c_str()))
+        {
+            msg("QScripts deactivated %s\n", file_path.c_str());
+            update_watches();
+            return;
+        }
 
-            // From here on, the *line* variable is an expandable string leading to a script file
-            ctx.script_file = line;
-            expand_file_name(line, ctx);
-            normalize_path_sep(line);
+        if (!is_monitor_active() || !has_selected_script())
+        {
+            msg("QScripts: activate a script first, then add the scripts to keep active along with it\n");
+            return;
+        }
+        if (selected_script.file_path == file_path)
+            return;
 
-            // Skip dependency scripts that (do not|no longer) exist
-            script_info_t dep_script;
-            if (!get_file_modification_time(line, &dep_script.modified_time))
-                continue;
+        auto script = std::make_unique<active_script_info_t>();
+        if (!load_extra_script(*script, file_path.c_str()))
+            return;
 
-            // Add script
-            dep_script.file_path  = line.c_str();
-            dep_script.reload_cmd = ctx.reload_cmd;
-            dep_script.pkg_base   = ctx.pkg_base;
+        active_script_info_t *added = script.get();
+        m_extra_scripts.push_back(std::move(script));
+        update_watches();
 
-            selected_script.dep_scripts[line.c_str()] = std::move(dep_script);
+        if (!added->is_notebook() || added->notebook.activation_action == notebook_ctx_t::act_exec_main)
+            execute_script(added, opt_with_undo);
+        else if (added->notebook.activation_action == notebook_ctx_t::act_exec_all)
+            execute_notebook_cells(added);
+    }
 
-            expand_ctx_t sub_ctx = ctx;
-            sub_ctx.script_file  = line;
-            sub_ctx.main_file    = false;
-            parse_deps_for_script(sub_ctx);
+    // Called on the main thread when the watcher daemon reported a change or a run request
+    void on_watchd_event()
+    {
+        qstring script;
+        if (   m_watchd.take_run_request(&script)
+            && is_monitor_active()
+            && selected_script.file_path == script)
+        {
+            if (opt_show_filename)
+                msg("QScripts executing %s on the request of another instance...\n", script.c_str());
+            execute_script(&selected_script, opt_with_undo);
         }
-        qfclose(fp);
-
-        return true;
+        filemon_timer_cb();
     }
 
-    void expand_file_name(qstring &filename, const expand_ctx_t &ctx)
+    // Exposes the trigger pipe payload to the script: 'sys.argv' for Python scripts and
+    // the 'qscripts_trigger_args' global variable for IDC scripts
+    void set_trigger_args(const script_info_t *script_info, const qstring &payload)
     {
-        expand_string(filename, filename, ctx);
-        make_abs_path(filename, ctx.base_dir.c_str(), true);
+        auto script_file = script_info->file_path.c_str();
+        const char *script_ext = get_file_ext(script_file);
+        extlang_object_t elang(nullptr);
+        if (script_ext == nullptr || (elang = find_extlang_by_ext(script_ext)) == nullptr)
+            return;
+
+        qstring errbuf;
+        if (elang->is_idc())
+        {
+            idc_value_t *gvar = add_idc_gvar("qscripts_trigger_args");
+            if (gvar != nullptr)
+                gvar->set_string(payload);
+        }
+        else if (py_helpers_t::is_python(elang))
+        {
+            qstring expr;
+            expr.sprnt("set_trigger_args(%s, %s)",
+                make_py_str_literal(script_file).c_str(),
+                make_py_str_literal(payload.c_str()).c_str());
+            if (   !py_helpers.install(elang, "trigger", PY_HELPER_TRIGGER, &errbuf)
+                || !py_helpers.eval(elang, expr.c_str(), nullptr, &errbuf))
+            {
+                msg("QScripts failed to set the trigger arguments:\n%s", errbuf.c_str());
+            }
+        }
     }
 
-    void populate_initial_notebook_cells()
+    // Takes the time-stamps of the build sources and returns true if any of them changed
+    bool scan_build_sources()
     {
-        auto& cell_files = selected_script.notebook.cell_files;
-        auto current_path = std::filesystem::path(selected_script.file_path.c_str()).parent_path();
-        selected_script.notebook.base_path = current_path.string();
+        namespace fs = std::filesystem;
+        bool changed = false;
+        std::unordered_set<std::string> present;
+        for (auto &pattern : selected_script.build_sources)
+        {
+            enumerate_glob(
+                pattern.c_str(),
+                [this, &changed, &present](const std::string &file)
+                {
+                    std::error_code ec;
+                    auto mtime = fs::last_write_time(file, ec);
+                    present.insert(file);
+                    auto p = m_build_sources.find(file);
+                    if (p == m_build_sources.end() || p->second != mtime)
+                    {
+                        m_build_sources[file] = mtime;
+                        changed = true;
+                    }
+                    return true;
+                });
+        }
 
-        enumerate_files(
-            current_path, 
-            selected_script.notebook.cells_re, 
-            [&cell_files](const std::string& filename)
+        // Deleted sources
+        for (auto it = m_build_sources.begin(); it != m_build_sources.end(); )
+        {
+            if (present.find(it->first) == present.end())
             {
-                qtime64_t mtime;
-                get_file_modification_time(filename, &mtime);
-                cell_files[filename] = mtime;
-                return true;
+                it = m_build_sources.erase(it);
+                changed = true;
             }
-        );
+            else
+            {
+                ++it;
+            }
+        }
+        return changed;
     }
-    
-    void set_selected_script(script_info_t &script)
+
+    // Starts the build command in the background. A build in progress is superseded.
+    void start_build()
     {
-        // Activate a new script
-        selected_script.clear();
-        selected_script.refresh(script.file_path.c_str());
+        if (m_build.is_busy())
+            m_build.cancel_all();
+
+        qstring work_dir;
+        work_dir.resize(selected_script.file_path.size());
+        qdirname(work_dir.begin(), work_dir.size(), selected_script.file_path.c_str());
+        work_dir.resize(strlen(work_dir.c_str()));
+
+        auto job = std::make_unique<worker_job_t>();
+        job->label    = "build";
+        job->command  = selected_script.build_cmd;
+        job->work_dir = work_dir;
+        job->on_done  = [this](worker_job_t &job) { on_build_done(job); };
+
+        m_build_save_ns = get_nsec_stamp();
+        if (opt_show_filename)
+            msg("QScripts building: %s\n", job->command.c_str());
+        m_build.submit(std::move(job));
+        refresh_chooser(QSCRIPTS_TITLE);
+    }
+
+    // Executes the active script after a successful build
+    void on_build_done(worker_job_t &job)
+    {
+        refresh_chooser(QSCRIPTS_TITLE);
+        if (job.start_failed)
+            return;
+
+        double build_ms = job.proc.elapsed_secs() * 1000.0;
+        int exit_code = job.proc.get_exit_code();
+        if (exit_code != 0)
+        {
+            msg("QScripts build failed with exit code %d after %.2f ms\n", exit_code, build_ms);
+            return;
+        }
+        if (!has_selected_script() || !is_monitor_active())
+            return;
 
-        // Recursively parse the dependencies and the index files
-        expand_ctx_t main_ctx = { script.file_path.c_str(), true };
-        parse_deps_for_script(main_ctx);
+        // The build output is complete: do not trigger again on its modification
+        if (selected_script.trigger_based())
+            selected_script.trigger_file.refresh();
+
+        if (selected_script.b_snapshot && !selected_script.b_worker && g_snapshot.has_baseline)
+        {
+            restore_baseline_and_execute(&selected_script);
+            return;
+        }
 
-        // If a notebook is selected, let's capture all the cell files
-        if (selected_script.is_notebook())
-            populate_initial_notebook_cells();
+        uint64 run_start = get_nsec_stamp();
+        execute_script(&selected_script, opt_with_undo);
+        uint64 end = get_nsec_stamp();
+        msg("QScripts save to result in %.2f ms (build: %.2f ms, run: %.2f ms)\n",
+            (end - m_build_save_ns) / 1000000.0,
+            build_ms,
+            (end - run_start) / 1000000.0);
     }
 
     void clear_selected_script()
     {
+        if (has_selected_script())
+            m_journal.deactivated(selected_script.file_path.c_str());
         action_active_script = nullptr;
         selected_script.clear();
+        m_workers.cancel_all();
+        m_trigger_pipe.stop();
+        m_trigger_ready.unwatch();
+        m_build.cancel_all();
+        m_build_sources.clear();
+        m_task.cancel();
+        m_idb_events.stop();
+        m_extra_scripts.clear();
+        update_watches();
         // ...and deactivate the monitor
         activate_monitor(false);
     }
@@ -286,87 +660,11 @@ private:
     bool is_monitor_active()          const { return m_b_filemon_timer_active; }
     bool is_filemon_timer_installed() const { return m_filemon_timer != nullptr; }
 
-    std::string expand_pkgmodname(const expand_ctx_t& ctx)
-    {
-        auto dep_file = selected_script.has_dep(ctx.script_file.c_str());
-        qstring pkg_base = dep_file == nullptr ? selected_script.pkg_base : dep_file->pkg_base;
-
-        // If the script file is in the package base, then replace the path separators with '.'
-        if (strncmp(ctx.script_file.c_str(), pkg_base.c_str(), pkg_base.length()) == 0)
-        {
-            qstring s = ctx.script_file.c_str() + pkg_base.length() + 1;
-            s.replace(SDIRCHAR, ".");
-            // Drop the extension too
-            auto idx = s.rfind('.');
-            if (idx != -1)
-                s.resize(idx);
-
-            return s.c_str();
-        }
-        return "";
-    }
-    
-    // Dynamic string expansion   Description
-    // ------------------------   -----------
-    // basename                   Returns the basename of the input file
-    // env:Variable_Name          Expands the 'Variable_Name'
-    // pkgbase                    Sets the current pkgbase path
-    // pkgmodname                 Expands the file name using the pkgbase into the form: 'module.submodule1.submodule2'
-    // pkgparentmodname           Expands the file name using the pkgbase into the form up to the parent module: 'module.submodule1'
-    // ext                        Add-on suffix including bitness and extension (example: 64.dll, .so, 64.so, .dylib, etc.)
-    void expand_string(
-        qstring &input, 
-        qstring &output, 
-        const expand_ctx_t& ctx)
-    {
-        output = std::regex_replace(
-            input.c_str(),
-            RE_EXPANDER,
-            [this, ctx](auto &m) -> std::string
-            {
-                qstring match1 = m.str(1).c_str();
-
-                if (strncmp(match1.c_str(), "pkgmodname", 10) == 0)
-                {
-					return expand_pkgmodname(ctx);
-                }
-                else if (strncmp(match1.c_str(), "pkgparentmodname", 16) == 0)
-                {
-                    std::string pkgmodname = expand_pkgmodname(ctx);
-                    size_t pos = pkgmodname.rfind('.');
-                    return pos == std::string::npos ? pkgmodname : pkgmodname.substr(0, pos);
-                }
-                else if (strncmp(match1.c_str(), "ext", 3) == 0)
-                {
-                    static_assert(LOADER_DLL[0] == '*');
-                    return LOADER_DLL + 1;
-                }
-                else if (strncmp(match1.c_str(), "pkgbase", 7) == 0)
-                {
-                    return ctx.pkg_base.c_str();
-                }
-                else if (strncmp(match1.c_str(), "basename", 8) == 0)
-                {
-                    char *basename, *ext;
-                    qstring wrk_str;
-                    get_basename_and_ext(ctx.script_file.c_str(), &basename, &ext, wrk_str);
-                    return basename;
-                }
-                else if (strncmp(match1.c_str(), "env:", 4) == 0)
-                {
-                    qstring env;
-                    if (qgetenv(match1.begin() + 4, &env))
-                        return env.c_str();
-                }
-                return m.str(1);
-            }
-        ).c_str();
-    }
-
     bool execute_reload_directive(
         script_info_t &dep_script_file,
         qstring &err,
-        bool silent=true)
+        bool silent=true,
+        int profile_top=0)
     {
         const char *script_file = dep_script_file.file_path.c_str();
 
@@ -384,9 +682,13 @@ private:
             expand_ctx_t ctx;
             ctx.script_file = script_file;
             ctx.pkg_base = dep_script_file.pkg_base;
-            expand_string(dep_script_file.reload_cmd, reload_cmd, ctx);
+            m_deps.expand_string(dep_script_file.reload_cmd, reload_cmd, ctx);
 
-            if (!elang->eval_snippet(reload_cmd.c_str(), &err))
+            bool profiling = profile_top > 0 && py_helpers_t::is_python(elang) && start_profiling(elang);
+            bool reloaded = elang->eval_snippet(reload_cmd.c_str(), &err);
+            if (profiling)
+                stop_profiling(elang, script_file, "reload.prof", profile_top);
+            if (!reloaded)
             {
                 err.sprnt(
                     "QScripts failed to reload script file: '%s'\n"
@@ -398,91 +700,1163 @@ private:
             return true;
         } while (false);
 
-        if (!silent)
-			msg("%s", err.c_str());
+        if (!silent)
+			msg("%s", err.c_str());
+
+        return false;
+    }
+
+    // Takes the database copy used by the out-of-process workers. It is taken once
+    // and reused: the SDK cannot delete snapshots, so each copy would stay behind.
+    bool take_worker_database()
+    {
+        uint64 start = get_nsec_stamp();
+        snapshot_t ss;
+        qsnprintf(ss.desc, sizeof(ss.desc), "QScripts workers: %s", qbasename(selected_script.file_path.c_str()));
+
+        qstring err;
+        if (!take_database_snapshot(&ss, &err))
+        {
+            msg("QScripts failed to take the workers database copy: %s\n", err.c_str());
+            return false;
+        }
+        m_worker_db = ss.filename;
+        msg("QScripts took the workers database copy in %.2f ms: %s\n",
+            (get_nsec_stamp() - start) / 1000000.0,
+            ss.filename);
+        return true;
+    }
+
+    // Runs the active script (or notebook cell) in a headless worker process
+    bool submit_worker_job(const script_info_t *script_info)
+    {
+        namespace fs = std::filesystem;
+        if (m_worker_db.empty() && !take_worker_database())
+            return false;
+
+        int job_no = ++m_worker_job_count;
+        qstring job_name;
+        job_name.sprnt("job-%d-%d", qgetpid(), job_no);
+
+        // Each job gets its own directory and database copy
+        std::error_code ec;
+        fs::path job_dir = fs::temp_directory_path(ec) / "qscripts" / job_name.c_str();
+        fs::create_directories(job_dir, ec);
+        fs::path job_db = job_dir / fs::path(m_worker_db.c_str()).filename();
+        if (!ec)
+            fs::copy_file(m_worker_db.c_str(), job_db, fs::copy_options::overwrite_existing, ec);
+        if (ec)
+        {
+            msg("QScripts failed to prepare the worker directory '%s': %s\n",
+                job_dir.string().c_str(),
+                ec.message().c_str());
+            fs::remove_all(job_dir, ec);
+            return false;
+        }
+
+        fs::path bootstrap = job_dir / WORKER_BOOTSTRAP_NAME;
+        FILE *fp = qfopen(bootstrap.string().c_str(), "w");
+        if (fp == nullptr)
+        {
+            msg("QScripts failed to write the worker bootstrap '%s'\n", bootstrap.string().c_str());
+            fs::remove_all(job_dir, ec);
+            return false;
+        }
+        qfwrite(fp, PY_WORKER_BOOTSTRAP, strlen(PY_WORKER_BOOTSTRAP));
+        qfclose(fp);
+
+        // Expand the worker command
+        qstring cmd = selected_script.worker_cmd;
+        cmd.replace("$bootstrap$", bootstrap.string().c_str());
+        cmd.replace("$idb$",       job_db.string().c_str());
+        cmd.replace("$script$",    script_info->file_path.c_str());
+        cmd.replace("$jobdir$",    job_dir.string().c_str());
+        cmd.replace("$idadir$",    idadir(nullptr));
+        expand_ctx_t ctx;
+        ctx.script_file = script_info->file_path;
+        m_deps.expand_string(cmd, cmd, ctx);
+
+        auto job = std::make_unique<worker_job_t>();
+        job->label.sprnt("worker #%d", job_no);
+        job->command = cmd;
+        job->work_dir = job_dir.string().c_str();
+
+        qstring artifacts_re = selected_script.worker_artifacts_re;
+        qstring script_file = script_info->file_path;
+        job->on_done = [this, artifacts_re, script_file, job_name](worker_job_t &job)
+        {
+            on_worker_done(job, artifacts_re, script_file, job_name);
+        };
+        job->on_cancel = [job_dir]()
+        {
+            std::error_code ec;
+            fs::remove_all(job_dir, ec);
+        };
+
+        int max_jobs = selected_script.worker_jobs;
+        if (max_jobs <= 0)
+            max_jobs = qmax(1, int(std::thread::hardware_concurrency()));
+        m_workers.set_max_jobs(max_jobs);
+
+        if (opt_show_filename)
+            msg("QScripts queued %s for %s: %s\n", job->label.c_str(), script_file.c_str(), cmd.c_str());
+
+        m_workers.submit(std::move(job));
+        refresh_chooser(QSCRIPTS_TITLE);
+        return true;
+    }
+
+    // Collects the (sorted, unique) databases matching the corpus patterns
+    static void collect_corpus_databases(const qstrvec_t &patterns, qstrvec_t &databases)
+    {
+        std::set<std::string> found;
+        auto add_glob = [&found](const char *glob)
+        {
+            enumerate_glob(glob, [&found](const std::string &file)
+            {
+                found.insert(file);
+                return true;
+            });
+        };
+
+        for (auto &pattern : patterns)
+        {
+            if (pattern[0] != '@')
+            {
+                add_glob(pattern.c_str());
+                continue;
+            }
+
+            // A list file: one database (or glob) per line, relative to the list file
+            FILE *fp = qfopen(pattern.c_str() + 1, "r");
+            if (fp == nullptr)
+            {
+                msg("QScripts: cannot open the corpus list file '%s'\n", pattern.c_str() + 1);
+                continue;
+            }
+            char list_dir[QMAXPATH];
+            qdirname(list_dir, sizeof(list_dir), pattern.c_str() + 1);
+            for (qstring line; qgetline(&line, fp) != -1;)
+            {
+                line.trim2();
+                if (line.empty() || line[0] == '#' || line[0] == ';')
+                    continue;
+                make_abs_path(line, list_dir, true);
+                add_glob(line.c_str());
+            }
+            qfclose(fp);
+        }
+
+        databases.qclear();
+        for (auto &file : found)
+            databases.push_back(file.c_str());
+    }
+
+    // Runs the selected script on the databases of its '/corpus' directives (or on the ones asked for)
+    void run_corpus()
+    {
+        if (!has_selected_script())
+        {
+            msg("QScripts: there is no active script to run on a corpus\n");
+            return;
+        }
+
+        const auto &corpus = selected_script.corpus;
+        expand_ctx_t ctx = { selected_script.file_path, true, &selected_script };
+        ctx.base_dir.resize(selected_script.file_path.size());
+        qdirname(ctx.base_dir.begin(), ctx.base_dir.size(), selected_script.file_path.c_str());
+        ctx.base_dir.resize(strlen(ctx.base_dir.c_str()));
+
+        qstrvec_t patterns = corpus.patterns;
+        if (patterns.empty())
+        {
+            qstring pattern;
+            if (!ask_str(&pattern, HIST_FILE, "Databases to run %s on (glob or @list file)", qbasename(selected_script.file_path.c_str())))
+                return;
+            pattern.trim2();
+            if (pattern.empty())
+                return;
+            patterns.push_back(m_deps.resolve_corpus_pattern(pattern.c_str(), ctx));
+        }
+
+        corpus_params_t params;
+        params.script       = selected_script.file_path;
+        params.jobs         = corpus.jobs;
+        params.timeout_secs = corpus.timeout_secs;
+        collect_corpus_databases(patterns, params.databases);
+
+        // The dependencies' folders are added to the workers' search path
+        std::set<std::string> dirs;
+        for (auto &kv : selected_script.dep_scripts)
+        {
+            auto &dep = kv.second;
+            dirs.insert(dep.pkg_base.empty()
+                ? std::filesystem::path(kv.first).parent_path().string()
+                : std::string(dep.pkg_base.c_str()));
+        }
+        qstring paths;
+        for (auto &dir : dirs)
+            paths.cat_sprnt("%s\"%s\"", paths.empty() ? "" : " ", dir.c_str());
+
+        qstring cmd = corpus.cmd.empty() ? DEFAULT_CORPUS_CMD : corpus.cmd.c_str();
+        cmd.replace("$script$",    selected_script.file_path.c_str());
+        cmd.replace("$scriptdir$", ctx.base_dir.c_str());
+        cmd.replace("$paths$",     paths.c_str());
+        cmd.replace("$idadir$",    idadir(nullptr));
+
+        params.command = cmd;
+
+        // The remaining variables are expanded after the per-database ones
+        params.expand_cmd = [this, ctx](qstring &cmd) { m_deps.expand_string(cmd, cmd, ctx); };
+
+        if (!corpus.report.empty())
+        {
+            params.report_base = corpus.report;
+        }
+        else
+        {
+            char stamp[32];
+            qstrftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", qtime32());
+            params.report_base.sprnt("%s" SDIRCHAR QSCRIPTS_LOCAL SDIRCHAR "corpus" SDIRCHAR "%s-%s",
+                ctx.base_dir.c_str(),
+                qbasename(selected_script.file_path.c_str()),
+                stamp);
+        }
+
+        qstring err;
+        if (!m_corpus.start(params, []() { refresh_chooser(QSCRIPTS_TITLE); }, &err))
+            msg("QScripts cannot run the corpus: %s\n", err.c_str());
+        refresh_chooser(QSCRIPTS_TITLE);
+    }
+
+    // Reports a finished worker job and collects its artifacts
+    void on_worker_done(
+        worker_job_t &job,
+        const qstring &artifacts_re,
+        const qstring &script_file,
+        const qstring &job_name)
+    {
+        namespace fs = std::filesystem;
+        if (!job.start_failed)
+        {
+            msg("QScripts %s finished with exit code %d in %.2f s\n",
+                job.label.c_str(),
+                job.proc.get_exit_code(),
+                job.proc.elapsed_secs());
+        }
+
+        std::error_code ec;
+        fs::path job_dir = job.work_dir.c_str();
+        if (!artifacts_re.empty() && !job.start_failed)
+        {
+            fs::path out_dir = fs::path(script_file.c_str()).parent_path() / QSCRIPTS_LOCAL / "artifacts" / job_name.c_str();
+            std::regex re(artifacts_re.c_str());
+            for (auto it = fs::recursive_directory_iterator(job_dir, ec); !ec && it != fs::recursive_directory_iterator(); it.increment(ec))
+            {
+                if (!it->is_regular_file() || !std::regex_match(it->path().filename().string(), re))
+                    continue;
+
+                fs::path dest = out_dir / fs::relative(it->path(), job_dir);
+                fs::create_directories(dest.parent_path(), ec);
+                fs::copy_file(it->path(), dest, fs::copy_options::overwrite_existing, ec);
+                if (!ec)
+                    msg("QScripts %s artifact: %s\n", job.label.c_str(), dest.string().c_str());
+            }
+        }
+        fs::remove_all(job_dir, ec);
+        refresh_chooser(QSCRIPTS_TITLE);
+    }
+
+    bool execute_script(script_info_t *script_info, bool with_undo)
+    {
+        // The active script (or notebook cell) may be executed out of process
+        auto active_script = dynamic_cast<active_script_info_t *>(script_info);
+        if (active_script != nullptr && active_script->b_worker && !active_script->is_native())
+            return submit_worker_job(script_info);
+
+        if (with_undo)
+        {
+            action_active_script = script_info;
+            auto r = process_ui_action(ACTION_EXECUTE_SCRIPT_WITH_UNDO_ID);
+            action_active_script = nullptr;
+            return r;
+        }
+        return execute_script_sync(script_info);
+    }
+
+    // Attempts to hot-patch the changed function and class definitions of a Python script.
+    // Returns false if the script has to be executed as a whole. A hot-patch counts as a
+    // run of the script (statistics, history, database changes, output capture, leak watch).
+    bool hotpatch_script(script_info_t *script_info)
+    {
+        auto script_file = script_info->file_path.c_str();
+        const char *script_ext = get_file_ext(script_file);
+        extlang_object_t elang(nullptr);
+        if (   script_ext == nullptr
+            || (elang = find_extlang_by_ext(script_ext)) == nullptr
+            || !py_helpers_t::is_python(elang))
+        {
+            return false;
+        }
+
+        leak_sample_t leak_before;
+        if (opt_leak_watch)
+            leak_before = take_leak_sample();
+
+        uint64 start = get_nsec_stamp();
+        trace_span_t exec_span("hotpatch", "execute", script_file, elang->name);
+        bool old_state = activate_monitor(false);
+        m_mutations.start();
+        bool capturing = opt_capture_output && start_capture(elang, script_file);
+
+        qstring errbuf, expr, ns;
+        idc_value_t rv;
+        if (get_script_namespace(script_info, elang, ns))
+            expr.sprnt("hotpatch(%s, '%s')", make_py_str_literal(script_file).c_str(), ns.c_str());
+        else
+            expr.sprnt("hotpatch(%s)", make_py_str_literal(script_file).c_str());
+        bool evaluated =  py_helpers.install(elang, "hotpatch", PY_HELPER_HOTPATCH, &errbuf)
+                       && py_helpers.eval(elang, expr.c_str(), &rv, &errbuf);
+        if (capturing)
+            stop_capture(elang);
+        activate_monitor(old_state);
+
+        // The full execution that follows records the run
+        if (!evaluated)
+        {
+            msg("QScripts failed to hot-patch '%s':\n%s", script_file, errbuf.c_str());
+            exec_span.discard();
+            return false;
+        }
+        if (rv.vtype != VT_LONG || rv.num < 0)
+        {
+            exec_span.discard();
+            return false;
+        }
+
+        exec_phases_t phases;
+        phases.ns[PHASE_COMPILE] = get_nsec_stamp() - start;
+        record_last_run(script_file, true, start, errbuf);
+        exec_span.arg("ok", true).arg("idb_changes", m_last_run.mutations.total()).end();
+        record_run_stats(script_file, true, phases);
+        if (opt_show_filename)
+        {
+            msg("QScripts hot-patched %d definition(s) of %s in %.2f ms\n",
+                int(rv.num),
+                script_file,
+                m_last_run.duration_ms);
+        }
+        report_mutations(script_file);
+        if (opt_leak_watch)
+            m_leak_watch.add_run(script_file, leak_before, take_leak_sample());
+        return true;
+    }
+
+    // Returns the name of the private namespace a script runs in when namespace isolation is enabled.
+    // The name is keyed on the script's full path. The cells of a notebook run in the namespace of
+    // the notebook's main script, and 'is_cell' tells whether the script is such a cell.
+    bool get_script_namespace(
+        const script_info_t *script_info,
+        extlang_object_t &elang,
+        qstring &ns,
+        bool *is_cell = nullptr)
+    {
+#if IDA_SDK_VERSION >= 900
+        if (!opt_isolate_ns || !py_helpers_t::is_python(elang))
+            return false;
+
+        const char *owner = script_info->file_path.c_str();
+        auto active = dynamic_cast<const active_script_info_t *>(script_info);
+        if (active != nullptr && active->is_notebook() && !active->notebook.main_file.empty())
+            owner = active->notebook.main_file.c_str();
+        if (is_cell != nullptr)
+            *is_cell = !streq(owner, script_info->file_path.c_str());
+
+        char *basename, *ext;
+        qstring wrk_str;
+        get_basename_and_ext(owner, &basename, &ext, wrk_str);
+
+        // 32-bit FNV-1a of the full path
+        uint32 h = 0x811c9dc5;
+        for (const char *p = owner; *p != '\0'; ++p)
+        {
+            h ^= uchar(*p);
+            h *= 0x01000193;
+        }
+
+        ns = "__qscripts_";
+        for (const char *p = basename; *p != '\0'; ++p)
+            ns.append(qisalnum(uchar(*p)) ? *p : '_');
+        ns.cat_sprnt("_%08x__", h);
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // Calls the unload function and releases the previous namespace of an isolated script
+    void teardown_script_namespace(
+        extlang_object_t &elang,
+        const char *ns,
+        qstring &errbuf)
+    {
+        if (!py_helpers.install(elang, "namespace", PY_HELPER_NAMESPACE, &errbuf))
+        {
+            msg("QScripts failed to install the namespace helpers:\n%s", errbuf.c_str());
+            return;
+        }
+
+        qstring expr;
+        if (opt_exec_unload_func)
+        {
+            expr.sprnt("ns_call_unload('%s', '%s')", ns, UNLOAD_SCRIPT_FUNC_NAME);
+            py_helpers.eval(elang, expr.c_str(), nullptr, &errbuf);
+        }
+
+        uint64 rss_before = get_process_rss();
+        idc_value_t rv;
+        expr.sprnt("ns_teardown('%s')", ns);
+        if (!py_helpers.eval(elang, expr.c_str(), &rv, &errbuf))
+        {
+            msg("QScripts failed to release namespace '%s':\n%s", ns, errbuf.c_str());
+            return;
+        }
+
+        int collected, released_blocks;
+        if (rv.vtype != VT_STR || qsscanf(rv.c_str(), "%d %d", &collected, &released_blocks) != 2)
+            return;
+
+        int64 rss_released = int64(rss_before) - int64(get_process_rss());
+        msg("QScripts released namespace '%s': %d object(s) collected, %d block(s) freed, RSS %s %s\n",
+            ns,
+            collected,
+            released_blocks,
+            rss_released >= 0 ? "released" : "grew",
+            format_bytes(rss_released >= 0 ? rss_released : -rss_released).c_str());
+    }
+
+    // Takes the baseline database snapshot of the active script
+    bool take_baseline_snapshot()
+    {
+        g_snapshot.clear();
+
+        uint64 start = get_nsec_stamp();
+        snapshot_t ss;
+        qsnprintf(ss.desc, sizeof(ss.desc), "QScripts baseline: %s", qbasename(selected_script.file_path.c_str()));
+
+        qstring err;
+        if (!take_database_snapshot(&ss, &err))
+        {
+            msg("QScripts failed to take a baseline snapshot: %s\n", err.c_str());
+            return false;
+        }
+
+        g_snapshot.baseline = ss;
+        g_snapshot.script_file = selected_script.file_path;
+        g_snapshot.has_baseline = true;
+        msg("QScripts took a baseline snapshot in %.2f ms: %s\n",
+            (get_nsec_stamp() - start) / 1000000.0,
+            ss.filename);
+        return true;
+    }
+
+    // Restores the baseline snapshot and executes the script once the restore completes
+    bool restore_baseline_and_execute(const script_info_t *script_info)
+    {
+        g_snapshot.run_file = script_info->file_path;
+        g_snapshot.restore_pending = true;
+        g_snapshot.restore_start = get_nsec_stamp();
+        if (restore_database_snapshot(&g_snapshot.baseline, s_snapshot_restored_cb, nullptr))
+            return true;
+
+        g_snapshot.restore_pending = false;
+        msg("QScripts failed to restore the baseline snapshot '%s'\n", g_snapshot.baseline.filename);
+        return false;
+    }
+
+    static void idaapi s_snapshot_restored_cb(const char *errmsg, void *)
+    {
+        // The database may have been reloaded: use the current plugin instance
+        if (s_instance != nullptr)
+            s_instance->on_snapshot_restored(errmsg);
+        else
+            g_snapshot.restore_pending = false;
+    }
+
+    void on_snapshot_restored(const char *errmsg)
+    {
+        g_snapshot.restore_pending = false;
+        if (errmsg != nullptr && errmsg[0] != '\0')
+        {
+            msg("QScripts failed to restore the baseline snapshot: %s\n", errmsg);
+            return;
+        }
+
+        msg("QScripts restored the baseline snapshot in %.2f ms\n",
+            (get_nsec_stamp() - g_snapshot.restore_start) / 1000000.0);
+
+        // A fresh plugin instance has to re-activate the script first
+        if (!is_monitor_active() || selected_script.file_path != g_snapshot.script_file)
+        {
+            script_info_t script(g_snapshot.script_file.c_str());
+            set_selected_script(script);
+            build_scripts_list();
+            activate_monitor();
+        }
+
+        if (g_snapshot.run_file == selected_script.file_path)
+        {
+            execute_script(&selected_script, opt_with_undo);
+        }
+        else
+        {
+            // Notebook cell
+            active_script_info_t cell_script(selected_script);
+            cell_script.file_path = g_snapshot.run_file;
+            execute_script(&cell_script, opt_with_undo);
+        }
+    }
+
+    // Should the script be executed in streaming mode?
+    bool is_stream_candidate(const script_info_t *script_info)
+    {
+        if (script_info->b_stream)
+            return true;
+
+        qstatbuf st;
+        return     opt_stream_threshold > 0
+                && qstat(script_info->file_path.c_str(), &st) == 0
+                && st.qst_size >= uint64(opt_stream_threshold) * 1024;
+    }
+
+    // Loads, runs and unloads the active script's native module
+    bool execute_native_module(script_info_t *script_info)
+    {
+        bool old_state = activate_monitor(false);
+
+        // The script itself is not executed, just remember its time-stamp
+        get_file_modification_time(script_info->file_path, &script_info->modified_time);
+
+        auto module_path = selected_script.native_module.c_str();
+        trace_span_t exec_span("execute_native_module", "execute", module_path, "native");
+        if (opt_clear_log)
+            msg_clear();
+
+        if (opt_show_filename)
+            msg("QScripts executing %s...\n", module_path);
+
+        // A newer build supersedes the running task
+        m_task.cancel();
+
+        uint64 start = get_nsec_stamp();
+        qstring errbuf;
+        bool exec_ok = false, is_task = false;
+        m_mutations.start();
+        auto module = std::make_unique<native_module_t>();
+        if (module->load(module_path, &errbuf))
+        {
+            // Cooperative tasks run in time slices, other modules run to completion
+            if (auto start_fn = module->find_task_entry())
+            {
+                is_task = true;
+                exec_ok = m_task.start(
+                    std::move(module),
+                    start_fn,
+                    0,
+                    qbasename(module_path),
+                    [this]() { refresh_chooser(QSCRIPTS_TITLE); },
+                    [this, file = qstring(module_path), start](bool ok, bool cancelled)
+                    {
+                        on_native_task_done(file.c_str(), ok, cancelled, start);
+                    },
+                    &errbuf);
+            }
+            else
+            {
+                exec_ok = module->run(0, &errbuf);
+            }
+        }
+        if (!errbuf.empty())
+            msg("QScripts failed to run the native module '%s': %s\n", module_path, errbuf.c_str());
+        else if (opt_show_filename && is_task)
+            msg("QScripts started the task of %s\n", module_path);
+        else if (opt_show_filename)
+            msg("QScripts executed %s in %.2f ms\n", module_path, (get_nsec_stamp() - start) / 1000000.0);
+
+        activate_monitor(old_state);
+
+        // A running task is recorded once it is over: its time slices are the actual work
+        if (is_task && exec_ok)
+            return true;
+
+        record_last_run(module_path, exec_ok, start, errbuf);
+        exec_phases_t phases;
+        phases.ns[PHASE_MAIN] = get_nsec_stamp() - start;
+        record_run_stats(module_path, exec_ok, phases);
+        report_mutations(module_path);
+        return exec_ok;
+    }
+
+    // Records the run of a native module's task once it is over. The database
+    // changes are counted from the start of the module to the last time slice.
+    void on_native_task_done(const char *module_path, bool ok, bool cancelled, uint64 start)
+    {
+        qstring errbuf = cancelled ? "the task was cancelled" : ok ? "" : "the task failed";
+        record_last_run(module_path, ok, start, errbuf);
+
+        // A cancelled task was superseded: its partial run does not count
+        if (cancelled)
+            return;
+        exec_phases_t phases;
+        phases.ns[PHASE_MAIN] = get_nsec_stamp() - start;
+        record_run_stats(module_path, ok, phases);
+        report_mutations(module_path);
+    }
+
+    // Profiles the Python code that runs until stop_profiling() (see the /profile directive)
+    bool start_profiling(extlang_object_t &elang)
+    {
+        qstring errbuf;
+        if (   py_helpers.install(elang, "profile", PY_HELPER_PROFILE, &errbuf)
+            && py_helpers.eval(elang, "profile_start()", nullptr, &errbuf))
+        {
+            return true;
+        }
+        msg("QScripts failed to start the profiler:\n%s", errbuf.c_str());
+        return false;
+    }
+
+    // Saves the profile to '.qscripts/<script>.<ext>' next to the script and prints the top functions
+    void stop_profiling(extlang_object_t &elang, const char *script_file, const char *ext, int top)
+    {
+        char dir[QMAXPATH];
+        qdirname(dir, sizeof(dir), script_file);
+        qstring prof_file;
+        prof_file.sprnt("%s" SDIRCHAR QSCRIPTS_LOCAL SDIRCHAR "%s.%s", dir, qbasename(script_file), ext);
+
+        qstring expr, errbuf;
+        expr.sprnt("profile_stop(%s, %d)", make_py_str_literal(prof_file.c_str()).c_str(), top);
+        idc_value_t rv;
+        if (!py_helpers.eval(elang, expr.c_str(), &rv, &errbuf))
+            msg("QScripts failed to save the profile of '%s':\n%s", script_file, errbuf.c_str());
+        else if (rv.vtype == VT_STR && !rv.qstr().empty())
+            msg("QScripts profile of %s (saved to %s):\n%s", script_file, prof_file.c_str(), rv.qstr().c_str());
+    }
+
+    // Redirects the Python output to the run's log until stop_capture() (see the options)
+    bool start_capture(extlang_object_t &elang, const char *script_file)
+    {
+        qstring expr, errbuf;
+        expr.sprnt("capture_start(%" FMT_64 "u)", uint64(size_t(&capture_sink)));
+        if (!g_capture.start(script_file, &errbuf))
+        {
+            msg("QScripts cannot capture the output of '%s': %s\n", script_file, errbuf.c_str());
+            return false;
+        }
+        if (   py_helpers.install(elang, "capture", PY_HELPER_CAPTURE, &errbuf)
+            && py_helpers.eval(elang, expr.c_str(), nullptr, &errbuf))
+        {
+            return true;
+        }
+        g_capture.stop();
+        msg("QScripts failed to capture the output:\n%s", errbuf.c_str());
+        return false;
+    }
+
+    void stop_capture(extlang_object_t &elang)
+    {
+        qstring errbuf;
+        if (!py_helpers.eval(elang, "capture_stop()", nullptr, &errbuf))
+            msg("QScripts failed to restore the Python output streams:\n%s", errbuf.c_str());
+        g_capture.stop();
+    }
+
+    // Executes a script file
+    bool execute_script_sync(script_info_t *script_info)
+    {
+        auto active_script = dynamic_cast<active_script_info_t *>(script_info);
+        if (active_script != nullptr && active_script->is_native())
+            return execute_native_module(script_info);
+
+        // Sampling is not part of the execution time
+        leak_sample_t leak_before;
+        if (opt_leak_watch)
+            leak_before = take_leak_sample();
+
+        bool exec_ok = false;
+        uint64 start = get_nsec_stamp();
+        qstring errbuf;
+
+        // The reload directives of the changed dependencies ran just before
+        exec_phases_t phases;
+        phases.ns[PHASE_RELOAD] = m_pending_reload_ns;
+        m_pending_reload_ns = 0;
+
+        trace_span_t exec_span("execute_script_sync", "execute", script_info->file_path.c_str());
+
+        // Pause the file monitor timer while executing a script
+        bool old_state = activate_monitor(false);
+        m_mutations.start();
+        do
+        {
+            auto script_file = script_info->file_path.c_str();
+
+            // First things first: always take the file's modification time-stamp first so not to visit it again in the file monitor timer
+            if (!get_file_modification_time(script_file, &script_info->modified_time))
+            {
+                errbuf.sprnt("Script file '%s' not found!\n", script_file);
+                msg("%s", errbuf.c_str());
+                break;
+            }
+
+            const char *script_ext = get_file_ext(script_file);
+            extlang_object_t elang(nullptr);
+            if (script_ext == nullptr || (elang = find_extlang_by_ext(script_ext)) == nullptr)
+            {
+                errbuf.sprnt("Unknown script language detected for '%s'!\n", script_file);
+                msg("%s", errbuf.c_str());
+                break;
+            }
+            exec_span.arg("extlang", elang->name);
+
+            if (opt_clear_log)
+            {
+                trace_span_t span("msg_clear", "execute");
+                msg_clear();
+            }
+
+            // Silently call the unload script function
+            uint64 phase_start = get_nsec_stamp();
+            trace_span_t unload_span("unload", "execute", script_file, elang->name);
+            qstring ns;
+            bool is_cell = false;
+            bool isolated = get_script_namespace(script_info, elang, ns, &is_cell);
+            if (isolated)
+            {
+                // The cells of a notebook build on the state of its namespace
+                if (!is_cell)
+                    teardown_script_namespace(elang, ns.c_str(), errbuf);
+                errbuf.qclear();
+            }
+            else if (opt_exec_unload_func)
+            {
+                idc_value_t result;
+                elang->call_func(&result, UNLOAD_SCRIPT_FUNC_NAME, &result, 0, &errbuf);
+            }
+            phase_start = phases.add(PHASE_UNLOAD, phase_start);
+            unload_span.end();
+
+            if (opt_show_filename)
+                msg("QScripts executing %s...\n", script_file);
+
+            // Python scripts (and notebook cells) may run under the profiler
+            int profile_top = active_script != nullptr ? active_script->profile_top : 0;
+            bool profiling = profile_top > 0 && py_helpers_t::is_python(elang) && start_profiling(elang);
+            bool capturing = opt_capture_output && py_helpers_t::is_python(elang) && start_capture(elang, script_file);
+
+            // Huge scripts are executed chunk by chunk
+            if (is_stream_candidate(script_info))
+            {
+                trace_span_t span("stream", "execute", script_file, elang->name);
+                script_streamer_t streamer;
+                auto res = streamer.execute(elang, script_file, errbuf, isolated ? ns.c_str() : nullptr);
+                span.end();
+                phase_start = phases.add(PHASE_COMPILE, phase_start);
+                if (res != script_streamer_t::res_unsupported)
+                {
+                    if (profiling)
+                        stop_profiling(elang, script_file, "prof", profile_top);
+                    if (capturing)
+                        stop_capture(elang);
+                    exec_ok = res == script_streamer_t::res_ok;
+                    if (!exec_ok)
+                        msg("%s", errbuf.c_str());
+                    break;
+                }
+                // ...fall back to the regular execution
+                msg("%sExecuting it as a whole instead.\n", errbuf.c_str());
+                errbuf.qclear();
+            }
+
+            trace_span_t compile_span("compile", "execute", script_file, elang->name);
+            exec_ok = elang->compile_file(
+                script_file, 
+#if IDA_SDK_VERSION >= 900
+                isolated ? ns.c_str() : nullptr,  // requested_namespace
+#endif
+                &errbuf);
+            phase_start = phases.add(PHASE_COMPILE, phase_start);
+            compile_span.end();
+            if (profiling)
+                stop_profiling(elang, script_file, "prof", profile_top);
+            if (capturing)
+                stop_capture(elang);
+            if (!exec_ok)
+            {
+                msg("QScripts failed to compile script file: '%s':\n%s", script_file, errbuf.c_str());
+                break;
+            }
+
+            // Special case for IDC scripts: we have to call 'main'
+            if (elang->is_idc())
+            {
+                trace_span_t span("main", "execute", script_file, elang->name);
+                idc_value_t result;
+                exec_ok = elang->call_func(&result, "main", &result, 0, &errbuf);
+                phases.add(PHASE_MAIN, phase_start);
+                span.end();
+                if (!exec_ok)
+                {
+                    msg("QScripts failed to run the IDC main() of file '%s':\n%s", script_file, errbuf.c_str());
+                    break;
+                }
+            }
+            // Remember the definitions of hot-patchable scripts
+            else if (script_info->b_hotpatch && py_helpers_t::is_python(elang))
+            {
+                trace_span_t span("hotpatch_commit", "execute", script_file, elang->name);
+                qstring expr;
+                expr.sprnt("hotpatch_commit(%s)", make_py_str_literal(script_file).c_str());
+                if (   !py_helpers.install(elang, "hotpatch", PY_HELPER_HOTPATCH, &errbuf)
+                    || !py_helpers.eval(elang, expr.c_str(), nullptr, &errbuf))
+                {
+                    msg("QScripts failed to record the definitions of '%s' for hot-patching:\n%s", script_file, errbuf.c_str());
+                }
+            }
+        } while (false);
+        activate_monitor(old_state);
+        record_last_run(script_info->file_path.c_str(), exec_ok, start, errbuf);
+        exec_span.arg("ok", exec_ok).arg("idb_changes", m_last_run.mutations.total()).end();
+
+        record_run_stats(script_info->file_path.c_str(), exec_ok, phases);
+        if (opt_show_filename && exec_ok)
+        {
+            msg("QScripts executed %s in %.2f ms (reload: %.2f, unload: %.2f, compile: %.2f, main: %.2f)\n",
+                script_info->file_path.c_str(),
+                m_last_run.duration_ms,
+                phases.ms(PHASE_RELOAD),
+                phases.ms(PHASE_UNLOAD),
+                phases.ms(PHASE_COMPILE),
+                phases.ms(PHASE_MAIN));
+        }
+        report_mutations(script_info->file_path.c_str());
+        if (opt_leak_watch)
+            m_leak_watch.add_run(script_info->file_path.c_str(), leak_before, take_leak_sample());
+        return exec_ok;
+    }
+
+    // Samples the memory and the Python runtime for the leak watch
+    leak_sample_t take_leak_sample()
+    {
+        extlang_object_t py(find_extlang_by_ext("py"));
+        return leak_watch_t::take_sample(py != nullptr ? &py : nullptr, py_helpers);
+    }
+
+    // Adds the last execution to the statistics and the run history
+    void record_run_stats(const char *file, bool ok, const exec_phases_t &phases)
+    {
+        m_stats.record(file, ok, m_last_run.duration_ms, phases);
+        if (opt_run_history)
+        {
+            const char *idb = get_path(PATH_TYPE_IDB);
+            m_history.add_run(
+                file,
+                idb == nullptr || idb[0] == '\0' ? "-" : idb,
+                ok,
+                m_last_run.duration_ms,
+                phases);
+        }
+    }
+
+    // Remembers the outcome of an execution (and its database changes) for the editors' status requests
+    void record_last_run(const char *file, bool ok, uint64 start, const qstring &errbuf)
+    {
+        m_last_run.file        = file;
+        m_last_run.ok          = ok;
+        m_last_run.duration_ms = (get_nsec_stamp() - start) / 1000000.0;
+        m_last_run.when        = qtime64();
+        m_last_run.mutations   = m_mutations.stop();
+        m_last_run.error       = ok ? qstring() : errbuf;
+        while (!m_last_run.error.empty() && m_last_run.error.last() == '\n')
+            m_last_run.error.remove_last();
+    }
+
+    // Completes the run summary with the database changes of the last execution
+    void report_mutations(const char *file)
+    {
+        if (opt_show_filename && m_last_run.mutations.total() != 0)
+        {
+            msg("QScripts database changes by %s: %s\n",
+                file,
+                m_last_run.mutations.summary(m_last_run.duration_ms).c_str());
+        }
+    }
+
+    // Executes an editor's unsaved buffer (or a selection of it) as if it was the given file.
+    // The text goes straight to the extlang: nothing is written to disk.
+    bool execute_buffer(
+        const char *file,
+        const char *text,
+        int first_line,
+        bool whole,
+        qstring &errbuf)
+    {
+        const char *ext = get_file_ext(file);
+        extlang_object_t elang(nullptr);
+        if (ext == nullptr || (elang = find_extlang_by_ext(ext)) == nullptr)
+        {
+            errbuf.sprnt("Unknown script language detected for '%s'!", file);
+            return false;
+        }
+
+        bool old_state = activate_monitor(false);
+        uint64 start = get_nsec_stamp();
+        if (whole && opt_clear_log)
+            msg_clear();
+        m_mutations.start();
+
+        if (opt_show_filename)
+            msg("QScripts executing the editor's %s of %s...\n", whole ? "buffer" : "selection", file);
+
+        bool exec_ok;
+        if (py_helpers_t::is_python(elang))
+        {
+            // A whole buffer replaces the previous run of the script
+            script_info_t script(file);
+            qstring ns;
+            bool isolated = get_script_namespace(&script, elang, ns);
+            if (whole && isolated)
+            {
+                teardown_script_namespace(elang, ns.c_str(), errbuf);
+                errbuf.qclear();
+            }
+            else if (whole && opt_exec_unload_func)
+            {
+                idc_value_t result;
+                elang->call_func(&result, UNLOAD_SCRIPT_FUNC_NAME, &result, 0, &errbuf);
+                errbuf.qclear();
+            }
+
+            qstring expr;
+            expr.sprnt("exec_buffer(%s, %s, %d, %s)",
+                make_py_str_literal(file).c_str(),
+                make_py_str_literal(text).c_str(),
+                first_line,
+                isolated ? make_py_str_literal(ns.c_str()).c_str() : "None");
+
+            idc_value_t rv;
+            exec_ok =  py_helpers.install(elang, "buffer", PY_HELPER_BUFFER, &errbuf)
+                    && py_helpers.eval(elang, expr.c_str(), &rv, &errbuf);
+            if (exec_ok && rv.vtype == VT_STR && !rv.qstr().empty())
+            {
+                errbuf = rv.qstr();
+                exec_ok = false;
+            }
+        }
+        else if (elang->is_idc() && whole)
+        {
+            // Keep the buffer's line numbers in the error messages
+            qstring src;
+            for (int i = 1; i < first_line; ++i)
+                src.append('\n');
+            src.append(text);
+
+            idc_value_t result;
+            exec_ok =  compile_idc_text(src.c_str(), &errbuf)
+                    && elang->call_func(&result, "main", &result, 0, &errbuf);
+        }
+        else
+        {
+            exec_ok = elang->eval_snippet(text, &errbuf);
+        }
+
+        if (!exec_ok)
+            msg("QScripts failed to execute the editor's %s of '%s':\n%s\n", whole ? "buffer" : "selection", file, errbuf.c_str());
+        else if (opt_show_filename)
+            msg("QScripts executed the editor's %s of %s in %.2f ms\n", whole ? "buffer" : "selection", file, (get_nsec_stamp() - start) / 1000000.0);
 
-        return false;
+        record_last_run(file, exec_ok, start, errbuf);
+        report_mutations(file);
+        activate_monitor(old_state);
+        return exec_ok;
     }
 
-    bool execute_script(script_info_t *script_info, bool with_undo)
+    // Starts, restarts or stops the editor RPC endpoint to match the options
+    void update_rpc_server()
     {
-        if (with_undo)
+        qstring endpoint = opt_rpc_endpoint;
+        endpoint.replace("$pid$", qstring().sprnt("%d", qgetpid()).c_str());
+        if (endpoint.empty())
         {
-            action_active_script = script_info;
-            auto r = process_ui_action(ACTION_EXECUTE_SCRIPT_WITH_UNDO_ID);
-            action_active_script = nullptr;
-            return r;
+            m_rpc.stop();
+            return;
         }
-        return execute_script_sync(script_info);
+        if (m_rpc.is_active() && m_rpc.get_endpoint() == endpoint)
+            return;
+
+        qstring err;
+        auto handler = [this](const char *method, const json_t &params, json_t &result, int &errcode, qstring &errmsg)
+        {
+            return handle_rpc(method, params, result, errcode, errmsg);
+        };
+        if (m_rpc.start(endpoint.c_str(), handler, &err))
+            msg("QScripts is listening for editor requests on %s\n", endpoint.c_str());
+        else
+            msg("QScripts failed to start the editor RPC endpoint: %s\n", err.c_str());
     }
 
-    // Executes a script file
-    bool execute_script_sync(script_info_t *script_info)
+    // Starts, restarts or stops the tracer to match the options
+    void update_trace()
     {
-        bool exec_ok = false;
-
-        // Pause the file monitor timer while executing a script
-        bool old_state = activate_monitor(false);
-        do
+        qstring path = opt_trace_file;
+        path.replace("$pid$", qstring().sprnt("%d", qgetpid()).c_str());
+        if (path.empty())
         {
-            auto script_file = script_info->file_path.c_str();
+            if (g_trace.is_enabled())
+                msg("QScripts stopped tracing to %s\n", g_trace.get_path().c_str());
+            g_trace.stop();
+            return;
+        }
+        if (g_trace.is_enabled() && g_trace.get_path() == path)
+            return;
 
-            // First things first: always take the file's modification time-stamp first so not to visit it again in the file monitor timer
-            if (!get_file_modification_time(script_file, &script_info->modified_time))
-            {
-                msg("Script file '%s' not found!\n", script_file);
-                break;
-            }
+        qstring err;
+        if (g_trace.start(path.c_str(), &err))
+            msg("QScripts is tracing to %s\n", path.c_str());
+        else
+            msg("QScripts failed to start tracing: %s\n", err.c_str());
+    }
 
-            const char *script_ext = get_file_ext(script_file);
-            extlang_object_t elang(nullptr);
-            if (script_ext == nullptr || (elang = find_extlang_by_ext(script_ext)) == nullptr)
-            {
-                msg("Unknown script language detected for '%s'!\n", script_file);
-                break;
-            }
+    // Starts, restarts or stops the session journal to match the options
+    void update_journal()
+    {
+        qstring path = opt_journal_file;
+        path.replace("$pid$", qstring().sprnt("%d", qgetpid()).c_str());
+        if (path.empty())
+        {
+            if (m_journal.is_enabled())
+                msg("QScripts stopped recording the session journal %s\n", m_journal.get_path().c_str());
+            m_journal.stop();
+            return;
+        }
+        if (m_journal.is_enabled() && m_journal.get_path() == path)
+            return;
 
-            if (opt_clear_log)
-                msg_clear();
+        qstring err;
+        if (!m_journal.start(path.c_str(), &err))
+        {
+            msg("QScripts failed to start the session journal: %s\n", err.c_str());
+            return;
+        }
+        msg("QScripts is recording the session journal to %s\n", path.c_str());
 
-            // Silently call the unload script function
-            qstring errbuf;
-            if (opt_exec_unload_func)
-            {
-                idc_value_t result;
-                elang->call_func(&result, UNLOAD_SCRIPT_FUNC_NAME, &result, 0, &errbuf);
-            }
+        // Start from the scripts that are already active
+        if (has_selected_script())
+            m_journal.activated(selected_script, opt_change_interval);
+        for (auto &script : m_extra_scripts)
+            m_journal.activated(*script, opt_change_interval);
+    }
 
-            if (opt_show_filename)
-                msg("QScripts executing %s...\n", script_file);
+    // Describes an active script for the editors
+    json_t describe_active_script(const active_script_info_t &script, bool is_selected)
+    {
+        const char *mode = script.is_notebook()    ? "notebook"
+                         : script.has_build()      ? "build"
+                         : script.is_native()      ? "native"
+                         : script.trigger_based()  ? "triggerfile"
+                         : script.pipe_triggered() ? "triggerpipe"
+                         : script.b_worker         ? "worker"
+                         :                           "script";
+        json_t deps = json_t::array();
+        for (auto &kv : script.dep_scripts)
+            deps.push_back(kv.first.c_str());
+
+        json_t desc = json_t::object();
+        desc.set("file", script.file_path);
+        desc.set("mode", mode);
+        desc.set("monitored", is_monitor_active());
+        desc.set("selected", is_selected);
+        desc.set("dependencies", std::move(deps));
+        return desc;
+    }
 
-            exec_ok = elang->compile_file(
-                script_file, 
-#if IDA_SDK_VERSION >= 900
-                nullptr,  // requested_namespace
-#endif
-                &errbuf);
-            if (!exec_ok)
+    // Handles an editor request (on the main thread)
+    bool handle_rpc(
+        const char *method,
+        const json_t &params,
+        json_t &result,
+        int &errcode,
+        qstring &errmsg)
+    {
+        bool whole = streq(method, "execute");
+        if (whole || streq(method, "execute_selection"))
+        {
+            const char *file = params.get_str("file");
+            const char *text = params.get_str("text");
+            if (file == nullptr || text == nullptr || !qisabspath(file))
             {
-                msg("QScripts failed to compile script file: '%s':\n%s", script_file, errbuf.c_str());
-                break;
+                errcode = RPC_ERR_INVALID_PARAMS;
+                errmsg  = "'file' (an absolute path) and 'text' are required";
+                return false;
             }
 
-            // Special case for IDC scripts: we have to call 'main'
-            if (elang->is_idc())
+            // A script error is a regular outcome, not an RPC error
+            qstring err;
+            bool ok = execute_buffer(file, text, int(qmax(1.0, qmin(params.get_num("line", 1), 1e7))), whole, err);
+            result = json_t::object();
+            result.set("ok", ok);
+            result.set("duration_ms", m_last_run.duration_ms);
+            if (!ok)
+                result.set("error", m_last_run.error);
+            return true;
+        }
+        else if (streq(method, "status"))
+        {
+            result = json_t::object();
+            result.set("monitor_active", is_monitor_active());
+            result.set("active_script", has_selected_script() ? json_t(selected_script.file_path) : json_t());
+            const char *idb = get_path(PATH_TYPE_IDB);
+            result.set("database", idb != nullptr ? json_t(idb) : json_t());
+
+            json_t busy = json_t::object();
+            busy.set("workers", int(m_workers.running_count() + m_workers.queued_count()));
+            busy.set("building", m_build.is_busy());
+            busy.set("task", m_task.is_running());
+            busy.set("corpus", m_corpus.is_busy());
+            result.set("busy", std::move(busy));
+
+            json_t last_run;
+            if (!m_last_run.file.empty())
             {
-                idc_value_t result;
-                exec_ok = elang->call_func(&result, "main", &result, 0, &errbuf);
-                if (!exec_ok)
-                {
-                    msg("QScripts failed to run the IDC main() of file '%s':\n%s", script_file, errbuf.c_str());
-                    break;
-                }
+                last_run = json_t::object();
+                last_run.set("file", m_last_run.file);
+                last_run.set("ok", m_last_run.ok);
+                last_run.set("duration_ms", m_last_run.duration_ms);
+                last_run.set("time", int64(get_secs(m_last_run.when)));
+
+                json_t mutations = json_t::object();
+                for (int kind = 0; kind < IDBMUT_COUNT; ++kind)
+                    mutations.set(idb_mutations_t::name(kind), m_last_run.mutations.counts[kind]);
+                last_run.set("idb_changes", std::move(mutations));
+                if (!m_last_run.ok)
+                    last_run.set("error", m_last_run.error);
             }
-        } while (false);
-        activate_monitor(old_state);
+            result.set("last_run", std::move(last_run));
+            return true;
+        }
+        else if (streq(method, "list_scripts"))
+        {
+            result = json_t::array();
+            if (has_selected_script())
+                result.push_back(describe_active_script(selected_script, true));
+            for (auto &script : m_extra_scripts)
+                result.push_back(describe_active_script(*script, false));
+            return true;
+        }
 
-        return exec_ok;
+        errcode = RPC_ERR_METHOD_NOT_FOUND;
+        errmsg.sprnt("unknown method '%s'", method);
+        return false;
     }
 
     enum 
@@ -493,6 +1867,15 @@ private:
         OPTID_UNLOADEXEC     = 0x0008,
         OPTID_SELSCRIPT      = 0x0010,
         OPTID_WITHUNDO       = 0x0020,
+        OPTID_STREAM         = 0x0040,
+        OPTID_ISOLATENS      = 0x0080,
+        OPTID_RPC            = 0x0100,
+        OPTID_WATCHD         = 0x0200,
+        OPTID_TRACE          = 0x0400,
+        OPTID_LEAKWATCH      = 0x0800,
+        OPTID_HISTORY        = 0x1000,
+        OPTID_JOURNAL        = 0x2000,
+        OPTID_CAPTURE        = 0x4000,
 
         OPTID_ONLY_SCRIPT    = OPTID_SELSCRIPT,
         OPTID_ALL_BUT_SCRIPT = 0xffff & ~OPTID_ONLY_SCRIPT,
@@ -516,7 +1899,16 @@ private:
             {OPTID_SHOWNAME,   "QScripts_showscriptname",       VT_LONG, &opt_show_filename},
             {OPTID_UNLOADEXEC, "QScripts_exec_unload_func",     VT_LONG, &opt_exec_unload_func},
             {OPTID_SELSCRIPT,  "QScripts_selected_script_name", QSTR, &selected_script.file_path},
-            {OPTID_WITHUNDO,   "QScripts_with_undo",            VT_LONG, &opt_with_undo}
+            {OPTID_WITHUNDO,   "QScripts_with_undo",            VT_LONG, &opt_with_undo},
+            {OPTID_STREAM,     "QScripts_stream_threshold",     VT_LONG, &opt_stream_threshold},
+            {OPTID_ISOLATENS,  "QScripts_isolate_namespace",    VT_LONG, &opt_isolate_ns},
+            {OPTID_RPC,        "QScripts_rpc_endpoint",         QSTR, &opt_rpc_endpoint},
+            {OPTID_WATCHD,     "QScripts_use_watch_daemon",     VT_LONG, &opt_use_watchd},
+            {OPTID_TRACE,      "QScripts_trace_file",           QSTR, &opt_trace_file},
+            {OPTID_LEAKWATCH,  "QScripts_leak_watch",           VT_LONG, &opt_leak_watch},
+            {OPTID_HISTORY,    "QScripts_run_history",          VT_LONG, &opt_run_history},
+            {OPTID_JOURNAL,    "QScripts_journal_file",         QSTR, &opt_journal_file},
+            {OPTID_CAPTURE,    "QScripts_capture_output",       VT_LONG, &opt_capture_output}
         };
 
         for (auto &opt: int_options)
@@ -571,165 +1963,184 @@ private:
             if (!is_monitor_active() || !has_selected_script())
                 break;
 
-            std::unique_ptr<active_script_info_t> notebook_cell_script;
-            active_script_info_t* work_script = &selected_script;
+            // Wait for the baseline snapshot to be restored
+            if (g_snapshot.restore_pending)
+                break;
 
-            //
-            // Handle dependencies first
-            // 
+            // The watcher daemon reports the changes: the time-stamps are only checked after that
+            bool force_scan = m_b_force_scan;
+            m_b_force_scan = false;
+            if (   m_watchd.is_connected()
+                && !selected_script.has_build()
+                && !selected_script.b_trigger_settling
+                && !force_scan
+                && !m_watchd.take_changes()
+                && !m_trigger_pipe.has_pending())
+            {
+                break;
+            }
 
-            // Check if the active script or its dependencies are changed:
-            // 1. Dependency file --> repopulate it and execute active script
-            // 2. Any dependencies --> reload if needed and //
-            // 3. Active script --> execute it again
-            auto& dep_scripts = selected_script.dep_scripts;
+            // A file shared by several active scripts is only visited once
+            file_stat_tick_t stat_tick;
+            trace_span_t tick_span("filemon_timer_cb", "monitor");
 
-            // Let's check the dependencies index files first
-            auto mod_stat = selected_script.is_any_dep_index_modified();
-            if (mod_stat == filemod_status_e::modified)
+            // The selected script first, then the additional ones in their activation order
+            int interval = monitor_active_script(selected_script, true);
+            for (size_t i = 0; i < m_extra_scripts.size() && is_monitor_active() && !g_snapshot.restore_pending; )
             {
-                // Force re-parsing of the index file
-                dep_scripts.clear();
-                set_selected_script(selected_script);
+                active_script_info_t *script = m_extra_scripts[i].get();
+                interval = qmin(interval, monitor_active_script(*script, false));
 
-                // Let's invalidate all the scripts time stamps so we ensure they are re-interpreted again
-                selected_script.invalidate_all_scripts();
+                // The script may have been deactivated
+                if (i < m_extra_scripts.size() && m_extra_scripts[i].get() == script)
+                    ++i;
+            }
+            return interval;
+        } while (false);
+        return opt_change_interval;
+    }
 
-                // Refresh the UI
-                refresh_chooser(QSCRIPTS_TITLE);
+    // The monitor tick of an active script (see script_monitor.hpp) with the plugin's actions
+    class plugin_monitor_t : public script_monitor_t
+    {
+        qscripts_chooser_t &self;
+        bool is_selected;
+        trace_span_t &monitor_span;
 
-                // Just leave and come back fast so we get a chance to re-evaluate everything
-                return 1; // (1 ms)
-            }
-            // Dependency index file is gone
-            else if (mod_stat == filemod_status_e::not_found && !dep_scripts.empty())
+    protected:
+        void on_change(active_script_info_t &, const char *file, int kind) override
+        {
+            self.m_journal.changed(file, kind);
+
+            // Other cells may have changed along with it: scan them again on the next tick
+            if (kind == JF_CELL)
+                self.m_b_force_scan = true;
+        }
+
+        bool on_reparse(active_script_info_t &script) override
+        {
+            trace_span_t span("dep_index_reparse", "monitor", script.file_path.c_str());
+            if (is_selected)
             {
-                // Let's just check the active script
-                dep_scripts.clear();
+                self.set_selected_script(script);
             }
-
-            //
-            // Check the dependency scripts
-            //
-            bool dep_script_changed = false;
-            bool brk = false;
-            for (auto& kv : dep_scripts)
+            else if (!self.load_extra_script(script, script.file_path.c_str()))
             {
-                auto& dep_script = kv.second;
-                if (dep_script.get_modification_status() == filemod_status_e::modified)
-                {
-                    qstring err;
-                    dep_script_changed = true;
-                    if (dep_script.has_reload_directive()
-                        && !execute_reload_directive(dep_script, err, false))
-                    {
-                        brk = true;
-                        break;
-                    }
-                }
+                self.remove_extra_script(script.file_path.c_str());
+                self.update_watches();
+                refresh_chooser(QSCRIPTS_TITLE);
+                return false;
             }
-            if (brk)
-                break;
 
-            //
-            // Notebook mode
-            //
-            if (selected_script.is_notebook())
-            {
-                auto& last_active_cell = selected_script.notebook.last_active_cell;
-                auto& cell_files = selected_script.notebook.cell_files;
-                auto current_path = std::filesystem::path(selected_script.file_path.c_str()).parent_path();
-                std::unordered_set<std::string> present_files;
-
-                std::string active_cell;
-                enumerate_files(
-                    current_path, 
-                    selected_script.notebook.cells_re, 
-                    [&present_files, &last_active_cell, &active_cell, &cell_files](const std::string& filename)
-                    {
-                        present_files.insert(filename);
-                        auto p = cell_files.find(filename);
+            // Refresh the UI
+            refresh_chooser(QSCRIPTS_TITLE);
+            return true;
+        }
 
-                        qtime64_t mtime;
-                        get_file_modification_time(filename.c_str(), &mtime);
+        bool on_reload(active_script_info_t &script, script_info_t &dep_script) override
+        {
+            qstring err;
+            trace_span_t span("reload_directive", "monitor", dep_script.file_path.c_str());
+            uint64 reload_start = get_nsec_stamp();
+            bool reloaded = self.execute_reload_directive(dep_script, err, false, script.profile_top);
+            self.m_pending_reload_ns += get_nsec_stamp() - reload_start;
+            span.arg("ok", reloaded).end();
+            self.m_journal.reloaded(dep_script.file_path.c_str(), reloaded);
+            return reloaded;
+        }
 
-                        // New file?
-                        if (p == cell_files.end())
-                        {
-                            cell_files[filename] = mtime;
-                        }
-                        // File was modified?
-                        else if (p->second != mtime)
-                        {
-                            last_active_cell = active_cell = filename;
-                            p->second = mtime;
-                            // Stop enumeration; next interval we pick up the rest
-                            return false;
-                        }
-                        return true;
-                    }
-                );
+        // Source changes start a build and only a successful build executes the script
+        void on_build(active_script_info_t &) override
+        {
+            if (self.scan_build_sources())
+                self.start_build();
+        }
 
-                // Remove missing files from cell_files
-                for (auto it = cell_files.begin(); it != cell_files.end();)
-                {
-                    if (present_files.find(it->first) == present_files.end())
-                        it = cell_files.erase(it);
-                    else
-                        ++it;
-                }
+        // The listener wakes us up right away
+        bool consume_trigger(active_script_info_t &script) override
+        {
+            qstring payload;
+            if (!self.m_trigger_pipe.consume(&payload))
+                return false;
 
-                // We have to always execute a script when a dependency changes:
-                // - If a dependency has changed, but no active cells changedthen attempt to use the last active cell.
-                if (dep_script_changed && active_cell.empty())
-                    active_cell = selected_script.notebook.last_active_cell;
+            if (!script.b_worker)
+                self.set_trigger_args(&script, payload);
+            return true;
+        }
 
-                // If no modified cell files, then do nothing
-                if (!active_cell.empty())
-                {
-                    // ...use the same metadata as the notebook main script, but just execute the given cell
-                    notebook_cell_script.reset(new active_script_info_t(selected_script));
-                    work_script = notebook_cell_script.get();
-                    work_script->file_path = active_cell.c_str();
-                }
+        void on_gone(active_script_info_t &script, const char *file) override
+        {
+            msg(
+                "QScripts detected that the active script '%s' no longer exists!\n",
+                file);
+            if (is_selected)
+            {
+                self.clear_selected_script();
             }
-            //
-            // Trigger mode
-            // 
-            // In trigger file mode, just wait for the trigger file to be created
-            else if (selected_script.trigger_based())
+            else
             {
-                // The monitor waits until the trigger file is created or modified
-                auto trigger_status = selected_script.trigger_file.get_modification_status(true);
-                if (trigger_status != filemod_status_e::modified)
-                    break;
-
-                // Delete the trigger file
-                if (!selected_script.b_keep_trigger_file)
-                    qunlink(selected_script.trigger_file.c_str());
+                self.remove_extra_script(script.file_path.c_str());
+                self.update_watches();
+            }
+        }
 
-                // Always execute the main script even if it was not changed
-                selected_script.invalidate();
-                // ...and proceed with QScript logic
+        void on_execute(
+            active_script_info_t &script,
+            active_script_info_t &work_script,
+            bool dep_changed,
+            bool modified) override
+        {
+            // How long the change waited for the monitor (the time-stamps are in seconds)
+            if (monitor_span.is_active() && modified)
+                monitor_span.arg("detect_delay_s", int64(qtime32()) - int64(work_script.modified_time));
+            monitor_span.arg("changed", work_script.file_path);
+            self.m_journal.executed(work_script.file_path.c_str());
+
+            // Only the script itself changed: try to hot-patch it first, unless each
+            // iteration starts from the baseline snapshot
+            if (   !dep_changed
+                && work_script.b_hotpatch
+                && !script.b_snapshot
+                && !script.trigger_based()
+                && !script.pipe_triggered()
+                && self.hotpatch_script(&work_script))
+            {
+                return;
             }
 
-            // Check the main script
-            mod_stat = work_script->get_modification_status();
-            if (mod_stat == filemod_status_e::not_found)
+            // Start each iteration from the same database state
+            if (script.b_snapshot && !script.b_worker && g_snapshot.has_baseline)
             {
-                // Script no longer exists
-                msg(
-                    "QScripts detected that the active script '%s' no longer exists!\n", 
-                    work_script->file_path.c_str());
-                clear_selected_script();
-                break;
+                self.restore_baseline_and_execute(&work_script);
+                return;
             }
+            self.execute_script(&work_script, self.opt_with_undo);
+        }
 
-            // Script or its dependencies changed?
-            if (dep_script_changed || mod_stat == filemod_status_e::modified)
-                execute_script(work_script, opt_with_undo);
-        } while (false);
-        return opt_change_interval;
+        void on_span(const char *name, const char *file, uint64 start_ns) override
+        {
+            if (!g_trace.is_enabled())
+                return;
+            json_t args = json_t::object();
+            args.set("file", file);
+            g_trace.complete(name, "monitor", start_ns, get_nsec_stamp(), std::move(args));
+        }
+
+    public:
+        plugin_monitor_t(qscripts_chooser_t &self, bool is_selected, trace_span_t &monitor_span)
+            : script_monitor_t(&self.m_trigger_ready), self(self), is_selected(is_selected), monitor_span(monitor_span)
+        {
+        }
+    };
+
+    // Checks an active script and its dependencies and executes it if needed.
+    // Returns the delay until the next check.
+    int monitor_active_script(active_script_info_t &script, bool is_selected)
+    {
+        trace_span_t monitor_span("monitor_active_script", "monitor", script.file_path.c_str());
+        m_pending_reload_ns = 0;
+        plugin_monitor_t monitor(*this, is_selected, monitor_span);
+        return monitor.tick(script, opt_change_interval);
     }
 
 protected:
@@ -737,13 +2148,38 @@ protected:
         CH_KEEP    | CH_RESTORE  | CH_ATTRS   | CH_NOIDB |
         CH_CAN_DEL | CH_CAN_EDIT | CH_CAN_INS | CH_CAN_REFRESH;
 
-    static constexpr int widths_[2]               = { 20, 70 };
-    static constexpr const char *const header_[2] = { "Script", "Path" };
+    // The statistics columns are numeric so that IDA sorts them by value
+    enum { COL_SCRIPT, COL_LAST, COL_P50, COL_P95, COL_RUNS, COL_FAILURES, COL_PATH, COL_COUNT };
+    static constexpr int widths_[COL_COUNT] =
+    {
+        20,
+        9 | CHCOL_DEC,
+        9 | CHCOL_DEC,
+        9 | CHCOL_DEC,
+        6 | CHCOL_DEC,
+        8 | CHCOL_DEC,
+        70 | CHCOL_PATH
+    };
+    static constexpr const char *const header_[COL_COUNT] =
+    {
+        "Script",
+        "Last (ms)",
+        "p50 (ms)",
+        "p95 (ms)",
+        "Runs",
+        "Failures",
+        "Path"
+    };
 
     static constexpr const char *ACTION_DEACTIVATE_MONITOR_ID        = "qscripts:deactivatemonitor";
     static constexpr const char *ACTION_EXECUTE_SELECTED_SCRIPT_ID   = "qscripts:execselscript";
     static constexpr const char *ACTION_EXECUTE_SCRIPT_WITH_UNDO_ID  = "qscripts:execscriptwithundo";
     static constexpr const char *ACTION_EXECUTE_NOTEBOOK_ID          = "qscripts:executenotebook";
+    static constexpr const char *ACTION_CANCEL_TASK_ID               = "qscripts:canceltask";
+    static constexpr const char *ACTION_EXECUTE_EVERYWHERE_ID        = "qscripts:executeeverywhere";
+    static constexpr const char *ACTION_TOGGLE_EXTRA_SCRIPT_ID       = "qscripts:toggleextrascript";
+    static constexpr const char *ACTION_RUN_CORPUS_ID                = "qscripts:runcorpus";
+    static constexpr const char *ACTION_EXPORT_STATS_ID              = "qscripts:exportstats";
 
     scripts_info_t m_scripts;
     ssize_t m_nselected = NO_SELECTION;
@@ -788,10 +2224,19 @@ protected:
             "Options\n"
             "\n"
             "<#Controls the refresh rate of the script change monitor#Script monitor ~i~nterval:D:100:10::>\n"
+            "<#Scripts larger than this size (in KB) are executed in chunks. Use 0 to disable#~S~tream scripts larger than (KB):D:100:10::>\n"
+            "<#Local socket (or named pipe) where editors send JSON-RPC requests. $pid$ expands to IDA's process id. Leave empty to disable#~E~ditor RPC endpoint:q:1024:40::>\n"
+            "<#Chrome trace-event file (Perfetto) of the monitor and the executions. $pid$ expands to IDA's process id. Leave empty to disable#~T~race file:q:1024:40::>\n"
+            "<#Binary journal of the changes the monitor detects and of its actions, for qscripts-replay. $pid$ expands to IDA's process id. Leave empty to disable#Session ~j~ournal:q:1024:40::>\n"
             "<#Clear the output window before re-running the script#C~l~ear the output window:C>\n"
             "<#Display the name of the file that is automatically executed#Show ~f~ile name when execution:C>\n"
             "<#Execute a function called '__quick_unload_script' before reloading the script#Execute the u~n~load script function:C>\n"
-            "<#The executed scripts' side effects can be reverted with IDA's Undo#Allow QScripts execution to be ~u~ndo-able:C>>\n"
+            "<#The executed scripts' side effects can be reverted with IDA's Undo#Allow QScripts execution to be ~u~ndo-able:C>\n"
+            "<#Run each Python script in its own namespace that is released before the next run#~R~un scripts in isolated namespaces:C>\n"
+            "<#One file watcher process serves all the IDA instances (Linux and macOS)#Use the shared ~w~atcher daemon:C>\n"
+            "<#Sample the memory, the Python objects and the registered hooks, actions and timers before and after each run and warn about sustained growth#Watch the memory ~g~rowth across runs:C>\n"
+            "<#Append each run to '.qscripts/<script>.runs.csv' and warn when a run is slower than the previous ones on the same database#~K~eep a run history:C>\n"
+            "<#Write the output of the Python scripts to '.qscripts/logs/<script>.<time>.log' and only show its tail in the output window#~C~apture the output to a log:C>>\n"
 
             "\n"
             "\n";
@@ -806,6 +2251,11 @@ protected:
                 ushort b_show_filename    : 1;
                 ushort b_exec_unload_func : 1;
                 ushort b_with_undo        : 1;
+                ushort b_isolate_ns       : 1;
+                ushort b_use_watchd       : 1;
+                ushort b_leak_watch       : 1;
+                ushort b_run_history      : 1;
+                ushort b_capture_output   : 1;
             };
         } chk_opts;
         // Load previous options first (account for multiple instances of IDA)
@@ -816,19 +2266,41 @@ protected:
         chk_opts.b_show_filename    = opt_show_filename;
         chk_opts.b_exec_unload_func = opt_exec_unload_func;
         chk_opts.b_with_undo        = opt_with_undo;
+        chk_opts.b_isolate_ns       = opt_isolate_ns;
+        chk_opts.b_use_watchd       = opt_use_watchd;
+        chk_opts.b_leak_watch       = opt_leak_watch;
+        chk_opts.b_run_history      = opt_run_history;
+        chk_opts.b_capture_output   = opt_capture_output;
         sval_t interval             = opt_change_interval;
+        sval_t stream_threshold     = opt_stream_threshold;
+        qstring rpc_endpoint        = opt_rpc_endpoint;
+        qstring trace_file          = opt_trace_file;
+        qstring journal_file        = opt_journal_file;
 
-        if (ask_form(form, &interval, &chk_opts.n) > 0)
+        if (ask_form(form, &interval, &stream_threshold, &rpc_endpoint, &trace_file, &journal_file, &chk_opts.n) > 0)
         {
             // Copy values from the dialog
             opt_change_interval  = normalize_filemon_interval(int(interval));
+            opt_stream_threshold = int(qmax(stream_threshold, sval_t(0)));
             opt_clear_log        = chk_opts.b_clear_log;
             opt_show_filename    = chk_opts.b_show_filename;
             opt_exec_unload_func = chk_opts.b_exec_unload_func;
             opt_with_undo        = chk_opts.b_with_undo;
+            opt_isolate_ns       = chk_opts.b_isolate_ns;
+            opt_use_watchd       = chk_opts.b_use_watchd;
+            opt_leak_watch       = chk_opts.b_leak_watch;
+            opt_run_history      = chk_opts.b_run_history;
+            opt_capture_output   = chk_opts.b_capture_output;
+            opt_rpc_endpoint     = rpc_endpoint.trim2();
+            opt_trace_file       = trace_file.trim2();
+            opt_journal_file     = journal_file.trim2();
 
             // Save the options directly
             saveload_options(true);
+            update_rpc_server();
+            update_trace();
+            update_journal();
+            update_watch_client();
             return true;
         }
         return false;
@@ -855,10 +2327,41 @@ protected:
         auto si = &m_scripts[n];
         auto path = si->file_path.c_str();
         auto name = strrchr(path, DIRCHAR);
-        cols->at(0) = name == nullptr ? path : name + 1;
-        cols->at(1) = path;
+        cols->at(COL_SCRIPT) = name == nullptr ? path : name + 1;
+        cols->at(COL_PATH)   = path;
+        if (auto st = m_stats.find(path))
+        {
+            cols->at(COL_LAST).sprnt("%.2f", st->last_ms);
+            cols->at(COL_P50).sprnt("%.2f", st->percentile(50));
+            cols->at(COL_P95).sprnt("%.2f", st->percentile(95));
+            cols->at(COL_RUNS).sprnt("%u", st->count);
+            cols->at(COL_FAILURES).sprnt("%u", st->failures);
+        }
         if (n == m_nselected)
         {
+            if (m_workers.is_busy())
+            {
+                cols->at(COL_SCRIPT).cat_sprnt(" [workers: %u running, %u queued]",
+                    uint(m_workers.running_count()),
+                    uint(m_workers.queued_count()));
+            }
+            if (m_build.is_busy())
+                cols->at(COL_SCRIPT).append(" [building]");
+            if (m_corpus.is_busy())
+            {
+                cols->at(COL_SCRIPT).cat_sprnt(" [corpus: %u/%u]",
+                    uint(m_corpus.done_count()),
+                    uint(m_corpus.total_count()));
+            }
+            if (m_task.is_running())
+            {
+                int percent = m_task.get_percent();
+                if (percent >= 0)
+                    cols->at(COL_SCRIPT).cat_sprnt(" [task: %d%%]", percent);
+                else
+                    cols->at(COL_SCRIPT).append(" [task running]");
+            }
+
             if (is_monitor_active())
             {
                 attrs->flags = CHITEM_BOLD;
@@ -870,7 +2373,13 @@ protected:
                 *icon = IDAICONS::RED_DOT;
             }
         }
-        else if (is_monitor_active() && selected_script.has_dep(si->file_path) != nullptr)
+        else if (auto extra = is_monitor_active() ? find_extra_script(si->file_path) : nullptr)
+        {
+            // Mark as an additional active script
+            attrs->flags = CHITEM_BOLD;
+            *icon = extra->is_notebook() ? IDAICONS::NOTEPAD_1 : IDAICONS::KEYBOARD_GRAY;
+        }
+        else if (is_monitor_active() && is_dependency(si->file_path))
         {
             // Mark as a dependency
             *icon = IDAICONS::EYE_GLASSES_EDIT;
@@ -892,6 +2401,19 @@ protected:
         // Set as the selected script and execute it
         set_selected_script(m_scripts[n]);
 
+        // Take the baseline snapshot before the first execution. It is kept while
+        // the same script is re-activated: the SDK cannot delete snapshots.
+        if (   selected_script.b_snapshot
+            && (!g_snapshot.has_baseline || g_snapshot.script_file != selected_script.file_path))
+        {
+            take_baseline_snapshot();
+        }
+
+        // The workers of the previous activation are cancelled, their database copy is reused
+        m_workers.cancel_all();
+        if (selected_script.b_worker && m_worker_db.empty())
+            take_worker_database();
+
         if (   selected_script.is_notebook() 
             && selected_script.notebook.activation_action == notebook_ctx_t::act_exec_none)
         {
@@ -1074,6 +2596,112 @@ protected:
             },
             "An action to programmatically execute the active script",
             IDAICONS::NOTEPAD_1);
+
+        am.add_action(
+            AMAHF_NONE,
+            ACTION_CANCEL_TASK_ID,
+            "QScripts: Cancel native task",
+            "",
+            FO_ACTION_UPDATE([this],
+                return this->is_correct_widget(ctx) ? AST_ENABLE_FOR_WIDGET : AST_DISABLE_FOR_WIDGET;
+            ),
+            FO_ACTION_ACTIVATE([this]) {
+                this->m_task.cancel();
+                return 1;
+            },
+            "Cancel the running task of the active native module",
+            IDAICONS::DISABLED);
+
+        am.add_action(
+            AMAHF_NONE,
+            ACTION_EXECUTE_EVERYWHERE_ID,
+            "QScripts: Execute active script in all instances",
+            "",
+            FO_ACTION_UPDATE([this],
+                return AST_ENABLE_ALWAYS;
+            ),
+            FO_ACTION_ACTIVATE([this])
+            {
+                if (this->has_selected_script())
+                {
+                    // The instances where the script is active execute it too
+                    if (!this->m_watchd.request_run(selected_script.file_path.c_str()))
+                        msg("QScripts is not connected to the watcher daemon: only this instance executes the script\n");
+                    this->execute_script(&selected_script, opt_with_undo);
+                }
+                return 1;
+            },
+            "Execute the active script in this and in the other IDA instances where it is active",
+            IDAICONS::FLASH);
+
+        am.add_action(
+            AMAHF_NONE,
+            ACTION_TOGGLE_EXTRA_SCRIPT_ID,
+            "QScripts: Keep script active along with the selected script",
+            "Ctrl-Shift-Enter",
+            FO_ACTION_UPDATE([this],
+                return this->is_correct_widget(ctx) ? AST_ENABLE_FOR_WIDGET : AST_DISABLE_FOR_WIDGET;
+            ),
+            FO_ACTION_ACTIVATE([this]) {
+                if (!ctx->chooser_selection.empty())
+                {
+                    this->toggle_extra_script(ctx->chooser_selection.at(0));
+                    refresh_chooser(QSCRIPTS_TITLE);
+                }
+                return 1;
+            },
+            "Activate (or deactivate) the script in addition to the selected script",
+            IDAICONS::KEYBOARD_GRAY);
+
+        am.add_action(
+            AMAHF_NONE,
+            ACTION_RUN_CORPUS_ID,
+            "QScripts: Run active script on a database corpus",
+            "",
+            FO_ACTION_UPDATE([this],
+                return AST_ENABLE_ALWAYS;
+            ),
+            FO_ACTION_ACTIVATE([this])
+            {
+                if (!this->m_corpus.is_busy())
+                {
+                    this->run_corpus();
+                }
+                else if (ask_yn(ASKBTN_NO, "HIDECANCEL\nThe corpus run is in progress (%u/%u done). Cancel it?",
+                                uint(this->m_corpus.done_count()),
+                                uint(this->m_corpus.total_count())) == ASKBTN_YES)
+                {
+                    this->m_corpus.cancel();
+                    refresh_chooser(QSCRIPTS_TITLE);
+                }
+                return 1;
+            },
+            "Run the active script in headless workers on each database of its corpus and write a report",
+            IDAICONS::FLASH);
+
+        am.add_action(
+            AMAHF_NONE,
+            ACTION_EXPORT_STATS_ID,
+            "QScripts: Export execution statistics",
+            "",
+            FO_ACTION_UPDATE([this],
+                return this->m_stats.empty() ? AST_DISABLE : AST_ENABLE;
+            ),
+            FO_ACTION_ACTIVATE([this])
+            {
+                const char *csv_file = ask_file(true, "*.csv", "Export the execution statistics");
+                if (csv_file != nullptr)
+                {
+                    qstring errbuf;
+                    if (this->m_stats.export_csv(csv_file, &errbuf))
+                        msg("QScripts exported the execution statistics to %s\n", csv_file);
+                    else
+                        msg("QScripts failed to export the execution statistics: %s\n", errbuf.c_str());
+                }
+                return 1;
+            },
+            "Save the execution statistics of the scripts (and notebook cells) to a CSV file",
+            IDAICONS::NOTEPAD_1);
     }
 
 public:
@@ -1085,6 +2713,11 @@ public:
         popup_names[POPUP_EDIT] = "~O~ptions";
         setup_ui();
         saveload_options(false);
+        s_instance = this;
+        update_rpc_server();
+        update_trace();
+        update_journal();
+        update_watch_client();
     }
 
     bool activate_monitor(bool activate = true)
@@ -1187,6 +2820,22 @@ public:
                 widget,
                 nullptr,
                 ACTION_EXECUTE_NOTEBOOK_ID);
+            attach_action_to_popup(
+                widget,
+                nullptr,
+                ACTION_EXECUTE_EVERYWHERE_ID);
+            attach_action_to_popup(
+                widget,
+                nullptr,
+                ACTION_TOGGLE_EXTRA_SCRIPT_ID);
+            attach_action_to_popup(
+                widget,
+                nullptr,
+                ACTION_RUN_CORPUS_ID);
+            attach_action_to_popup(
+                widget,
+                nullptr,
+                ACTION_EXPORT_STATS_ID);
         }
     }
 
@@ -1254,9 +2903,15 @@ public:
 
     virtual ~qscripts_chooser_t()
     {
+        if (s_instance == this)
+            s_instance = nullptr;
+        m_rpc.stop();
+        m_watchd.stop();
+        g_trace.stop();
         uninstall_filemon_timer();
     }
 };
+qscripts_chooser_t *qscripts_chooser_t::s_instance = nullptr;
 
 //-------------------------------------------------------------------------
 plugmod_t *idaapi init(void)
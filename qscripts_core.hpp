@@ -0,0 +1,22 @@
+#pragma once
+
+//-------------------------------------------------------------------------
+// The QScripts engine: the active scripts and their dependencies, the change
+// detection and the monitor tick, the dependency index parser and the session
+// journal.
+//
+// The engine does not use the database or the UI, only a small subset of the
+// IDA SDK: qstring, qvector, qstrvec_t, qstat, the qfopen/qfread/qgetline file
+// functions, qunlink, the path helpers (qdirname, qbasename, qisabspath...),
+// qgetenv, get_nsec_stamp, msg and the extlang enumeration. The monitor timer
+// stays in the plugin, which runs the engine's tick (see script_monitor.hpp).
+//
+// The plugin includes it after the SDK headers (see ida.h), while the benchmark
+// (see bench/) builds it on a stub implementation of that subset, so it runs
+// without IDA.
+#include "utils_impl.cpp"
+#include "script.hpp"
+#include "deps_parser.hpp"
+#include "session_journal.hpp"
+#include "file_ready.hpp"
+#include "script_monitor.hpp"
@@ -0,0 +1,192 @@
+#pragma once
+
+//-------------------------------------------------------------------------
+// Cooperative tasks for native modules executed with the '/native' directive.
+//
+// A long running native experiment can be written as a C++20 coroutine that
+// periodically reaches a yield point. QScripts resumes it from a timer on the
+// main thread, one time slice after the other, so the UI stays responsive and
+// no thread other than the main thread ever touches the IDA API:
+//
+//      #include "qscripts_task.hpp"
+//
+//      qscripts::task analyze(size_t arg)
+//      {
+//          size_t n = get_func_qty();
+//          for (size_t i = 0; i < n; ++i)
+//          {
+//              ...
+//              co_await qscripts::yield(double(i) / n);
+//          }
+//          co_return true;
+//      }
+//      QSCRIPTS_TASK_MAIN(analyze)
+//
+// A yield point only suspends the task when the slice's time budget is spent.
+// A task is cancelled by destroying it at a suspension point: the destructors
+// of its local variables run as usual.
+//
+// QScripts and the modules only share the plain C interface below, so QScripts
+// itself does not need to be compiled as C++20.
+#include <stddef.h>
+#include <stdint.h>
+
+#define QSCRIPTS_TASK_ABI_VERSION 1
+#define QSCRIPTS_TASK_START_NAME  "qscripts_task_start"
+
+struct qscripts_task_abi_t
+{
+    // Set by QScripts before the task is started
+    int version;
+
+    // The task's state (owned by the module)
+    void *task;
+
+    // Runs the task until it yields after 'budget_us' microseconds of work.
+    // Returns non-zero while the task has more work to do.
+    int (*resume)(void *task, uint64_t budget_us);
+
+    // Returns the task's progress in [0, 1] or a negative value if unknown
+    double (*progress)(void *task);
+
+    // Returns non-zero if the finished task succeeded
+    int (*succeeded)(void *task);
+
+    // Destroys the task, whether it is finished or not
+    void (*destroy)(void *task);
+};
+
+// Exported by the module: creates the task and fills 'abi'. Returns zero on failure.
+typedef int (*qscripts_task_start_t)(size_t arg, qscripts_task_abi_t *abi);
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+
+#include <coroutine>
+#include <chrono>
+
+#ifdef _WIN32
+    #define QSCRIPTS_TASK_EXPORT __declspec(dllexport)
+#else
+    #define QSCRIPTS_TASK_EXPORT __attribute__((visibility("default")))
+#endif
+
+namespace qscripts
+{
+    class task
+    {
+    public:
+        struct promise_type
+        {
+            std::chrono::steady_clock::time_point deadline;
+            double progress = -1.0;
+            bool result = false;
+
+            task get_return_object() { return task(handle_t::from_promise(*this)); }
+
+            // Nothing runs before the first time slice
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            std::suspend_always final_suspend() noexcept { return {}; }
+
+            void return_value(bool ok) { result = ok; }
+            void unhandled_exception() { result = false; }
+        };
+        using handle_t = std::coroutine_handle<promise_type>;
+
+        task(task &&other) noexcept : h(other.h) { other.h = nullptr; }
+        task(const task &) = delete;
+        task &operator=(const task &) = delete;
+
+        ~task()
+        {
+            if (h)
+                h.destroy();
+        }
+
+        handle_t release()
+        {
+            handle_t r = h;
+            h = nullptr;
+            return r;
+        }
+
+    private:
+        explicit task(handle_t h) : h(h) {}
+        handle_t h;
+    };
+
+    // A yield point, optionally reporting the progress in [0, 1]
+    class yield
+    {
+        double progress;
+
+    public:
+        explicit yield(double progress = -1.0) : progress(progress) {}
+
+        bool await_ready() const noexcept { return false; }
+
+        // Only suspend when the time slice is over
+        bool await_suspend(task::handle_t h) const noexcept
+        {
+            auto &p = h.promise();
+            if (progress >= 0)
+                p.progress = progress;
+            return std::chrono::steady_clock::now() >= p.deadline;
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+    namespace detail
+    {
+        inline task::handle_t handle(void *t)
+        {
+            return task::handle_t::from_address(t);
+        }
+
+        inline int resume(void *t, uint64_t budget_us)
+        {
+            auto h = handle(t);
+            h.promise().deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(budget_us);
+            h.resume();
+            return h.done() ? 0 : 1;
+        }
+
+        inline double progress(void *t)
+        {
+            return handle(t).promise().progress;
+        }
+
+        inline int succeeded(void *t)
+        {
+            auto h = handle(t);
+            return h.done() && h.promise().result ? 1 : 0;
+        }
+
+        inline void destroy(void *t)
+        {
+            handle(t).destroy();
+        }
+
+        inline int start(task t, qscripts_task_abi_t *abi)
+        {
+            if (abi->version != QSCRIPTS_TASK_ABI_VERSION)
+                return 0;
+
+            abi->task      = t.release().address();
+            abi->resume    = resume;
+            abi->progress  = progress;
+            abi->succeeded = succeeded;
+            abi->destroy   = destroy;
+            return 1;
+        }
+    }
+}
+
+// Exports the task entry point: 'func' is a 'qscripts::task func(size_t arg)' coroutine
+#define QSCRIPTS_TASK_MAIN(func)                                                        \
+    extern "C" QSCRIPTS_TASK_EXPORT int qscripts_task_start(size_t arg, qscripts_task_abi_t *abi) \
+    {                                                                                   \
+        return qscripts::detail::start(func(arg), abi);                                 \
+    }
+
+#endif // __cpp_impl_coroutine
@@ -0,0 +1,403 @@
+#pragma once
+
+//-------------------------------------------------------------------------
+// A local JSON-RPC 2.0 endpoint for editors.
+//
+// - POSIX: a Unix domain socket (only accessible by the current user)
+// - Windows: a named pipe (\\.\pipe\name), one client at a time
+//
+// Each request and each response is a single line of JSON. The requests are
+// read by a background thread and handled on the main thread with
+// execute_sync(), so the handlers can use the IDA API.
+static constexpr int RPC_ERR_PARSE            = -32700;
+static constexpr int RPC_ERR_INVALID_REQUEST  = -32600;
+static constexpr int RPC_ERR_METHOD_NOT_FOUND = -32601;
+static constexpr int RPC_ERR_INVALID_PARAMS   = -32602;
+static constexpr int RPC_ERR_INTERNAL         = -32603;
+
+class rpc_server_t
+{
+public:
+    // Handles a call on the main thread. Returns false and sets 'errcode'/'errmsg' on failure.
+    using handler_t = std::function<bool(
+        const char *method,
+        const json_t &params,
+        json_t &result,
+        int &errcode,
+        qstring &errmsg)>;
+
+private:
+    struct call_req_t : public exec_request_t
+    {
+        rpc_server_t *owner = nullptr;
+        const json_t *request = nullptr;
+        json_t *response = nullptr;
+
+        ssize_t idaapi execute() override
+        {
+            owner->dispatch(*request, *response);
+            qsem_post(owner->done_sem);
+            return 0;
+        }
+    } call_req;
+
+    qstring endpoint;
+    handler_t handler;
+    qthread_t thread = nullptr;
+    qsemaphore_t done_sem = nullptr;
+    std::atomic<bool> stop_requested{ false };
+    std::atomic<int> pending_req_id{ -1 };
+
+#ifdef __NT__
+    HANDLE h_pipe = INVALID_HANDLE_VALUE;
+#else
+    int fd_listen = -1;
+    int stop_fds[2] = { -1, -1 };
+#endif
+
+    static int idaapi s_thread_cb(void *ud)
+    {
+        ((rpc_server_t *)ud)->serve();
+        return 0;
+    }
+
+    static json_t make_error(int code, const char *message)
+    {
+        json_t err = json_t::object();
+        err.set("code", code);
+        err.set("message", message);
+        return err;
+    }
+
+    // Called on the main thread
+    void dispatch(const json_t &req, json_t &resp)
+    {
+        json_t result;
+        int errcode = RPC_ERR_INTERNAL;
+        qstring errmsg;
+
+        const json_t *params = req.get("params");
+        static const json_t no_params = json_t::object();
+        if (handler(req.get_str("method"), params != nullptr ? *params : no_params, result, errcode, errmsg))
+            resp.set("result", std::move(result));
+        else
+            resp.set("error", make_error(errcode, errmsg.c_str()));
+    }
+
+    // Called from the server thread: returns false if no response is to be sent
+    bool handle_line(const char *line, size_t len, qstring &out)
+    {
+        json_t req;
+        json_t resp = json_t::object();
+        resp.set("jsonrpc", "2.0");
+
+        qstring err;
+        if (!json_t::parse(line, len, req, &err))
+        {
+            resp.set("id", json_t());
+            resp.set("error", make_error(RPC_ERR_PARSE, err.c_str()));
+        }
+        else if (!req.is_object() || req.get_str("method") == nullptr)
+        {
+            resp.set("id", json_t());
+            resp.set("error", make_error(RPC_ERR_INVALID_REQUEST, "invalid request"));
+        }
+        else
+        {
+            const json_t *id = req.get("id");
+            resp.set("id", id != nullptr ? *id : json_t());
+
+            call_req.request  = &req;
+            call_req.response = &resp;
+            pending_req_id = execute_sync(call_req, MFF_WRITE | MFF_NOWAIT);
+            qsem_wait(done_sem, -1);
+            if (stop_requested)
+                return false;
+            pending_req_id = -1;
+
+            // Notifications do not get a response
+            if (id == nullptr)
+                return false;
+        }
+
+        resp.dump(out);
+        out.append('\n');
+        return true;
+    }
+
+    // Splits the received data into lines and handles them. Returns the responses.
+    void handle_data(qstring &data, qstring &out)
+    {
+        size_t start = 0;
+        for (size_t i = 0; i < data.length() && !stop_requested; ++i)
+        {
+            if (data[i] != '\n')
+                continue;
+
+            size_t len = i - start;
+            if (len != 0)
+            {
+                qstring line(data.c_str() + start, len);
+                handle_line(line.c_str(), line.length(), out);
+            }
+            start = i + 1;
+        }
+        data.remove(0, start);
+    }
+
+#ifdef __NT__
+    void serve()
+    {
+        qstring data, out;
+        while (!stop_requested)
+        {
+            if (!ConnectNamedPipe(h_pipe, nullptr) && GetLastError() != ERROR_PIPE_CONNECTED)
+                break;
+
+            data.qclear();
+            char buf[4096];
+            DWORD nread;
+            while (!stop_requested && ReadFile(h_pipe, buf, sizeof(buf), &nread, nullptr) && nread > 0)
+            {
+                data.append(buf, nread);
+                out.qclear();
+                handle_data(data, out);
+
+                DWORD nwritten;
+                if (!out.empty() && !WriteFile(h_pipe, out.c_str(), DWORD(out.length()), &nwritten, nullptr))
+                    break;
+            }
+            FlushFileBuffers(h_pipe);
+            DisconnectNamedPipe(h_pipe);
+        }
+    }
+#else
+    static bool write_all(int fd, const qstring &s)
+    {
+        const char *p = s.c_str();
+        size_t left = s.length();
+        while (left != 0)
+        {
+#ifdef MSG_NOSIGNAL
+            ssize_t n = send(fd, p, left, MSG_NOSIGNAL);
+#else
+            ssize_t n = send(fd, p, left, 0);
+#endif
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            p += n;
+            left -= size_t(n);
+        }
+        return true;
+    }
+
+    void serve()
+    {
+        struct client_t
+        {
+            int fd;
+            qstring data;
+        };
+        std::vector<client_t> clients;
+        std::vector<pollfd> fds;
+        while (!stop_requested)
+        {
+            fds.clear();
+            fds.push_back({ stop_fds[0], POLLIN, 0 });
+            fds.push_back({ fd_listen, POLLIN, 0 });
+            for (auto &c : clients)
+                fds.push_back({ c.fd, POLLIN, 0 });
+
+            if (poll(fds.data(), nfds_t(fds.size()), -1) < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                break;
+            }
+            if (fds[0].revents != 0)
+                break;
+
+            // Visit the clients backwards so they can be removed on the way
+            for (size_t i = clients.size(); i-- > 0; )
+            {
+                if (fds[i + 2].revents == 0)
+                    continue;
+
+                auto &c = clients[i];
+                char buf[4096];
+                ssize_t n = read(c.fd, buf, sizeof(buf));
+                bool keep = n > 0;
+                if (keep)
+                {
+                    c.data.append(buf, size_t(n));
+                    qstring out;
+                    handle_data(c.data, out);
+                    keep = out.empty() || write_all(c.fd, out);
+                }
+                if (!keep)
+                {
+                    close(c.fd);
+                    clients.erase(clients.begin() + i);
+                }
+            }
+
+            if (fds[1].revents != 0)
+            {
+                int fd = accept(fd_listen, nullptr, nullptr);
+                if (fd != -1)
+                {
+                    fcntl(fd, F_SETFD, FD_CLOEXEC);
+#ifdef SO_NOSIGPIPE
+                    int one = 1;
+                    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+                    clients.push_back({ fd });
+                }
+            }
+        }
+        for (auto &c : clients)
+            close(c.fd);
+    }
+#endif
+
+public:
+    rpc_server_t()
+    {
+        call_req.owner = this;
+    }
+
+    bool is_active() const { return thread != nullptr; }
+    const qstring &get_endpoint() const { return endpoint; }
+
+    bool start(const char *ep, handler_t cb, qstring *errbuf)
+    {
+        stop();
+        endpoint = ep;
+        handler = std::move(cb);
+        stop_requested = false;
+
+#ifdef __NT__
+        h_pipe = CreateNamedPipeA(
+            endpoint.c_str(),
+            PIPE_ACCESS_DUPLEX,
+            PIPE_TYPE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+            1,
+            64 * 1024,
+            64 * 1024,
+            0,
+            nullptr);
+        if (h_pipe == INVALID_HANDLE_VALUE)
+        {
+            errbuf->sprnt("CreateNamedPipe() failed with error %u", GetLastError());
+            return false;
+        }
+#else
+        sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        if (endpoint.length() >= sizeof(addr.sun_path))
+        {
+            errbuf->sprnt("the socket path is too long");
+            return false;
+        }
+        qstrncpy(addr.sun_path, endpoint.c_str(), sizeof(addr.sun_path));
+
+        // Remove a stale socket left by a previous session
+        unlink(endpoint.c_str());
+        fd_listen = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (   fd_listen == -1
+            || bind(fd_listen, (sockaddr *)&addr, sizeof(addr)) != 0
+            || chmod(endpoint.c_str(), 0600) != 0
+            || listen(fd_listen, 4) != 0
+            || pipe(stop_fds) != 0)
+        {
+            errbuf->sprnt("failed to listen on '%s': %s", endpoint.c_str(), strerror(errno));
+            stop();
+            return false;
+        }
+        fcntl(fd_listen, F_SETFD, FD_CLOEXEC);
+#endif
+        done_sem = qsem_create(nullptr, 0);
+        thread = qthread_create(s_thread_cb, this);
+        if (thread == nullptr)
+        {
+            errbuf->sprnt("failed to create the server thread");
+            stop();
+            return false;
+        }
+        return true;
+    }
+
+    void stop()
+    {
+        stop_requested = true;
+        if (thread != nullptr)
+        {
+            // Release the server thread if it waits for the main thread (us)
+            qsem_post(done_sem);
+#ifdef __NT__
+            // Break a pending read and a pending ConnectNamedPipe()
+            DisconnectNamedPipe(h_pipe);
+            for (int i = 0; i < 50; ++i)
+            {
+                HANDLE h = CreateFileA(endpoint.c_str(), GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, 0, nullptr);
+                if (h != INVALID_HANDLE_VALUE)
+                {
+                    CloseHandle(h);
+                    break;
+                }
+                WaitNamedPipeA(endpoint.c_str(), 100);
+            }
+#else
+            char c = 0;
+            ssize_t n = write(stop_fds[1], &c, 1);
+            qnotused(n);
+#endif
+            qthread_join(thread);
+            qthread_free(thread);
+            thread = nullptr;
+        }
+
+        // Drop a call that was not handled yet
+        if (pending_req_id != -1)
+        {
+            cancel_exec_request(pending_req_id);
+            pending_req_id = -1;
+        }
+
+#ifdef __NT__
+        if (h_pipe != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(h_pipe);
+            h_pipe = INVALID_HANDLE_VALUE;
+        }
+#else
+        if (fd_listen != -1)
+        {
+            close(fd_listen);
+            fd_listen = -1;
+            unlink(endpoint.c_str());
+        }
+        for (int *pfd : { &stop_fds[0], &stop_fds[1] })
+        {
+            if (*pfd != -1)
+            {
+                close(*pfd);
+                *pfd = -1;
+            }
+        }
+#endif
+        if (done_sem != nullptr)
+        {
+            qsem_free(done_sem);
+            done_sem = nullptr;
+        }
+        endpoint.qclear();
+    }
+
+    ~rpc_server_t()
+    {
+        stop();
+    }
+};
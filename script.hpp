@@ -13,6 +13,54 @@ enum class filemod_status_e
     modified
 };
 
+//-------------------------------------------------------------------------
+// Modification times taken during one file monitor tick. While a tick is in
+// progress, a file that several active scripts depend on is only visited once.
+class file_stat_tick_t
+{
+    struct stat_t
+    {
+        bool exists;
+        qtime64_t mtime;
+    };
+    std::unordered_map<std::string, stat_t> stats;
+    file_stat_tick_t *prev;
+
+    static file_stat_tick_t *&current()
+    {
+        static file_stat_tick_t *tick = nullptr;
+        return tick;
+    }
+
+public:
+    file_stat_tick_t() : prev(current())
+    {
+        current() = this;
+    }
+
+    ~file_stat_tick_t()
+    {
+        current() = prev;
+    }
+
+    static bool get_modification_time(const char *file_path, qtime64_t *mtime)
+    {
+        file_stat_tick_t *tick = current();
+        if (tick == nullptr)
+            return get_file_modification_time(file_path, mtime);
+
+        auto p = tick->stats.find(file_path);
+        if (p == tick->stats.end())
+        {
+            stat_t st;
+            st.exists = get_file_modification_time(file_path, &st.mtime);
+            p = tick->stats.emplace(file_path, st).first;
+        }
+        *mtime = p->second.mtime;
+        return p->second.exists;
+    }
+};
+
 // Structure to describe a file and its metadata
 struct fileinfo_t
 {
@@ -60,7 +108,7 @@ struct fileinfo_t
     {
         qtime64_t cur_mtime;
         const char *script_file = this->file_path.c_str();
-        if (!get_file_modification_time(script_file, &cur_mtime))
+        if (!file_stat_tick_t::get_modification_time(script_file, &cur_mtime))
         {
             if (update_mtime)
                 modified_time = 0;
@@ -95,6 +143,15 @@ struct script_info_t: fileinfo_t
     // Base path if this dependency is part of a package
     qstring pkg_base;
 
+    // Execute the script in chunks (see stream_exec.hpp)
+    bool b_stream = false;
+
+    // Hot-patch changed Python definitions instead of re-executing the script
+    bool b_hotpatch = false;
+
+    // Profile the Python executions and print the top N functions (0 to disable)
+    int profile_top = 0;
+
     const bool has_reload_directive() const { return !reload_cmd.empty(); }
 };
 
@@ -112,6 +169,7 @@ struct notebook_ctx_t
         act_exec_all
     };
     std::string base_path;
+    std::string main_file;  // the notebook's main script (its cells share its namespace)
     std::string title;
     std::regex cells_re = std::regex(DEFAULT_CELLS_RE);
     std::map<std::string, qtime64_t> cell_files;
@@ -122,12 +180,75 @@ struct notebook_ctx_t
     void clear()
     {
         title.clear();
+        main_file.clear();
         cell_files.clear();
         last_active_cell.clear();
         cells_re = std::regex(DEFAULT_CELLS_RE);
     }
 };
 
+//-------------------------------------------------------------------------
+// Database corpus the script can be run on (see corpus_runner.hpp)
+struct corpus_ctx_t
+{
+    qstrvec_t patterns;     // globs or '@' followed by a list file
+    qstring cmd;
+    qstring report;
+    int jobs = 0;
+    int timeout_secs = 0;
+
+    void clear()
+    {
+        patterns.qclear();
+        cmd.clear();
+        report.clear();
+        jobs = 0;
+        timeout_secs = 0;
+    }
+};
+
+//-------------------------------------------------------------------------
+// Database event classes of the '/on' directive (see idb_events.hpp)
+enum idb_event_class_e : uint32
+{
+    IDBEV_RENAME     = 0x01,
+    IDBEV_TYPE       = 0x02,
+    IDBEV_FUNC_ADDED = 0x04,
+    IDBEV_CMT        = 0x08,
+};
+
+// Parses an event class name. Returns 0 if unknown.
+inline uint32 parse_idb_event_class(const char *name)
+{
+    static const struct { const char *name; uint32 cls; } names[] =
+    {
+        { "rename",     IDBEV_RENAME },
+        { "type",       IDBEV_TYPE },
+        { "func_added", IDBEV_FUNC_ADDED },
+        { "cmt",        IDBEV_CMT },
+        { "comment",    IDBEV_CMT },
+        { "all",        IDBEV_RENAME | IDBEV_TYPE | IDBEV_FUNC_ADDED | IDBEV_CMT },
+    };
+    for (auto &n : names)
+    {
+        if (streq(n.name, name))
+            return n.cls;
+    }
+    return 0;
+}
+
+inline const char *idb_event_class_name(uint32 cls)
+{
+    switch (cls)
+    {
+        case IDBEV_RENAME:     return "rename";
+        case IDBEV_TYPE:       return "type";
+        case IDBEV_FUNC_ADDED: return "func_added";
+        case IDBEV_CMT:        return "cmt";
+    }
+    return "?";
+}
+
 //-------------------------------------------------------------------------
 // Active script information along with its dependencies
 struct active_script_info_t : script_info_t
@@ -141,9 +262,36 @@ struct active_script_info_t : script_info_t
 
     notebook_ctx_t notebook;
 
+    // Restore the baseline database snapshot before each automatic re-run
+    bool b_snapshot = false;
+
+    // Out-of-process execution options
+    bool b_worker = false;
+    qstring worker_cmd;
+    int worker_jobs = 0;
+    qstring worker_artifacts_re;
+
     // Trigger file options
     fileinfo_t trigger_file;
     bool b_keep_trigger_file;
+    int trigger_samples = -1;       // Readiness samples (-1 for the default)
+    bool b_trigger_settling = false; // Modified, waiting for the trigger file to be ready
+
+    // Build stage: command and source file patterns
+    qstring build_cmd;
+    qstrvec_t build_sources;
+
+    // Native module executed instead of the script
+    qstring native_module;
+
+    // Trigger pipe (FIFO or named pipe) path
+    qstring trigger_pipe;
+
+    // IDB event classes that re-run the script and their coalescing window (-1 for the default)
+    uint32 idb_events = 0;
+    int idb_events_window = -1;
+
+    corpus_ctx_t corpus;
 
     // The dependencies index files. First entry is for the main script's deps
     qvector<fileinfo_t> dep_indices;
@@ -160,18 +308,27 @@ struct active_script_info_t : script_info_t
 
     // Is this trigger based or dependency based?
     const bool trigger_based() const { return !trigger_file.empty(); }
+    const bool pipe_triggered() const { return !trigger_pipe.empty(); }
+    const bool is_native() const { return !native_module.empty(); }
+    const bool has_build() const { return !build_cmd.empty(); }
+    const bool idb_triggered() const { return idb_events != 0; }
 
     // If no dependency index files have been modified, return 0.
     // Return 1 if one of them has been modified or -1 if one of them has gone missing.
-    // In both latter cases, we have to recompute our dependencies
-    filemod_status_e is_any_dep_index_modified(bool update_mtime = true)
+    // In both latter cases, we have to recompute our dependencies.
+    // 'changed' receives the index file that was modified or is gone.
+    filemod_status_e is_any_dep_index_modified(bool update_mtime = true, qstring *changed = nullptr)
     {
         filemod_status_e r = filemod_status_e::not_modified;
         for (auto& dep_file : dep_indices)
         {
             r = dep_file.get_modification_status(update_mtime);
             if (r != filemod_status_e::not_modified)
+            {
+                if (changed != nullptr)
+                    *changed = dep_file.file_path;
                 break;
+            }
         }
         return r;
     }
@@ -194,10 +351,27 @@ struct active_script_info_t : script_info_t
         dep_scripts.clear();
         trigger_file.clear();
         b_keep_trigger_file = false;
+        trigger_samples = -1;
+        b_trigger_settling = false;
+        trigger_pipe.clear();
+        idb_events = 0;
+        idb_events_window = -1;
+        corpus.clear();
+        native_module.clear();
+        build_cmd.clear();
+        build_sources.qclear();
         b_is_notebook = false;
+        b_snapshot = false;
+        b_worker = false;
+        worker_cmd.clear();
+        worker_jobs = 0;
+        worker_artifacts_re.clear();
         notebook.clear();
         reload_cmd.clear();
         pkg_base.clear();
+        b_stream = false;
+        b_hotpatch = false;
+        profile_top = 0;
     }
 
     void invalidate_all_scripts()
@@ -208,4 +382,72 @@ struct active_script_info_t : script_info_t
         for (auto& kv : dep_scripts)
             kv.second.invalidate();
     }
+
+    // Calls 'visitor' for each dependency script modified since the last check, until it returns false.
+    // Returns the number of modified scripts that were visited.
+    template <typename F>
+    size_t visit_modified_deps(F visitor)
+    {
+        size_t nmodified = 0;
+        for (auto& kv : dep_scripts)
+        {
+            auto& dep_script = kv.second;
+            if (dep_script.get_modification_status() != filemod_status_e::modified)
+                continue;
+
+            ++nmodified;
+            if (!visitor(dep_script))
+                break;
+        }
+        return nmodified;
+    }
+
+    // Scans the notebook cells and returns the first modified one (empty if none).
+    // New cells are recorded and the deleted ones are forgotten.
+    std::string scan_notebook_cells()
+    {
+        auto& last_active_cell = notebook.last_active_cell;
+        auto& cell_files = notebook.cell_files;
+        auto current_path = std::filesystem::path(file_path.c_str()).parent_path();
+        std::unordered_set<std::string> present_files;
+
+        std::string active_cell;
+        enumerate_files(
+            current_path, 
+            notebook.cells_re, 
+            [&present_files, &last_active_cell, &active_cell, &cell_files](const std::string& filename)
+            {
+                present_files.insert(filename);
+                auto p = cell_files.find(filename);
+
+                qtime64_t mtime;
+                get_file_modification_time(filename.c_str(), &mtime);
+
+                // New file?
+                if (p == cell_files.end())
+                {
+                    cell_files[filename] = mtime;
+                }
+                // File was modified?
+                else if (p->second != mtime)
+                {
+                    last_active_cell = active_cell = filename;
+                    p->second = mtime;
+                    // Stop enumeration; next interval we pick up the rest
+                    return false;
+                }
+                return true;
+            }
+        );
+
+        // Remove missing files from cell_files
+        for (auto it = cell_files.begin(); it != cell_files.end();)
+        {
+            if (present_files.find(it->first) == present_files.end())
+                it = cell_files.erase(it);
+            else
+                ++it;
+        }
+        return active_cell;
+    }
 };
@@ -0,0 +1,233 @@
+#pragma once
+
+//-------------------------------------------------------------------------
+// One monitor tick of an active script: it detects the changes and decides
+// whether the script must be executed, in this order:
+// - the dependency index files: a change re-loads the active script
+// - the dependency scripts: the changed ones with a reload directive are reloaded
+// - build mode: the build takes over, the script itself is not checked
+// - notebook mode: the changed cell, or the last active one if a dependency changed
+// - trigger file mode: the trigger file is modified, then ready (see file_ready.hpp)
+// - trigger pipe mode: a trigger is pending
+// - the script itself
+//
+// The tick does not use the UI or the database. What it detects and what must
+// be done about it is handed over to the hooks, which the plugin (journal,
+// trace and executions) and the command-line tools of bench/ implement.
+class script_monitor_t
+{
+    file_readiness_t *trigger_ready;
+
+protected:
+    // A change was detected. 'kind' is one of the JF_* kinds (see session_journal.hpp)
+    virtual void on_change(active_script_info_t &, const char * /*file*/, int /*kind*/)
+    {
+    }
+
+    // An index file changed: the script must be re-loaded (its dependencies are cleared).
+    // Returns false if it was not, in which case the script must no longer be used.
+    virtual bool on_reparse(active_script_info_t &script) = 0;
+
+    // A changed dependency has a reload directive. Returns false to stop the tick.
+    virtual bool on_reload(active_script_info_t &, script_info_t &)
+    {
+        return true;
+    }
+
+    // Build mode: called on each tick instead of the checks of the script
+    virtual void on_build(active_script_info_t &)
+    {
+    }
+
+    // Trigger pipe mode: consumes a pending trigger, if any
+    virtual bool consume_trigger(active_script_info_t &)
+    {
+        return false;
+    }
+
+    // The script (or the notebook cell) no longer exists. The script must no longer be used.
+    virtual void on_gone(active_script_info_t &, const char *)
+    {
+    }
+
+    // The script must be executed. 'work_script' is either the script or a copy
+    // of it pointing to the notebook cell to execute.
+    virtual void on_execute(
+        active_script_info_t & /*script*/,
+        active_script_info_t & /*work_script*/,
+        bool /*dep_changed*/,
+        bool /*modified*/)
+    {
+    }
+
+    // A step of the tick took place between 'start_ns' and now
+    virtual void on_span(const char * /*name*/, const char * /*file*/, uint64 /*start_ns*/)
+    {
+    }
+
+public:
+    // Without a readiness check, a modified trigger file is ready right away
+    explicit script_monitor_t(file_readiness_t *trigger_ready = nullptr) : trigger_ready(trigger_ready)
+    {
+    }
+
+    virtual ~script_monitor_t()
+    {
+    }
+
+    // Checks the script and calls the hooks. Returns the delay until the next
+    // tick: 'interval', or less when the tick must come back sooner.
+    int tick(active_script_info_t &script, int interval)
+    {
+        do
+        {
+            std::unique_ptr<active_script_info_t> notebook_cell_script;
+            active_script_info_t *work_script = &script;
+
+            // Let's check the dependencies index files first
+            qstring changed_index;
+            auto mod_stat = script.is_any_dep_index_modified(true, &changed_index);
+            if (mod_stat == filemod_status_e::modified || (mod_stat == filemod_status_e::not_found && !script.dep_scripts.empty()))
+                on_change(script, changed_index.c_str(), JF_INDEX);
+            if (mod_stat == filemod_status_e::modified)
+            {
+                // Force re-parsing of the index file
+                script.dep_scripts.clear();
+                if (!on_reparse(script))
+                    break;
+
+                // Let's invalidate all the scripts time stamps so we ensure they are re-interpreted again
+                script.invalidate_all_scripts();
+
+                // Just leave and come back fast so we get a chance to re-evaluate everything
+                return 1; // (1 ms)
+            }
+            // Dependency index file is gone
+            else if (mod_stat == filemod_status_e::not_found && !script.dep_scripts.empty())
+            {
+                // Let's just check the active script
+                script.dep_scripts.clear();
+            }
+
+            //
+            // Check the dependency scripts
+            //
+            bool brk = false;
+            bool dep_script_changed = script.visit_modified_deps([&](script_info_t &dep_script)
+            {
+                on_change(script, dep_script.file_path.c_str(), JF_DEP);
+                if (!dep_script.has_reload_directive())
+                    return true;
+
+                brk = !on_reload(script, dep_script);
+                return !brk;
+            }) != 0;
+            if (brk)
+                break;
+
+            //
+            // Build mode
+            //
+            if (script.has_build())
+            {
+                on_build(script);
+                break;
+            }
+
+            //
+            // Notebook mode
+            //
+            if (script.is_notebook())
+            {
+                uint64 scan_start = get_nsec_stamp();
+                std::string active_cell = script.scan_notebook_cells();
+                on_span("notebook_scan", script.file_path.c_str(), scan_start);
+                if (!active_cell.empty())
+                    on_change(script, active_cell.c_str(), JF_CELL);
+
+                // We have to always execute a script when a dependency changes:
+                // - If a dependency has changed, but no active cells changed then attempt to use the last active cell.
+                if (dep_script_changed && active_cell.empty())
+                    active_cell = script.notebook.last_active_cell;
+
+                // If no modified cell files, then do nothing
+                if (!active_cell.empty())
+                {
+                    // ...use the same metadata as the notebook main script, but just execute the given cell
+                    notebook_cell_script.reset(new active_script_info_t(script));
+                    work_script = notebook_cell_script.get();
+                    work_script->file_path = active_cell.c_str();
+                }
+            }
+            //
+            // Trigger mode
+            //
+            // In trigger file mode, just wait for the trigger file to be created
+            else if (script.trigger_based())
+            {
+                // The monitor waits until the trigger file is created or modified
+                if (!script.b_trigger_settling)
+                {
+                    auto trigger_status = script.trigger_file.get_modification_status(true);
+                    if (trigger_status != filemod_status_e::modified)
+                        break;
+
+                    on_change(script, script.trigger_file.c_str(), JF_TRIGGER);
+                    script.b_trigger_settling = true;
+                    if (trigger_ready != nullptr)
+                        trigger_ready->begin();
+                }
+
+                // ...then until it is completely written (a linker may still be flushing it)
+                auto ready = trigger_ready != nullptr ? trigger_ready->check() : file_readiness_t::st_ready;
+                if (ready == file_readiness_t::st_wait)
+                    return TRIGGER_READY_INTERVAL;
+
+                script.b_trigger_settling = false;
+                script.trigger_file.refresh();
+                if (ready == file_readiness_t::st_gone)
+                    break;
+
+                // Delete the trigger file
+                if (!script.b_keep_trigger_file)
+                    qunlink(script.trigger_file.c_str());
+
+                // Always execute the main script even if it was not changed
+                script.invalidate();
+                // ...and proceed with QScript logic
+            }
+            //
+            // Trigger pipe mode
+            //
+            // Wait for a write to the pipe
+            else if (script.pipe_triggered())
+            {
+                if (!consume_trigger(script))
+                    break;
+
+                script.invalidate();
+            }
+
+            // Check the main script
+            mod_stat = work_script->get_modification_status();
+            if (   mod_stat != filemod_status_e::not_modified
+                && work_script == &script
+                && !script.trigger_based()
+                && !script.pipe_triggered())
+            {
+                on_change(script, script.file_path.c_str(), JF_SCRIPT);
+            }
+            if (mod_stat == filemod_status_e::not_found)
+            {
+                // Script no longer exists
+                on_gone(script, work_script->file_path.c_str());
+                break;
+            }
+
+            // Script or its dependencies changed?
+            if (dep_script_changed || mod_stat == filemod_status_e::modified)
+                on_execute(script, *work_script, dep_script_changed, mod_stat == filemod_status_e::modified);
+        } while (false);
+        return interval;
+    }
+};
@@ -0,0 +1,270 @@
+#pragma once
+
+//-------------------------------------------------------------------------
+// Execution statistics of the scripts (shown in the QScripts window).
+//
+// Each execution is split in phases: the reload directives of the changed
+// dependencies, the unload function (or the namespace teardown), the
+// compilation (which also runs Python scripts) and the IDC 'main' call.
+// The percentiles are computed over the most recent executions.
+static constexpr size_t STATS_WINDOW = 200; // executions kept per script for the percentiles
+
+enum exec_phase_e
+{
+    PHASE_RELOAD,
+    PHASE_UNLOAD,
+    PHASE_COMPILE,
+    PHASE_MAIN,
+    PHASE_COUNT
+};
+
+struct exec_phases_t
+{
+    uint64 ns[PHASE_COUNT] = {};
+
+    // Adds the time elapsed since 'start' to a phase and returns the current time stamp
+    uint64 add(int phase, uint64 start)
+    {
+        uint64 now = get_nsec_stamp();
+        ns[phase] += now - start;
+        return now;
+    }
+
+    double ms(int phase) const { return ns[phase] / 1000000.0; }
+};
+
+struct script_stats_t
+{
+    uint32 count = 0;
+    uint32 failures = 0;
+    bool last_ok = true;
+    double last_ms = 0;
+    exec_phases_t last_phases;
+    std::deque<double> recent_ms;
+
+    // Nearest-rank percentile of the recent durations (0 if none)
+    double percentile(int p) const
+    {
+        if (recent_ms.empty())
+            return 0;
+
+        std::vector<double> sorted(recent_ms.begin(), recent_ms.end());
+        std::sort(sorted.begin(), sorted.end());
+        size_t rank = (p * sorted.size() + 99) / 100;
+        return sorted[rank == 0 ? 0 : rank - 1];
+    }
+};
+
+class script_stats_db_t
+{
+    std::map<std::string, script_stats_t> stats;
+
+public:
+    void record(const char *file, bool ok, double duration_ms, const exec_phases_t &phases)
+    {
+        script_stats_t &st = stats[file];
+        ++st.count;
+        if (!ok)
+            ++st.failures;
+        st.last_ok     = ok;
+        st.last_ms     = duration_ms;
+        st.last_phases = phases;
+        st.recent_ms.push_back(duration_ms);
+        if (st.recent_ms.size() > STATS_WINDOW)
+            st.recent_ms.pop_front();
+    }
+
+    const script_stats_t *find(const char *file) const
+    {
+        auto p = stats.find(file);
+        return p == stats.end() ? nullptr : &p->second;
+    }
+
+    bool empty() const { return stats.empty(); }
+    void clear()       { stats.clear(); }
+
+    // Writes the statistics of all the executed scripts (and notebook cells) as CSV
+    bool export_csv(const char *path, qstring *errbuf) const
+    {
+        FILE *fp = qfopen(path, "w");
+        if (fp == nullptr)
+        {
+            errbuf->sprnt("cannot create '%s'", path);
+            return false;
+        }
+
+        qfprintf(fp, "script,runs,failures,last_ok,last_ms,p50_ms,p95_ms,last_reload_ms,last_unload_ms,last_compile_ms,last_main_ms\n");
+        for (auto &kv : stats)
+        {
+            const script_stats_t &st = kv.second;
+            qstring file = kv.first.c_str();
+            file.replace("\"", "\"\"");
+            qfprintf(fp, "\"%s\",%u,%u,%d,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+                file.c_str(),
+                st.count,
+                st.failures,
+                st.last_ok ? 1 : 0,
+                st.last_ms,
+                st.percentile(50),
+                st.percentile(95),
+                st.last_phases.ms(PHASE_RELOAD),
+                st.last_phases.ms(PHASE_UNLOAD),
+                st.last_phases.ms(PHASE_COMPILE),
+                st.last_phases.ms(PHASE_MAIN));
+        }
+        qfclose(fp);
+        return true;
+    }
+};
+
+//-------------------------------------------------------------------------
+// Persistent run history: each execution is appended to the script's
+// '.qscripts/<script>.runs.csv' log. A run is compared against the recent
+// successful runs on the same database and flagged when it is slower than
+// their p95 plus a margin, along with the content hash of the script.
+static constexpr size_t HISTORY_BASELINE_RUNS = 50;   // runs per database kept as the baseline
+static constexpr size_t HISTORY_MIN_BASELINE  = 10;   // runs needed before comparing
+static constexpr double HISTORY_MARGIN_PCT    = 20.0; // tolerated slowdown over the p95...
+static constexpr double HISTORY_MARGIN_MS     = 2.0;  // ...plus a fixed margin for very short runs
+
+class run_history_t
+{
+    struct baseline_t
+    {
+        std::deque<double> ms;  // successful runs, oldest first
+        qstring last_hash;
+    };
+
+    // Log file -> database -> baseline
+    std::map<std::string, std::map<std::string, baseline_t>> logs;
+
+    static qstring hash_file(const char *file)
+    {
+        // 64-bit FNV-1a of the content
+        uint64 h = 0xcbf29ce484222325ULL;
+        FILE *fp = qfopen(file, "rb");
+        if (fp == nullptr)
+            return "-";
+        uchar buf[16 * 1024];
+        ssize_t n;
+        while ((n = qfread(fp, buf, sizeof(buf))) > 0)
+        {
+            for (ssize_t i = 0; i < n; ++i)
+            {
+                h ^= buf[i];
+                h *= 0x100000001b3ULL;
+            }
+        }
+        qfclose(fp);
+        qstring hash;
+        hash.sprnt("%016" FMT_64 "x", h);
+        return hash;
+    }
+
+    static void add_to_baseline(baseline_t &b, const char *hash, bool ok, double ms)
+    {
+        b.last_hash = hash;
+        if (!ok)
+            return;
+        b.ms.push_back(ms);
+        if (b.ms.size() > HISTORY_BASELINE_RUNS)
+            b.ms.pop_front();
+    }
+
+    // Loads the baselines of a log file. Lines: time,hash,ok,duration_ms,<phases ms>,database
+    std::map<std::string, baseline_t> &load(const qstring &log_file)
+    {
+        auto p = logs.find(log_file.c_str());
+        if (p != logs.end())
+            return p->second;
+
+        auto &dbs = logs[log_file.c_str()];
+        FILE *fp = qfopen(log_file.c_str(), "r");
+        if (fp == nullptr)
+            return dbs;
+
+        char line[QMAXPATH + 256];
+        while (qfgets(line, sizeof(line), fp) != nullptr)
+        {
+            char hash[64];
+            int ok, db_pos = 0;
+            double ms, phase_ms[PHASE_COUNT];
+            if (sscanf(line, "%*[^,],%63[^,],%d,%lf,%lf,%lf,%lf,%lf,%n",
+                       hash, &ok, &ms, &phase_ms[0], &phase_ms[1], &phase_ms[2], &phase_ms[3], &db_pos) != 7
+                || db_pos == 0)
+            {
+                continue; // header or damaged line
+            }
+            qstring db = line + db_pos;
+            while (!db.empty() && (db.last() == '\n' || db.last() == '\r'))
+                db.remove_last();
+            add_to_baseline(dbs[db.c_str()], hash, ok != 0, ms);
+        }
+        qfclose(fp);
+        return dbs;
+    }
+
+public:
+    // Records a run and warns if it is slower than the baseline on the same database
+    void add_run(
+        const char *script_file,
+        const char *database,
+        bool ok,
+        double duration_ms,
+        const exec_phases_t &phases)
+    {
+        namespace fs = std::filesystem;
+        fs::path script_path(script_file);
+        fs::path log_dir = script_path.parent_path() / QSCRIPTS_LOCAL;
+        qstring log_file = (log_dir / (script_path.filename().string() + ".runs.csv")).string().c_str();
+
+        qstring hash = hash_file(script_file);
+        baseline_t &b = load(log_file)[database];
+
+        // Compare with the p95 of the baseline
+        if (ok && b.ms.size() >= HISTORY_MIN_BASELINE)
+        {
+            std::vector<double> sorted(b.ms.begin(), b.ms.end());
+            std::sort(sorted.begin(), sorted.end());
+            double p95 = sorted[(95 * sorted.size() + 99) / 100 - 1];
+            double limit = p95 * (1 + HISTORY_MARGIN_PCT / 100) + HISTORY_MARGIN_MS;
+            if (duration_ms > limit)
+            {
+                qstring origin;
+                if (b.last_hash != hash)
+                    origin.sprnt("the script changed: content hash %s, previously %s", hash.c_str(), b.last_hash.c_str());
+                else
+                    origin.sprnt("the script did not change: content hash %s", hash.c_str());
+                msg("QScripts performance regression: %s ran in %.2f ms, above the p95 of %.2f ms over its last %u runs on %s (%s)\n",
+                    qbasename(script_file),
+                    duration_ms,
+                    p95,
+                    uint(b.ms.size()),
+                    qbasename(database),
+                    origin.c_str());
+            }
+        }
+        add_to_baseline(b, hash.c_str(), ok, duration_ms);
+
+        // Append to the log
+        std::error_code ec;
+        fs::create_directories(log_dir, ec);
+        bool is_new = !fs::exists(log_file.c_str(), ec);
+        FILE *fp = qfopen(log_file.c_str(), "a");
+        if (fp == nullptr)
+            return;
+        if (is_new)
+            qfprintf(fp, "time,hash,ok,duration_ms,reload_ms,unload_ms,compile_ms,main_ms,database\n");
+        qfprintf(fp, "%" FMT_64 "d,%s,%d,%.3f,%.3f,%.3f,%.3f,%.3f,%s\n",
+            int64(qtime32()),
+            hash.c_str(),
+            ok ? 1 : 0,
+            duration_ms,
+            phases.ms(PHASE_RELOAD),
+            phases.ms(PHASE_UNLOAD),
+            phases.ms(PHASE_COMPILE),
+            phases.ms(PHASE_MAIN),
+            database);
+        qfclose(fp);
+    }
+};
@@ -0,0 +1,423 @@
+#pragma once
+
+//-------------------------------------------------------------------------
+// Session journal: a compact binary log of what the monitor observed (the
+// file changes it detected) and what it did (re-parses, reload directives
+// and executions), see the "Session journal" option. The replayer in bench/
+// drives the engine from a journal to reproduce the timing of a session.
+//
+// The file starts with JOURNAL_MAGIC, followed by records:
+//
+//   type (byte), time since the previous record (varint, microseconds), fields
+//
+// Integers are LEB128 varints, strings are a varint length and the bytes. Each
+// path is written once in a JR_PATH record and referenced by its index later.
+// The records are flushed as they are written, so the journal of a session
+// that ended abruptly is still readable.
+static constexpr char JOURNAL_MAGIC[] = "QSJ\x01";
+static constexpr size_t JOURNAL_MAGIC_LEN = 4;
+
+enum journal_record_e : uchar
+{
+    JR_PATH       = 1, // path
+    JR_SESSION    = 2, // start time (Unix, seconds)
+    JR_ACTIVATE   = 3, // script, monitor interval (ms), nfiles * (path, kind, mtime, content)
+    JR_DEACTIVATE = 4, // script
+    JR_CHANGE     = 5, // path, kind, mtime (0 if the file is gone), content (index files only)
+    JR_RELOAD     = 6, // dependency, ok
+    JR_EXEC       = 7, // executed file
+};
+
+// The role of a file for the active script
+enum journal_file_e : uchar
+{
+    JF_SCRIPT  = 0,
+    JF_INDEX   = 1,
+    JF_DEP     = 2,
+    JF_CELL    = 3,
+    JF_TRIGGER = 4,
+};
+
+struct journal_file_t
+{
+    qstring path;
+    int kind = JF_SCRIPT;
+    qtime64_t mtime = 0;
+    qstring content;
+};
+
+struct journal_record_t
+{
+    int type = 0;
+    uint64 t_us = 0;            // since the start of the journal
+    qstring path;               // the script, the changed file, the dependency or the executed file
+    int kind = JF_SCRIPT;
+    qtime64_t mtime = 0;
+    qstring content;
+    bool ok = false;
+    int interval_ms = 0;
+    uint64 start_time = 0;
+    std::vector<journal_file_t> files;
+};
+
+//-------------------------------------------------------------------------
+class session_journal_t
+{
+    FILE *fp = nullptr;
+    qstring path;
+    uint64 last_ns = 0;
+    std::unordered_map<std::string, uint64> path_ids;
+    std::string rec;
+
+    void put_varint(uint64 v)
+    {
+        do
+        {
+            uchar b = v & 0x7f;
+            v >>= 7;
+            rec += char(v != 0 ? b | 0x80 : b);
+        } while (v != 0);
+    }
+
+    void put_str(const qstring &s)
+    {
+        put_varint(s.length());
+        rec.append(s.c_str(), s.length());
+    }
+
+    // Writes the path record the first time a path is seen and returns its index
+    uint64 path_id(const char *file)
+    {
+        auto p = path_ids.find(file);
+        if (p != path_ids.end())
+            return p->second;
+
+        uint64 id = path_ids.size();
+        path_ids[file] = id;
+        begin(JR_PATH);
+        put_str(file);
+        return id;
+    }
+
+    void begin(uchar type)
+    {
+        uint64 now = get_nsec_stamp();
+        rec += char(type);
+        put_varint((now - last_ns) / 1000);
+        last_ns = now;
+    }
+
+    void commit()
+    {
+        qfwrite(fp, rec.data(), rec.size());
+        qfflush(fp);
+        rec.clear();
+    }
+
+    static qstring read_text(const char *file)
+    {
+        qstring text;
+        FILE *f = qfopen(file, "rb");
+        if (f == nullptr)
+            return text;
+        char buf[4096];
+        ssize_t n;
+        while ((n = qfread(f, buf, sizeof(buf))) > 0)
+            text.append(qstring(buf, n));
+        qfclose(f);
+        return text;
+    }
+
+    // Writes the fields of a file: path, kind, mtime and the content of the index files.
+    // Its path must have been written before the record started.
+    void put_file(const char *file, int kind)
+    {
+        qtime64_t mtime = 0;
+        get_file_modification_time(file, &mtime);
+        put_varint(path_id(file));
+        rec += char(kind);
+        put_varint(uint64(mtime));
+        put_str(kind == JF_INDEX && mtime != 0 ? read_text(file) : qstring());
+    }
+
+public:
+    ~session_journal_t()
+    {
+        stop();
+    }
+
+    bool start(const char *file, qstring *errbuf)
+    {
+        stop();
+        fp = qfopen(file, "wb");
+        if (fp == nullptr)
+        {
+            errbuf->sprnt("cannot create '%s'", file);
+            return false;
+        }
+        path = file;
+        path_ids.clear();
+        last_ns = get_nsec_stamp();
+        qfwrite(fp, JOURNAL_MAGIC, JOURNAL_MAGIC_LEN);
+        begin(JR_SESSION);
+        put_varint(uint64(qtime32()));
+        commit();
+        return true;
+    }
+
+    void stop()
+    {
+        if (fp == nullptr)
+            return;
+        qfclose(fp);
+        fp = nullptr;
+        path.clear();
+    }
+
+    bool is_enabled() const { return fp != nullptr; }
+    const qstring &get_path() const { return path; }
+
+    // Snapshots an active script after it was (re-)loaded: its files, their time-stamps and the index files
+    void activated(const active_script_info_t &script, int interval_ms)
+    {
+        if (fp == nullptr)
+            return;
+
+        std::vector<std::pair<const char *, int>> files;
+        files.emplace_back(script.file_path.c_str(), JF_SCRIPT);
+        for (auto &index : script.dep_indices)
+            files.emplace_back(index.file_path.c_str(), JF_INDEX);
+        for (auto &kv : script.dep_scripts)
+            files.emplace_back(kv.first.c_str(), JF_DEP);
+        for (auto &kv : script.notebook.cell_files)
+            files.emplace_back(kv.first.c_str(), JF_CELL);
+        if (script.trigger_based())
+            files.emplace_back(script.trigger_file.file_path.c_str(), JF_TRIGGER);
+
+        // The paths are written first, so the record itself only holds their indices
+        for (auto &f : files)
+            path_id(f.first);
+        uint64 script_id = path_id(script.file_path.c_str());
+        begin(JR_ACTIVATE);
+        put_varint(script_id);
+        put_varint(uint64(interval_ms));
+        put_varint(files.size());
+        for (auto &f : files)
+            put_file(f.first, f.second);
+        commit();
+    }
+
+    void deactivated(const char *script)
+    {
+        if (fp == nullptr)
+            return;
+        uint64 id = path_id(script);
+        begin(JR_DEACTIVATE);
+        put_varint(id);
+        commit();
+    }
+
+    // A change the monitor detected
+    void changed(const char *file, int kind)
+    {
+        if (fp == nullptr)
+            return;
+        path_id(file);
+        begin(JR_CHANGE);
+        put_file(file, kind);
+        commit();
+    }
+
+    void reloaded(const char *dep_file, bool ok)
+    {
+        if (fp == nullptr)
+            return;
+        uint64 id = path_id(dep_file);
+        begin(JR_RELOAD);
+        put_varint(id);
+        rec += char(ok ? 1 : 0);
+        commit();
+    }
+
+    void executed(const char *file)
+    {
+        if (fp == nullptr)
+            return;
+        uint64 id = path_id(file);
+        begin(JR_EXEC);
+        put_varint(id);
+        commit();
+    }
+};
+
+//-------------------------------------------------------------------------
+class session_journal_reader_t
+{
+    std::string data;
+    size_t pos = 0;
+    uint64 t_us = 0;
+    std::vector<qstring> paths;
+    bool truncated = false;
+
+    bool get_byte(uchar *b)
+    {
+        if (pos >= data.size())
+            return false;
+        *b = uchar(data[pos++]);
+        return true;
+    }
+
+    bool get_varint(uint64 *v)
+    {
+        *v = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            uchar b;
+            if (!get_byte(&b))
+                return false;
+            *v |= uint64(b & 0x7f) << shift;
+            if ((b & 0x80) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    bool get_str(qstring *s)
+    {
+        uint64 len;
+        if (!get_varint(&len) || len > data.size() - pos)
+            return false;
+        *s = qstring(data.data() + pos, size_t(len));
+        pos += size_t(len);
+        return true;
+    }
+
+    bool get_path(qstring *s)
+    {
+        uint64 id;
+        if (!get_varint(&id) || id >= paths.size())
+            return false;
+        *s = paths[size_t(id)];
+        return true;
+    }
+
+    bool get_file(journal_file_t *f)
+    {
+        uchar kind;
+        uint64 mtime;
+        if (!get_path(&f->path) || !get_byte(&kind) || !get_varint(&mtime) || !get_str(&f->content))
+            return false;
+        f->kind  = kind;
+        f->mtime = qtime64_t(mtime);
+        return true;
+    }
+
+    bool parse(journal_record_t *r)
+    {
+        uchar type;
+        uint64 dt;
+        if (!get_byte(&type) || !get_varint(&dt))
+            return false;
+        t_us += dt;
+        *r = journal_record_t();
+        r->type = type;
+        r->t_us = t_us;
+        switch (type)
+        {
+            case JR_PATH:
+                if (!get_str(&r->path))
+                    return false;
+                paths.push_back(r->path);
+                return true;
+            case JR_SESSION:
+                return get_varint(&r->start_time);
+            case JR_ACTIVATE:
+            {
+                uint64 interval, nfiles;
+                if (!get_path(&r->path) || !get_varint(&interval) || !get_varint(&nfiles))
+                    return false;
+                r->interval_ms = int(interval);
+                for (uint64 i = 0; i < nfiles; ++i)
+                {
+                    journal_file_t f;
+                    if (!get_file(&f))
+                        return false;
+                    r->files.push_back(std::move(f));
+                }
+                return true;
+            }
+            case JR_DEACTIVATE:
+            case JR_EXEC:
+                return get_path(&r->path);
+            case JR_CHANGE:
+            {
+                journal_file_t f;
+                if (!get_file(&f))
+                    return false;
+                r->path    = f.path;
+                r->kind    = f.kind;
+                r->mtime   = f.mtime;
+                r->content = f.content;
+                return true;
+            }
+            case JR_RELOAD:
+            {
+                uchar ok;
+                if (!get_path(&r->path) || !get_byte(&ok))
+                    return false;
+                r->ok = ok != 0;
+                return true;
+            }
+        }
+        return false;
+    }
+
+public:
+    bool open(const char *file, qstring *errbuf)
+    {
+        FILE *fp = qfopen(file, "rb");
+        if (fp == nullptr)
+        {
+            errbuf->sprnt("cannot open '%s'", file);
+            return false;
+        }
+        data.clear();
+        char buf[16 * 1024];
+        ssize_t n;
+        while ((n = qfread(fp, buf, sizeof(buf))) > 0)
+            data.append(buf, size_t(n));
+        qfclose(fp);
+
+        if (data.size() < JOURNAL_MAGIC_LEN || memcmp(data.data(), JOURNAL_MAGIC, JOURNAL_MAGIC_LEN) != 0)
+        {
+            errbuf->sprnt("'%s' is not a QScripts session journal", file);
+            return false;
+        }
+        pos = JOURNAL_MAGIC_LEN;
+        t_us = 0;
+        paths.clear();
+        truncated = false;
+        return true;
+    }
+
+    // Reads the next record (the path records are resolved and skipped)
+    bool next(journal_record_t *r)
+    {
+        while (pos < data.size())
+        {
+            size_t start = pos;
+            if (!parse(r))
+            {
+                // A record cut short by the end of the session or an unknown record
+                truncated = start < data.size();
+                pos = data.size();
+                return false;
+            }
+            if (r->type != JR_PATH)
+                return true;
+        }
+        return false;
+    }
+
+    bool is_truncated() const { return truncated; }
+};
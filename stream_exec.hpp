@@ -0,0 +1,436 @@
+#pragma once
+
+//-------------------------------------------------------------------------
+// Streaming execution of very large (usually generated) scripts.
+//
+// The script is split into statement-aligned chunks that are evaluated one
+// after the other with the language's snippet evaluator. Progress is shown
+// in a wait box and the user can cancel between chunks.
+//
+// Supported layouts:
+//  - Python: any file made of top-level statements
+//  - IDC: a file whose 'static main()' body is a flat list of statements
+//    (other functions in the file are compiled first)
+//
+// Python scripts that run in an isolated namespace have their chunks executed
+// in that namespace's module instead of '__main__'.
+static constexpr size_t STREAM_CHUNK_SIZE        = 64 * 1024;
+static constexpr uint64 STREAM_PROGRESS_INTERVAL = 100 * 1000000ULL; // 100ms in ns
+
+struct script_chunk_t
+{
+    size_t offset;
+    size_t length;
+    int first_line;
+};
+using script_chunks_t = qvector<script_chunk_t>;
+
+class script_streamer_t
+{
+public:
+    enum result_e
+    {
+        res_ok,
+        res_failed,
+        res_cancelled,
+        res_unsupported,
+    };
+
+private:
+    qstring source;
+    qstring preamble;
+    script_chunks_t chunks;
+    int total_lines = 0;
+
+    static bool read_file(const char *file_path, qstring &out)
+    {
+        FILE *fp = qfopen(file_path, "rb");
+        if (fp == nullptr)
+            return false;
+
+        qstatbuf st;
+        bool ok = qstat(file_path, &st) == 0;
+        if (ok)
+        {
+            out.resize(size_t(st.qst_size));
+            ok = out.empty() || qfread(fp, out.begin(), out.size()) == ssize_t(out.size());
+        }
+        qfclose(fp);
+        return ok;
+    }
+
+    static bool starts_with_keyword(const char *p, const char *end, const char *kw)
+    {
+        size_t len = strlen(kw);
+        if (size_t(end - p) < len || strncmp(p, kw, len) != 0)
+            return false;
+        return p + len == end || !(qisalnum(p[len]) || p[len] == '_');
+    }
+
+    // Scans the text in [begin, end) and records the offsets of the lines that start a new statement.
+    // The scanner understands strings, comments and brackets nesting well enough for generated scripts.
+    static void find_statement_starts(
+        const char *begin,
+        const char *end,
+        bool is_idc,
+        int first_line,
+        qvector<std::pair<size_t, int>> &starts)
+    {
+        int depth = 0;
+        int line = first_line;
+        char quote = 0;
+        bool triple = false;
+        bool block_cmt = false;
+        bool backslash_cont = false;
+        bool after_decorator = false;
+        char last_sig = ';';
+
+        for (const char *p = begin; p < end; )
+        {
+            // Start of a line: decide if this is a statement boundary
+            if (p == begin || p[-1] == '\n')
+            {
+                char c = *p;
+                bool line_starts_stmt = depth == 0 && quote == 0 && !block_cmt && !backslash_cont;
+                if (line_starts_stmt)
+                {
+                    if (is_idc)
+                    {
+                        // IDC statements end with ';' or '}'
+                        const char *q = p;
+                        while (q < end && (*q == ' ' || *q == '\t'))
+                            ++q;
+                        line_starts_stmt =    (last_sig == ';' || last_sig == '}')
+                                           && q < end && *q != '\r' && *q != '\n' && *q != '/'
+                                           && !starts_with_keyword(q, end, "else");
+                    }
+                    else
+                    {
+                        // Python statements start at column 0
+                        line_starts_stmt =    c != ' ' && c != '\t' && c != '\r' && c != '\n' && c != '#'
+                                           && !starts_with_keyword(p, end, "else")
+                                           && !starts_with_keyword(p, end, "elif")
+                                           && !starts_with_keyword(p, end, "except")
+                                           && !starts_with_keyword(p, end, "finally");
+                    }
+                }
+                if (line_starts_stmt)
+                {
+                    // Keep decorators together with the definition that follows them
+                    if (!after_decorator)
+                        starts.push_back({ size_t(p - begin), line });
+                    after_decorator = !is_idc && c == '@';
+                }
+                backslash_cont = false;
+            }
+
+            char c = *p;
+            if (block_cmt)
+            {
+                if (c == '*' && p + 1 < end && p[1] == '/')
+                    block_cmt = false, ++p;
+            }
+            else if (quote != 0)
+            {
+                if (c == '\\')
+                {
+                    if (p + 1 < end && p[1] == '\n')
+                        ++line;
+                    ++p;
+                }
+                else if (c == quote)
+                {
+                    if (!triple)
+                        quote = 0;
+                    else if (p + 2 < end && p[1] == quote && p[2] == quote)
+                        quote = 0, triple = false, p += 2;
+                }
+                else if (c == '\n' && !triple)
+                {
+                    // Unterminated string literal: resynchronize at the end of the line
+                    quote = 0;
+                }
+            }
+            else if (c == '"' || c == '\'')
+            {
+                quote = c;
+                triple = !is_idc && p + 2 < end && p[1] == c && p[2] == c;
+                if (triple)
+                    p += 2;
+                last_sig = c;
+            }
+            else if (is_idc && c == '/' && p + 1 < end && p[1] == '/')
+            {
+                while (p + 1 < end && p[1] != '\n')
+                    ++p;
+            }
+            else if (is_idc && c == '/' && p + 1 < end && p[1] == '*')
+            {
+                block_cmt = true;
+                ++p;
+            }
+            else if (!is_idc && c == '#')
+            {
+                while (p + 1 < end && p[1] != '\n')
+                    ++p;
+            }
+            else if (c == '\\' && p + 1 < end && (p[1] == '\n' || p[1] == '\r'))
+            {
+                backslash_cont = true;
+            }
+            else if (c == '(' || c == '[' || c == '{')
+            {
+                ++depth;
+                last_sig = c;
+            }
+            else if (c == ')' || c == ']' || c == '}')
+            {
+                if (depth > 0)
+                    --depth;
+                last_sig = c;
+            }
+            else if (c != ' ' && c != '\t' && c != '\r' && c != '\n')
+            {
+                last_sig = c;
+            }
+
+            if (c == '\n')
+                ++line;
+            ++p;
+        }
+    }
+
+    // Locates the body of 'static main()' and returns its [begin, end) offsets.
+    // Everything outside of main() is returned in the preamble.
+    bool split_idc_main(size_t &body_begin, size_t &body_end, int &body_line)
+    {
+        static const std::regex RE_MAIN(R"(static\s+main\s*\(\s*\)\s*\{)");
+        std::cmatch m;
+        if (!std::regex_search(source.c_str(), source.c_str() + source.size(), m, RE_MAIN))
+            return false;
+
+        body_begin = size_t(m.position(0) + m.length(0));
+
+        // Find the matching closing brace
+        int depth = 1;
+        char quote = 0;
+        const char *p = source.begin() + body_begin;
+        const char *end = source.end();
+        for (; p < end && depth > 0; ++p)
+        {
+            char c = *p;
+            if (quote != 0)
+            {
+                if (c == '\\')
+                    ++p;
+                else if (c == quote)
+                    quote = 0;
+            }
+            else if (c == '"' || c == '\'')
+                quote = c;
+            else if (c == '/' && p + 1 < end && p[1] == '/')
+                for (; p + 1 < end && p[1] != '\n'; ++p);
+            else if (c == '/' && p + 1 < end && p[1] == '*')
+                for (p += 2; p + 1 < end && !(p[0] == '*' && p[1] == '/'); ++p);
+            else if (c == '{')
+                ++depth;
+            else if (c == '}')
+                --depth;
+        }
+        if (depth != 0)
+            return false;
+
+        body_end = size_t(p - source.begin()) - 1;
+        body_line = 1 + int(std::count(source.begin(), source.begin() + body_begin, '\n'));
+
+        // The rest of the file is compiled as is, without main()
+        preamble.qclear();
+        preamble.append(source.begin(), size_t(m.position(0)));
+        preamble.append(source.begin() + body_end + 1, source.size() - body_end - 1);
+        return true;
+    }
+
+    // Maps a line number reported by the interpreter for a chunk back to the script file
+    static int map_error_line(const qstring &err, bool is_idc, const script_chunk_t &chunk)
+    {
+        static const std::regex RE_PY_LINE(R"x("<string>", line (\d+))x");
+        static const std::regex RE_IDC_LINE(R"([Ll]ine (\d+))");
+
+        std::cmatch m;
+        if (std::regex_search(err.c_str(), err.c_str() + err.size(), m, is_idc ? RE_IDC_LINE : RE_PY_LINE))
+            return chunk.first_line + atoi(m.str(1).c_str()) - 1;
+
+        return chunk.first_line;
+    }
+
+    // Python code that runs 'code' in the module of namespace 'ns'
+    static qstring make_ns_snippet(const char *ns, const char *code)
+    {
+        qstring snippet;
+        snippet.sprnt(
+            "exec(compile(%s, '<string>', 'exec'), "
+            "__import__('sys').modules.setdefault('%s', __import__('types').ModuleType('%s')).__dict__)",
+            make_py_str_literal(code).c_str(),
+            ns,
+            ns);
+        return snippet;
+    }
+
+    bool build_chunks(bool is_idc, qstring &err)
+    {
+        chunks.qclear();
+        preamble.qclear();
+
+        size_t body_begin = 0, body_end = source.size();
+        int body_line = 1;
+        if (is_idc && !split_idc_main(body_begin, body_end, body_line))
+        {
+            err = "no flat 'static main()' function found";
+            return false;
+        }
+
+        qvector<std::pair<size_t, int>> starts;
+        find_statement_starts(
+            source.begin() + body_begin,
+            source.begin() + body_end,
+            is_idc,
+            body_line,
+            starts);
+
+        // Local variables would not survive from one chunk to the next
+        if (is_idc)
+        {
+            for (auto &st : starts)
+            {
+                const char *q = source.begin() + body_begin + st.first;
+                while (*q == ' ' || *q == '\t')
+                    ++q;
+                if (starts_with_keyword(q, source.end(), "auto"))
+                {
+                    err.sprnt("line %d declares local variables with 'auto'", st.second);
+                    return false;
+                }
+            }
+        }
+
+        // Group the statements into chunks of roughly STREAM_CHUNK_SIZE bytes
+        for (size_t i = 0; i < starts.size(); )
+        {
+            script_chunk_t chunk;
+            chunk.offset = body_begin + starts[i].first;
+            chunk.first_line = starts[i].second;
+
+            size_t j = i + 1;
+            while (j < starts.size() && starts[j].first - starts[i].first < STREAM_CHUNK_SIZE)
+                ++j;
+
+            size_t chunk_end = j < starts.size() ? body_begin + starts[j].first : body_end;
+            chunk.length = chunk_end - chunk.offset;
+            chunks.push_back(chunk);
+            i = j;
+        }
+
+        total_lines = 1 + int(std::count(source.begin(), source.end(), '\n'));
+        return true;
+    }
+
+public:
+    // Executes the script chunk by chunk. Returns res_unsupported when the script layout
+    // does not lend itself to streaming so the caller can fall back to a regular execution.
+    // 'ns' is the namespace of an isolated Python script (nullptr for '__main__').
+    result_e execute(
+        extlang_object_t &elang,
+        const char *script_file,
+        qstring &errbuf,
+        const char *ns = nullptr)
+    {
+        if (!read_file(script_file, source))
+        {
+            errbuf.sprnt("QScripts failed to read script file: '%s'\n", script_file);
+            return res_failed;
+        }
+
+        bool is_idc = elang->is_idc();
+        qstring why;
+        if (!build_chunks(is_idc, why))
+        {
+            errbuf.sprnt("QScripts cannot stream '%s': %s\n", script_file, why.c_str());
+            source.qclear();
+            return res_unsupported;
+        }
+
+        // Compile the helper functions of IDC scripts. Python scripts get their '__file__' instead.
+        bool ok;
+        qstring err;
+        if (is_idc)
+        {
+            ok = preamble.empty() || compile_idc_text(preamble.c_str(), &err);
+        }
+        else
+        {
+            qstring snippet;
+            snippet.sprnt("__file__ = %s", make_py_str_literal(script_file).c_str());
+            if (ns != nullptr)
+                snippet = make_ns_snippet(ns, snippet.c_str());
+            ok = elang->eval_snippet(snippet.c_str(), &err);
+        }
+        if (!ok)
+        {
+            errbuf.sprnt("QScripts failed to prepare script file '%s' for streaming:\n%s", script_file, err.c_str());
+            source.qclear();
+            return res_failed;
+        }
+
+        result_e res = res_ok;
+        show_wait_box("QScripts: streaming %s", qbasename(script_file));
+
+        uint64 last_progress = get_nsec_stamp();
+        qstring chunk_text;
+        for (size_t i = 0; i < chunks.size(); ++i)
+        {
+            auto &chunk = chunks[i];
+            chunk_text.qclear();
+            chunk_text.append(source.begin() + chunk.offset, chunk.length);
+            if (ns != nullptr)
+                chunk_text = make_ns_snippet(ns, chunk_text.c_str());
+
+            if (!elang->eval_snippet(chunk_text.c_str(), &err))
+            {
+                errbuf.sprnt(
+                    "QScripts failed to execute '%s' at line %d:\n%s",
+                    script_file,
+                    map_error_line(err, is_idc, chunk),
+                    err.c_str());
+                res = res_failed;
+                break;
+            }
+
+            if (user_cancelled())
+            {
+                errbuf.sprnt(
+                    "QScripts: streaming of '%s' cancelled before line %d\n",
+                    script_file,
+                    i + 1 < chunks.size() ? chunks[i + 1].first_line : total_lines);
+                res = res_cancelled;
+                break;
+            }
+
+            uint64 now = get_nsec_stamp();
+            if (now - last_progress >= STREAM_PROGRESS_INTERVAL)
+            {
+                last_progress = now;
+                replace_wait_box(
+                    "QScripts: streaming %s\n%d%% (line %d of %d)",
+                    qbasename(script_file),
+                    int(100 * (i + 1) / chunks.size()),
+                    chunk.first_line,
+                    total_lines);
+            }
+        }
+        hide_wait_box();
+
+        source.qclear();
+        chunks.qclear();
+        return res;
+    }
+};
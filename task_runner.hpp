@@ -0,0 +1,144 @@
+#pragma once
+
+//-------------------------------------------------------------------------
+// Runs a native module's cooperative task (see qscripts_task.hpp) in time
+// slices from a timer on the main thread. The module stays loaded until
+// the task finishes or is cancelled.
+static constexpr int TASK_SLICE_BUDGET   = 20; // ms of work per slice
+static constexpr int TASK_SLICE_INTERVAL = 10; // ms left to the UI between slices
+
+class native_task_runner_t
+{
+    std::unique_ptr<native_module_t> module;
+    qscripts_task_abi_t abi = {};
+    qtimer_t timer = nullptr;
+    qstring name;
+    uint64 start_ns = 0;
+    int nslices = 0;
+    int last_percent = -1;
+
+    // Called when the progress changed by at least a percent and when the task is over
+    std::function<void()> on_update;
+
+    // Called once when the task is over: finished, failed or cancelled
+    std::function<void(bool ok, bool cancelled)> on_done;
+
+    static int idaapi s_timer_cb(void *ud)
+    {
+        return ((native_task_runner_t *)ud)->tick();
+    }
+
+    void release()
+    {
+        if (abi.task != nullptr)
+        {
+            abi.destroy(abi.task);
+            abi.task = nullptr;
+        }
+        module.reset();
+    }
+
+    void finish(bool ok, bool cancelled)
+    {
+        auto done_cb = std::move(on_done);
+        on_done = nullptr;
+        if (done_cb)
+            done_cb(ok, cancelled);
+        if (on_update)
+            on_update();
+    }
+
+    int tick()
+    {
+        ++nslices;
+        if (abi.resume(abi.task, uint64(TASK_SLICE_BUDGET) * 1000) != 0)
+        {
+            int percent = get_percent();
+            if (percent != last_percent)
+            {
+                last_percent = percent;
+                if (on_update)
+                    on_update();
+            }
+            return TASK_SLICE_INTERVAL;
+        }
+
+        bool ok = abi.succeeded(abi.task) != 0;
+        msg("QScripts task %s %s in %.2f ms (%d slice(s))\n",
+            name.c_str(),
+            ok ? "finished" : "failed",
+            (get_nsec_stamp() - start_ns) / 1000000.0,
+            nslices);
+
+        timer = nullptr;
+        release();
+        finish(ok, false);
+        return -1;
+    }
+
+public:
+    // Starts the task exported by a loaded module and takes ownership of the module
+    bool start(
+        std::unique_ptr<native_module_t> mod,
+        qscripts_task_start_t start_fn,
+        size_t arg,
+        const char *task_name,
+        std::function<void()> update_cb,
+        std::function<void(bool ok, bool cancelled)> done_cb,
+        qstring *errbuf)
+    {
+        cancel();
+
+        abi = {};
+        abi.version = QSCRIPTS_TASK_ABI_VERSION;
+        if (start_fn(arg, &abi) == 0 || abi.task == nullptr)
+        {
+            errbuf->sprnt("the task could not be started (task interface version %d expected)", QSCRIPTS_TASK_ABI_VERSION);
+            abi.task = nullptr;
+            return false;
+        }
+
+        module    = std::move(mod);
+        name      = task_name;
+        on_update = std::move(update_cb);
+        on_done   = std::move(done_cb);
+        start_ns  = get_nsec_stamp();
+        nslices   = 0;
+        last_percent = -1;
+        timer = register_timer(TASK_SLICE_INTERVAL, s_timer_cb, this);
+        return true;
+    }
+
+    // Destroys the task at its current suspension point and unloads the module
+    void cancel()
+    {
+        if (!is_running())
+            return;
+
+        if (timer != nullptr)
+        {
+            unregister_timer(timer);
+            timer = nullptr;
+        }
+        release();
+        msg("QScripts task %s cancelled after %d slice(s)\n", name.c_str(), nslices);
+        finish(false, true);
+    }
+
+    bool is_running() const { return abi.task != nullptr; }
+
+    // Returns the progress in percent or -1 if unknown
+    int get_percent() const
+    {
+        double progress = is_running() ? abi.progress(abi.task) : -1.0;
+        return progress < 0 ? -1 : int(qmin(progress, 1.0) * 100);
+    }
+
+    ~native_task_runner_t()
+    {
+        if (timer != nullptr)
+            unregister_timer(timer);
+        timer = nullptr;
+        release();
+    }
+};
@@ -0,0 +1,5 @@
+# Runs in a headless idalib worker, once per database of the corpus
+import idautils
+
+count = sum(1 for _ in idautils.Functions())
+print('functions: %d' % count)
@@ -0,0 +1,17 @@
+# Stand-in for the idalib worker: usage: stub_analyzer.py <database> <script>
+import os, sys, time
+
+db, script = sys.argv[1], sys.argv[2]
+name = os.path.splitext(os.path.basename(db))[0]
+print('analyzing %s with %s' % (name, os.path.basename(script)))
+
+buf = bytearray((200 if name == 'big' else 20) * 1024 * 1024)
+time.sleep(0.5)
+
+if name == 'crash':
+    print('Traceback (most recent call last): simulated failure')
+    sys.exit(1)
+if name == 'hang':
+    time.sleep(3600)
+
+print('functions: %d' % (len(name) * 100))
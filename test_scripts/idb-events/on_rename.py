@@ -0,0 +1,13 @@
+import idc
+from __qscripts__ import idb_events, idb_events_truncated
+
+for ea in idb_events.get('rename', []):
+    print(f"renamed: {ea:#x} -> {idc.get_name(ea)}")
+
+for ea in idb_events.get('cmt', []):
+    print(f"commented: {ea:#x}")
+
+if idb_events_truncated:
+    print("(some addresses were dropped)")
+
+print("----------------------")
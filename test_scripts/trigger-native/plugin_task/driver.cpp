@@ -0,0 +1,39 @@
+#include "idasdk.h"
+
+extern qscripts::task main_task(size_t);
+
+//--------------------------------------------------------------------------
+// When loaded as a regular plugin (and not with the '/native' directive),
+// run the task to completion
+struct plugin_ctx_t : public plugmod_t
+{
+    bool idaapi run(size_t arg) override
+    {
+        qscripts_task_abi_t abi = {};
+        abi.version = QSCRIPTS_TASK_ABI_VERSION;
+        if (qscripts::detail::start(main_task(arg), &abi) == 0)
+            return false;
+
+        // A time budget of one day: never suspend
+        constexpr uint64_t budget_us = uint64_t(24) * 3600 * 1000000;
+        while (abi.resume(abi.task, budget_us) != 0)
+            ;
+        bool ok = abi.succeeded(abi.task) != 0;
+        abi.destroy(abi.task);
+        return ok;
+    }
+};
+
+//--------------------------------------------------------------------------
+plugin_t PLUGIN =
+{
+  IDP_INTERFACE_VERSION,
+  PLUGIN_UNL | PLUGIN_MULTI,
+  []()->plugmod_t* {return new plugin_ctx_t; },
+  nullptr,
+  nullptr,
+  nullptr,
+  nullptr,
+  "QScripts native task driver",
+  nullptr,
+};
@@ -0,0 +1,13 @@
+#pragma warning(push)
+#pragma warning(disable: 4244 4267)
+
+#include <ida.hpp>
+#include <idp.hpp>
+#include <loader.hpp>
+#include <kernwin.hpp>
+#include <name.hpp>
+#include <funcs.hpp>
+// Include more headers here...
+#pragma warning(pop)
+
+#include <qscripts_task.hpp>
@@ -0,0 +1,25 @@
+#include "idasdk.h"
+
+// Counts the instructions of all the functions. The task yields after each
+// function so QScripts can run it in time slices without freezing the UI.
+qscripts::task main_task(size_t)
+{
+    size_t nfuncs = get_func_qty();
+    size_t ninsns = 0;
+    for (size_t i = 0; i < nfuncs; ++i)
+    {
+        func_t *func = getn_func(i);
+        if (func == nullptr)
+            continue;
+
+        func_item_iterator_t fii;
+        for (bool ok = fii.set(func); ok; ok = fii.next_code())
+            ++ninsns;
+
+        co_await qscripts::yield(double(i + 1) / nfuncs);
+    }
+
+    msg("%zu instruction(s) in %zu function(s)\n", ninsns, nfuncs);
+    co_return true;
+}
+QSCRIPTS_TASK_MAIN(main_task)
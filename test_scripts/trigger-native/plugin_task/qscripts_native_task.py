@@ -0,0 +1,3 @@
+# The '/native' directive in the dependency file makes QScripts load the plugin
+# each time it is rebuilt and run its cooperative task in time slices.
+# This script is only activated and is not executed.
@@ -1,12 +1,8 @@
-import time
-
-# Give the linker time to finish flushing the binary
-time.sleep(1)
-
-# Optionally clear the screen:
-#idaapi.msg_clear()
-
-# Load your plugin and pass any arg value you want
-idaapi.load_and_run_plugin('qscripts_native', 0)
-
-# Optionally, do post work, etc.
\ No newline at end of file
+# The '/native' directive in the dependency file makes QScripts load and run
+# the plugin directly each time it is rebuilt. This script is only activated
+# and is not executed.
+#
+# Without the '/native' directive, use '/triggerfile /keep <plugin>' instead
+# and load the plugin from here:
+#
+# idaapi.load_and_run_plugin('qscripts_native', 0)
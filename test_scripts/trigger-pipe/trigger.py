@@ -0,0 +1,5 @@
+import sys
+
+print(f"triggered with arguments: {sys.argv[1:]}")
+
+print("----------------------")
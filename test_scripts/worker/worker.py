@@ -0,0 +1,12 @@
+# This script runs in a headless idalib worker process against a copy of the database.
+# Crashing or hanging here does not affect the interactive IDA session.
+import idautils
+import ida_funcs
+
+count = 0
+with open('functions.csv', 'w') as f:
+    for ea in idautils.Functions():
+        f.write('%x,%s\n' % (ea, ida_funcs.get_func_name(ea)))
+        count += 1
+
+print('Exported %d function(s)' % count)
@@ -0,0 +1,189 @@
+#pragma once
+
+//-------------------------------------------------------------------------
+// Chrome trace-event recorder of the monitor and execution pipeline (see the
+// "Trace file" option). The trace can be opened in Perfetto or chrome://tracing.
+//
+// Each span is written as a complete ("X") event as soon as it ends. The file
+// holds a JSON array whose closing bracket is optional in the trace-event
+// format, so a trace cut short by a crash is still readable. Once the file
+// grows past TRACE_MAX_FILE_SIZE, it is renamed to '<file>.1' and a new one
+// is started.
+//
+// When tracing is disabled, a span costs a single test.
+static constexpr uint64 TRACE_MAX_FILE_SIZE = 32 * 1024 * 1024;
+
+class trace_recorder_t
+{
+    FILE *fp = nullptr;
+    qstring path;
+    uint64 base_ns = 0;
+    uint64 written = 0;
+
+    bool open(qstring *errbuf)
+    {
+        fp = qfopen(path.c_str(), "wb");
+        if (fp == nullptr)
+        {
+            errbuf->sprnt("cannot create '%s'", path.c_str());
+            return false;
+        }
+
+        json_t args = json_t::object();
+        args.set("name", "IDA (QScripts)");
+        json_t ev = json_t::object();
+        ev.set("name", "process_name");
+        ev.set("ph", "M");
+        ev.set("pid", qgetpid());
+        ev.set("tid", 0);
+        ev.set("args", std::move(args));
+
+        qstring line = "[\n";
+        ev.dump(line);
+        write(line);
+        return true;
+    }
+
+    void close()
+    {
+        if (fp == nullptr)
+            return;
+        write("\n]\n");
+        qfclose(fp);
+        fp = nullptr;
+    }
+
+    void write(const qstring &text)
+    {
+        written += qfwrite(fp, text.c_str(), text.length());
+    }
+
+    void rotate()
+    {
+        close();
+        qstring old_path = path + ".1";
+        qunlink(old_path.c_str());
+        qrename(path.c_str(), old_path.c_str());
+
+        qstring err;
+        written = 0;
+        if (!open(&err))
+            msg("QScripts stopped tracing: %s\n", err.c_str());
+    }
+
+public:
+    ~trace_recorder_t()
+    {
+        stop();
+    }
+
+    bool start(const char *file, qstring *errbuf)
+    {
+        stop();
+        path = file;
+        written = 0;
+        base_ns = get_nsec_stamp();
+        return open(errbuf);
+    }
+
+    void stop()
+    {
+        close();
+        path.clear();
+    }
+
+    bool is_enabled() const { return fp != nullptr; }
+    const qstring &get_path() const { return path; }
+
+    // Writes a span. 'args' is an object or null.
+    void complete(
+        const char *name,
+        const char *cat,
+        uint64 start_ns,
+        uint64 end_ns,
+        json_t args)
+    {
+        if (fp == nullptr)
+            return;
+
+        json_t ev = json_t::object();
+        ev.set("name", name);
+        ev.set("cat", cat);
+        ev.set("ph", "X");
+        ev.set("ts", (start_ns - base_ns) / 1000.0);
+        ev.set("dur", (end_ns - start_ns) / 1000.0);
+        ev.set("pid", qgetpid());
+        ev.set("tid", 0);
+        if (!args.is_null())
+            ev.set("args", std::move(args));
+
+        qstring line = ",\n";
+        ev.dump(line);
+        write(line);
+        qfflush(fp);
+        if (written > TRACE_MAX_FILE_SIZE)
+            rotate();
+    }
+};
+
+static trace_recorder_t g_trace;
+
+//-------------------------------------------------------------------------
+// Scoped span: recorded when it goes out of scope (or when it is ended)
+class trace_span_t
+{
+    const char *name;
+    const char *cat;
+    uint64 start_ns = 0;
+    json_t args;
+
+public:
+    trace_span_t(
+        const char *name,
+        const char *cat,
+        const char *file = nullptr,
+        const char *extlang = nullptr) : name(name), cat(cat)
+    {
+        if (!g_trace.is_enabled())
+            return;
+
+        start_ns = get_nsec_stamp();
+        if (file != nullptr)
+            arg("file", file);
+        if (extlang != nullptr)
+            arg("extlang", extlang);
+    }
+
+    ~trace_span_t()
+    {
+        end();
+    }
+
+    bool is_active() const { return start_ns != 0; }
+
+    // Attaches an argument to the span (ignored when tracing is disabled)
+    trace_span_t &arg(const char *key, json_t value)
+    {
+        if (is_active())
+        {
+            if (args.is_null())
+                args = json_t::object();
+            args.set(key, std::move(value));
+        }
+        return *this;
+    }
+
+    // Drops the span (for example, when a monitor tick had nothing to do)
+    void discard()
+    {
+        start_ns = 0;
+    }
+
+    void end()
+    {
+        if (!is_active())
+            return;
+        g_trace.complete(name, cat, start_ns, get_nsec_stamp(), std::move(args));
+        start_ns = 0;
+    }
+};
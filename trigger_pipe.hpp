@@ -0,0 +1,297 @@
+#pragma once
+
+//-------------------------------------------------------------------------
+// Trigger pipe: a named pipe (FIFO) that wakes up QScripts as soon as
+// something is written to it.
+//
+// - POSIX: the FIFO is created if needed. Each line written to it is a trigger
+//   event and the line's text is the payload. A trailing line without a new
+//   line character is flushed after a short idle time.
+// - Windows: a named pipe (\\.\pipe\name). Each client connection is a
+//   trigger event and everything written during the connection is the payload.
+//
+// The listener runs in a background thread. Events are handed over to the
+// main thread with execute_sync() so that no IDA API is called from the thread.
+static constexpr int TRIGGER_PIPE_IDLE_FLUSH = 20; // ms
+
+class trigger_pipe_t
+{
+    struct wake_req_t : public exec_request_t
+    {
+        trigger_pipe_t *owner = nullptr;
+        ssize_t idaapi execute() override
+        {
+            owner->on_wake();
+            return 0;
+        }
+    } wake_req;
+
+    qstring path;
+    qthread_t thread = nullptr;
+    qmutex_t lock = nullptr;
+    std::atomic<bool> stop_requested{ false };
+    std::atomic<int> last_req_id{ -1 };
+    std::atomic<bool> wake_queued{ false };
+
+    // Protected by 'lock'
+    qstring payload;
+    bool b_pending = false;
+
+    std::function<void()> on_trigger;
+
+#ifdef __NT__
+    HANDLE h_pipe = INVALID_HANDLE_VALUE;
+#else
+    int fd_fifo = -1;
+    int stop_fds[2] = { -1, -1 };
+#endif
+
+    static int idaapi s_thread_cb(void *ud)
+    {
+        ((trigger_pipe_t *)ud)->listen();
+        return 0;
+    }
+
+    // Called from the listener thread
+    void post(const char *data, size_t len)
+    {
+        {
+            qmutex_locker_t guard(lock);
+            payload.qclear();
+            payload.append(data, len);
+            payload.trim2();
+            b_pending = true;
+        }
+
+        // At most one wake up request is queued at any time
+        if (!stop_requested && !wake_queued.exchange(true))
+            last_req_id = execute_sync(wake_req, MFF_WRITE | MFF_NOWAIT);
+    }
+
+    // Called on the main thread
+    void on_wake()
+    {
+        wake_queued = false;
+        if (!stop_requested && on_trigger)
+            on_trigger();
+    }
+
+    void listen()
+    {
+#ifdef __NT__
+        qstring data;
+        while (!stop_requested)
+        {
+            if (!ConnectNamedPipe(h_pipe, nullptr) && GetLastError() != ERROR_PIPE_CONNECTED)
+                break;
+
+            data.qclear();
+            char buf[4096];
+            DWORD nread;
+            while (ReadFile(h_pipe, buf, sizeof(buf), &nread, nullptr) && nread > 0)
+                data.append(buf, nread);
+            DisconnectNamedPipe(h_pipe);
+
+            if (!stop_requested)
+                post(data.c_str(), data.length());
+        }
+#else
+        qstring data;
+        while (!stop_requested)
+        {
+            pollfd fds[2] = { { fd_fifo, POLLIN, 0 }, { stop_fds[0], POLLIN, 0 } };
+            int r = poll(fds, 2, data.empty() ? -1 : TRIGGER_PIPE_IDLE_FLUSH);
+            if (r < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                break;
+            }
+            if (fds[1].revents != 0)
+                break;
+
+            // Idle: flush the incomplete line
+            if (r == 0)
+            {
+                post(data.c_str(), data.length());
+                data.qclear();
+                continue;
+            }
+
+            char buf[4096];
+            ssize_t n;
+            while ((n = read(fd_fifo, buf, sizeof(buf))) > 0)
+                data.append(buf, size_t(n));
+
+            // Each complete line is an event
+            size_t start = 0;
+            for (size_t i = 0; i < data.length(); ++i)
+            {
+                if (data[i] != '\n')
+                    continue;
+                post(data.c_str() + start, i - start);
+                start = i + 1;
+            }
+            data.remove(0, start);
+        }
+#endif
+    }
+
+public:
+    trigger_pipe_t()
+    {
+        wake_req.owner = this;
+    }
+
+    const qstring &get_path() const { return path; }
+    bool is_active() const { return thread != nullptr; }
+
+    // Is there an event that was not consumed yet?
+    bool has_pending()
+    {
+        if (lock == nullptr)
+            return false;
+
+        qmutex_locker_t guard(lock);
+        return b_pending;
+    }
+
+    // Retrieves the payload of the last event (if any)
+    bool consume(qstring *out)
+    {
+        if (lock == nullptr)
+            return false;
+
+        qmutex_locker_t guard(lock);
+        if (!b_pending)
+            return false;
+
+        *out = payload;
+        b_pending = false;
+        return true;
+    }
+
+    bool start(const char *pipe_path, std::function<void()> cb, qstring *errbuf)
+    {
+        stop();
+        path = pipe_path;
+        on_trigger = std::move(cb);
+        stop_requested = false;
+
+#ifdef __NT__
+        h_pipe = CreateNamedPipeA(
+            path.c_str(),
+            PIPE_ACCESS_INBOUND,
+            PIPE_TYPE_BYTE | PIPE_WAIT,
+            1,
+            0,
+            4096,
+            0,
+            nullptr);
+        if (h_pipe == INVALID_HANDLE_VALUE)
+        {
+            errbuf->sprnt("CreateNamedPipe() failed with error %u", GetLastError());
+            return false;
+        }
+#else
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0)
+        {
+            if (mkfifo(path.c_str(), 0600) != 0)
+            {
+                errbuf->sprnt("mkfifo() failed: %s", strerror(errno));
+                return false;
+            }
+        }
+        else if (!S_ISFIFO(st.st_mode))
+        {
+            errbuf->sprnt("'%s' exists and is not a FIFO", path.c_str());
+            return false;
+        }
+
+        // Opening for both reading and writing never blocks and keeps the FIFO
+        // open between writers (no end-of-file after each writer)
+        fd_fifo = open(path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        if (fd_fifo == -1 || pipe(stop_fds) != 0)
+        {
+            errbuf->sprnt("failed to open the FIFO: %s", strerror(errno));
+            stop();
+            return false;
+        }
+#endif
+        lock = qmutex_create();
+        thread = qthread_create(s_thread_cb, this);
+        if (thread == nullptr)
+        {
+            errbuf->sprnt("failed to create the listener thread");
+            stop();
+            return false;
+        }
+        return true;
+    }
+
+    void stop()
+    {
+        stop_requested = true;
+        if (thread != nullptr)
+        {
+#ifdef __NT__
+            // Unblock ConnectNamedPipe() by connecting to ourselves
+            for (int i = 0; i < 50; ++i)
+            {
+                HANDLE h = CreateFileA(path.c_str(), GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, 0, nullptr);
+                if (h != INVALID_HANDLE_VALUE)
+                {
+                    CloseHandle(h);
+                    break;
+                }
+                WaitNamedPipeA(path.c_str(), 100);
+            }
+#else
+            char c = 0;
+            ssize_t n = write(stop_fds[1], &c, 1);
+            qnotused(n);
+#endif
+            qthread_join(thread);
+            qthread_free(thread);
+            thread = nullptr;
+        }
+
+        // Drop a wake up request that did not execute yet
+        if (last_req_id != -1)
+        {
+            cancel_exec_request(last_req_id);
+            last_req_id = -1;
+        }
+        wake_queued = false;
+
+#ifdef __NT__
+        if (h_pipe != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(h_pipe);
+            h_pipe = INVALID_HANDLE_VALUE;
+        }
+#else
+        for (int *pfd : { &fd_fifo, &stop_fds[0], &stop_fds[1] })
+        {
+            if (*pfd != -1)
+            {
+                close(*pfd);
+                *pfd = -1;
+            }
+        }
+#endif
+        if (lock != nullptr)
+        {
+            qmutex_free(lock);
+            lock = nullptr;
+        }
+        b_pending = false;
+        path.qclear();
+    }
+
+    ~trigger_pipe_t()
+    {
+        stop();
+    }
+};
@@ -160,3 +160,173 @@ void enumerate_files(
     }
 }
 
+//-------------------------------------------------------------------------
+// Enumerates the files matching a glob pattern. '*' and '?' match within a
+// path component and '**' matches any number of directories (e.g.: src/**/*.cpp)
+void enumerate_glob(
+    const char *pattern,
+    std::function<bool(const std::string&)> callback)
+{
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    std::string pat = fs::path(pattern).generic_string();
+
+    // The base directory is the part of the pattern before the first wildcard
+    size_t wild = pat.find_first_of("*?");
+    if (wild == std::string::npos)
+    {
+        if (fs::is_regular_file(pat, ec))
+            callback(fs::path(pat).string());
+        return;
+    }
+    size_t slash = pat.rfind('/', wild);
+    std::string base = slash == std::string::npos ? "." : pat.substr(0, slash == 0 ? 1 : slash);
+    std::string rest = slash == std::string::npos ? pat : pat.substr(slash + 1);
+
+    std::string re;
+    for (size_t i = 0; i < rest.size(); ++i)
+    {
+        char c = rest[i];
+        if (c == '*' && i + 1 < rest.size() && rest[i + 1] == '*')
+        {
+            bool dirs = i + 2 < rest.size() && rest[i + 2] == '/';
+            re += dirs ? "(?:.*/)?" : ".*";
+            i += dirs ? 2 : 1;
+        }
+        else if (c == '*')
+        {
+            re += "[^/]*";
+        }
+        else if (c == '?')
+        {
+            re += "[^/]";
+        }
+        else
+        {
+            if (strchr(".^$+(){}[]|\\", c) != nullptr)
+                re += '\\';
+            re += c;
+        }
+    }
+#ifdef __NT__
+    std::regex filter(re, std::regex::icase);
+#else
+    std::regex filter(re);
+#endif
+
+    auto visit = [&](const fs::directory_entry &entry)
+    {
+        if (!entry.is_regular_file(ec))
+            return true;
+        auto rel = entry.path().lexically_relative(base).generic_string();
+        if (!std::regex_match(rel, filter))
+            return true;
+        return callback(entry.path().string());
+    };
+
+    if (!fs::is_directory(base, ec))
+        return;
+
+    if (rest.find('/') == std::string::npos && rest.find("**") == std::string::npos)
+    {
+        for (fs::directory_iterator it(base, ec), end; !ec && it != end; it.increment(ec))
+        {
+            if (!visit(*it))
+                break;
+        }
+    }
+    else
+    {
+        auto opts = fs::directory_options::skip_permission_denied;
+        for (fs::recursive_directory_iterator it(base, opts, ec), end; !ec && it != end; it.increment(ec))
+        {
+            if (!visit(*it))
+                break;
+        }
+    }
+}
+
+//-------------------------------------------------------------------------
+// Returns a Python string literal that evaluates to the given UTF-8 string
+qstring make_py_str_literal(const char *str)
+{
+    qstring out = "'";
+    for (const uchar *p = (const uchar *)str; *p != '\0'; ++p)
+    {
+        uchar c = *p;
+        if (c == '\\' || c == '\'')
+            out.cat_sprnt("\\%c", c);
+        else if (c < 0x20 || c == 0x7f)
+            out.cat_sprnt("\\x%02x", c);
+        else
+            out.append(char(c));
+    }
+    out.append("'");
+    return out;
+}
+
+//-------------------------------------------------------------------------
+// Returns the resident set size of the current process in bytes (0 if unknown)
+uint64 get_process_rss()
+{
+#ifdef __NT__
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+        return pmc.WorkingSetSize;
+#elif defined(__MAC__)
+    mach_task_basic_info info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) == KERN_SUCCESS)
+        return info.resident_size;
+#else
+    FILE *fp = qfopen("/proc/self/statm", "r");
+    if (fp != nullptr)
+    {
+        uint64 size = 0, resident = 0;
+        int n = qfscanf(fp, "%" FMT_64 "u %" FMT_64 "u", &size, &resident);
+        qfclose(fp);
+        if (n == 2)
+            return resident * uint64(sysconf(_SC_PAGESIZE));
+    }
+#endif
+    return 0;
+}
+
+//-------------------------------------------------------------------------
+// Formats a signed byte count in a human readable way
+qstring format_bytes(int64 bytes)
+{
+    qstring out;
+    double v = double(bytes < 0 ? -bytes : bytes);
+    const char *sign = bytes < 0 ? "-" : "";
+    if (v >= 1024.0 * 1024 * 1024)
+        out.sprnt("%s%.2f GB", sign, v / (1024.0 * 1024 * 1024));
+    else if (v >= 1024.0 * 1024)
+        out.sprnt("%s%.2f MB", sign, v / (1024.0 * 1024));
+    else if (v >= 1024.0)
+        out.sprnt("%s%.1f KB", sign, v / 1024.0);
+    else
+        out.sprnt("%s%d bytes", sign, int(v));
+    return out;
+}
+
+//-------------------------------------------------------------------------
+// Quotes a string so it is passed as a single argument by the shell
+qstring shell_quote(const char *str)
+{
+    qstring out;
+#ifdef __NT__
+    out.sprnt("\"%s\"", str);
+#else
+    out = "'";
+    for (const char *p = str; *p != '\0'; ++p)
+    {
+        if (*p == '\'')
+            out.append("'\\''");
+        else
+            out.append(*p);
+    }
+    out.append("'");
+#endif
+    return out;
+}
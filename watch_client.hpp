@@ -0,0 +1,425 @@
+#pragma once
+
+//-------------------------------------------------------------------------
+// Client of the shared watcher daemon (qscripts-watchd, see watch_proto.hpp).
+//
+// While connected, the file monitor does not poll the time-stamps of the
+// watched files: it only visits them after the daemon reported a change.
+// A background thread keeps the connection. It starts the daemon if needed
+// and, if the daemon goes away, re-connects and registers the watches again.
+//
+// The daemon is not available on Windows, where the file monitor keeps polling.
+#ifndef __NT__
+    #include "watch_proto.hpp"
+#endif
+
+static constexpr char WATCHD_EXE_NAME[]          = "qscripts-watchd";
+static constexpr int  WATCHD_RECONNECT_INTERVAL = 2000; // ms
+static constexpr int  WATCHD_IDLE_EXIT          = 600;  // secs without clients before an auto-started daemon exits
+
+class watch_client_t
+{
+    struct wake_req_t : public exec_request_t
+    {
+        watch_client_t *owner = nullptr;
+        ssize_t idaapi execute() override
+        {
+            owner->on_wake();
+            return 0;
+        }
+    } wake_req;
+
+    qthread_t thread = nullptr;
+    qmutex_t lock = nullptr;
+    std::atomic<bool> stop_requested{ false };
+    std::atomic<bool> connected{ false };
+    std::atomic<bool> wake_queued{ false };
+    std::atomic<int> last_req_id{ -1 };
+    std::function<void()> on_event;
+    qstring daemon_path;
+
+    // Protected by 'lock'
+    std::set<std::string> watches;
+    std::string active_script;
+    qstring run_request;
+    bool b_changed = false;
+    int fd = -1;
+
+#ifndef __NT__
+    int stop_fds[2] = { -1, -1 };
+#endif
+
+    // Called from the client thread
+    void wake()
+    {
+        if (!stop_requested && !wake_queued.exchange(true))
+            last_req_id = execute_sync(wake_req, MFF_WRITE | MFF_NOWAIT);
+    }
+
+    // Called on the main thread
+    void on_wake()
+    {
+        wake_queued = false;
+        if (!stop_requested && on_event)
+            on_event();
+    }
+
+#ifndef __NT__
+    static int idaapi s_thread_cb(void *ud)
+    {
+        ((watch_client_t *)ud)->serve();
+        return 0;
+    }
+
+    // Must be called with 'lock' held
+    bool send_locked(const char *cmd, const std::string &arg)
+    {
+        if (fd == -1)
+            return false;
+
+        std::string line = std::string(cmd) + " " + arg + "\n";
+        const char *p = line.c_str();
+        size_t left = line.size();
+        while (left != 0)
+        {
+#ifdef MSG_NOSIGNAL
+            ssize_t n = send(fd, p, left, MSG_NOSIGNAL);
+#else
+            ssize_t n = send(fd, p, left, 0);
+#endif
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            p += n;
+            left -= size_t(n);
+        }
+        return true;
+    }
+
+    static int connect_daemon()
+    {
+        sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        std::string path = get_watchd_socket_path();
+        if (path.size() >= sizeof(addr.sun_path))
+            return -1;
+        qstrncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path));
+
+        int s = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (s == -1)
+            return -1;
+        if (connect(s, (sockaddr *)&addr, sizeof(addr)) != 0)
+        {
+            close(s);
+            return -1;
+        }
+        fcntl(s, F_SETFD, FD_CLOEXEC);
+#ifdef SO_NOSIGPIPE
+        int one = 1;
+        setsockopt(s, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+        return s;
+    }
+
+    // Starts a detached daemon that exits once it has no clients for a while
+    void launch_daemon()
+    {
+        qstring idle_exit;
+        idle_exit.sprnt("%d", WATCHD_IDLE_EXIT);
+        char *argv[] =
+        {
+            (char *)daemon_path.c_str(),
+            (char *)"--detach",
+            (char *)"--idle-exit",
+            idle_exit.begin(),
+            nullptr
+        };
+
+        posix_spawn_file_actions_t fa;
+        posix_spawn_file_actions_init(&fa);
+        posix_spawn_file_actions_addopen(&fa, STDIN_FILENO,  "/dev/null", O_RDONLY, 0);
+        posix_spawn_file_actions_addopen(&fa, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+        posix_spawn_file_actions_addopen(&fa, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+
+        // The detached daemon forks: only its short-lived parent is ours to reap
+        pid_t pid;
+        if (posix_spawnp(&pid, daemon_path.c_str(), &fa, nullptr, argv, environ) == 0)
+            waitpid(pid, nullptr, 0);
+        posix_spawn_file_actions_destroy(&fa);
+    }
+
+    // Waits on the stop pipe. Returns false if stopping.
+    bool sleep_ms(int ms)
+    {
+        pollfd pfd = { stop_fds[0], POLLIN, 0 };
+        return poll(&pfd, 1, ms) == 0 && !stop_requested;
+    }
+
+    void serve()
+    {
+        bool launched = false;
+        while (!stop_requested)
+        {
+            int s = connect_daemon();
+            if (s == -1)
+            {
+                if (!launched && !daemon_path.empty())
+                {
+                    launched = true;
+                    launch_daemon();
+                    for (int i = 0; i < 20 && (s = connect_daemon()) == -1; ++i)
+                    {
+                        if (!sleep_ms(50))
+                            return;
+                    }
+                }
+                if (s == -1)
+                {
+                    if (!sleep_ms(WATCHD_RECONNECT_INTERVAL))
+                        return;
+                    continue;
+                }
+            }
+
+            // Register the watches: the events that happened while disconnected are lost
+            {
+                qmutex_locker_t guard(lock);
+                fd = s;
+                for (auto &path : watches)
+                    send_locked("watch", path);
+                send_locked("active", active_script);
+                b_changed = true;
+            }
+            connected = true;
+            wake();
+
+            qstring data;
+            while (!stop_requested)
+            {
+                pollfd fds[2] = { { s, POLLIN, 0 }, { stop_fds[0], POLLIN, 0 } };
+                if (poll(fds, 2, -1) < 0)
+                {
+                    if (errno == EINTR)
+                        continue;
+                    break;
+                }
+                if (fds[1].revents != 0)
+                    break;
+
+                char buf[4096];
+                ssize_t n = read(s, buf, sizeof(buf));
+                if (n <= 0)
+                {
+                    if (n < 0 && errno == EINTR)
+                        continue;
+                    break;
+                }
+                data.append(buf, size_t(n));
+
+                bool notify = false;
+                size_t start = 0;
+                for (size_t i = 0; i < data.length(); ++i)
+                {
+                    if (data[i] != '\n')
+                        continue;
+
+                    std::string cmd, arg;
+                    split_watchd_message(std::string(data.c_str() + start, i - start), cmd, arg);
+                    start = i + 1;
+
+                    qmutex_locker_t guard(lock);
+                    if (cmd == "changed")
+                    {
+                        b_changed = notify = true;
+                    }
+                    else if (cmd == "run")
+                    {
+                        run_request = arg.c_str();
+                        notify = true;
+                    }
+                }
+                data.remove(0, start);
+                if (notify)
+                    wake();
+            }
+
+            // Disconnected: the file monitor polls again until re-connected
+            {
+                qmutex_locker_t guard(lock);
+                close(fd);
+                fd = -1;
+                b_changed = true;
+            }
+            connected = false;
+            wake();
+        }
+    }
+#endif
+
+public:
+    watch_client_t()
+    {
+        wake_req.owner = this;
+    }
+
+    // Connects to the daemon in the background. 'daemon' is the executable to start if it
+    // is not running (empty to never start it). 'cb' is called on the main thread upon events.
+    bool start(const char *daemon, std::function<void()> cb, qstring *errbuf)
+    {
+        stop();
+#ifdef __NT__
+        qnotused(daemon);
+        qnotused(cb);
+        errbuf->sprnt("the shared watcher daemon is not available on Windows");
+        return false;
+#else
+        daemon_path = daemon;
+        on_event = std::move(cb);
+        stop_requested = false;
+        if (pipe(stop_fds) != 0)
+        {
+            errbuf->sprnt("pipe() failed: %s", strerror(errno));
+            return false;
+        }
+        lock = qmutex_create();
+        thread = qthread_create(s_thread_cb, this);
+        if (thread == nullptr)
+        {
+            errbuf->sprnt("failed to create the watcher client thread");
+            stop();
+            return false;
+        }
+        return true;
+#endif
+    }
+
+    void stop()
+    {
+        stop_requested = true;
+#ifndef __NT__
+        if (thread != nullptr)
+        {
+            char c = 0;
+            ssize_t n = write(stop_fds[1], &c, 1);
+            qnotused(n);
+            qthread_join(thread);
+            qthread_free(thread);
+            thread = nullptr;
+        }
+        if (last_req_id != -1)
+        {
+            cancel_exec_request(last_req_id);
+            last_req_id = -1;
+        }
+        wake_queued = false;
+
+        for (int *pfd : { &stop_fds[0], &stop_fds[1] })
+        {
+            if (*pfd != -1)
+            {
+                close(*pfd);
+                *pfd = -1;
+            }
+        }
+        if (lock != nullptr)
+        {
+            qmutex_free(lock);
+            lock = nullptr;
+        }
+#endif
+        connected = false;
+        watches.clear();
+        active_script.clear();
+        run_request.qclear();
+        b_changed = false;
+    }
+
+    bool is_active() const    { return thread != nullptr; }
+    bool is_connected() const { return connected; }
+
+    // Replaces the set of watched files and folders
+    void set_watches(const std::set<std::string> &paths)
+    {
+#ifndef __NT__
+        if (lock == nullptr)
+            return;
+
+        qmutex_locker_t guard(lock);
+        for (auto &path : watches)
+        {
+            if (paths.find(path) == paths.end())
+                send_locked("unwatch", path);
+        }
+        for (auto &path : paths)
+        {
+            if (watches.find(path) == watches.end())
+                send_locked("watch", path);
+        }
+        watches = paths;
+#else
+        qnotused(paths);
+#endif
+    }
+
+    // Announces the active script (used to fan out the execution requests)
+    void set_active(const char *script)
+    {
+#ifndef __NT__
+        if (lock == nullptr)
+            return;
+
+        qmutex_locker_t guard(lock);
+        active_script = script;
+        send_locked("active", active_script);
+#else
+        qnotused(script);
+#endif
+    }
+
+    // Asks the other instances that have the same active script to execute it
+    bool request_run(const char *script)
+    {
+#ifndef __NT__
+        if (lock == nullptr)
+            return false;
+
+        qmutex_locker_t guard(lock);
+        return send_locked("run", script);
+#else
+        qnotused(script);
+        return false;
+#endif
+    }
+
+    // Returns true (once) if a watched file changed since the last call
+    bool take_changes()
+    {
+        if (lock == nullptr)
+            return false;
+
+        qmutex_locker_t guard(lock);
+        bool changed = b_changed;
+        b_changed = false;
+        return changed;
+    }
+
+    // Returns true (once) if another instance asked to execute the active script
+    bool take_run_request(qstring *script)
+    {
+        if (lock == nullptr)
+            return false;
+
+        qmutex_locker_t guard(lock);
+        if (run_request.empty())
+            return false;
+        script->swap(run_request);
+        run_request.qclear();
+        return true;
+    }
+
+    ~watch_client_t()
+    {
+        stop();
+    }
+};
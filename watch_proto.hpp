@@ -0,0 +1,51 @@
+#pragma once
+
+//-------------------------------------------------------------------------
+// Protocol of the shared watcher daemon (qscripts-watchd).
+//
+// One daemon per user holds the file system watches of all the QScripts
+// instances and broadcasts the change events to them. This header is shared
+// by the plugin and the daemon, so it only depends on the C++ and POSIX
+// libraries.
+//
+// The daemon listens on a Unix domain socket. Each message is a line made of
+// a command, a space and an absolute path:
+//
+//   client -> daemon
+//      watch <path>      report changes of a file (or of any file in a folder)
+//      unwatch <path>    stop reporting them
+//      clear             drop all the watches of this client
+//      active <path>     the client's active script (empty if none)
+//      run <path>        ask the other clients with the same active script to execute it
+//
+//   daemon -> client
+//      hello <version>   sent upon connection
+//      changed <path>    a watched file was created, modified, renamed or deleted
+//      run <path>        another instance asked to execute the active script
+#include <string>
+#include <stdlib.h>
+#include <unistd.h>
+
+static constexpr int WATCHD_PROTO_VERSION = 1;
+
+// Returns the per-user socket path of the daemon
+inline std::string get_watchd_socket_path()
+{
+    const char *env = getenv("QSCRIPTS_WATCHD_SOCKET");
+    if (env != nullptr && env[0] != '\0')
+        return env;
+
+    const char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+    if (runtime_dir != nullptr && runtime_dir[0] != '\0')
+        return std::string(runtime_dir) + "/qscripts-watchd.sock";
+
+    return "/tmp/qscripts-watchd-" + std::to_string(getuid()) + ".sock";
+}
+
+// Splits a message line into its command and its argument
+inline void split_watchd_message(const std::string &line, std::string &cmd, std::string &arg)
+{
+    size_t sp = line.find(' ');
+    cmd = line.substr(0, sp);
+    arg = sp == std::string::npos ? std::string() : line.substr(sp + 1);
+}
@@ -0,0 +1,636 @@
+/*
+qscripts-watchd: a per-user file watcher shared by all the QScripts instances.
+
+Each IDA instance running QScripts normally polls the time-stamps of its active
+script and dependencies. With several instances open on the same script trees,
+the same files are polled over and over. The daemon holds a single set of
+watches (inotify on Linux, polling elsewhere) and broadcasts the change events
+to the subscribed instances. See watch_proto.hpp for the protocol.
+
+Usage: qscripts-watchd [--socket path] [--poll ms] [--idle-exit secs] [--detach] [-v]
+*/
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <filesystem>
+#include <system_error>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#ifdef __linux__
+    #include <sys/inotify.h>
+#endif
+
+#include "../watch_proto.hpp"
+
+namespace fs = std::filesystem;
+
+//-------------------------------------------------------------------------
+static bool g_verbose = false;
+
+static void log_msg(const char *fmt, ...)
+{
+    if (!g_verbose)
+        return;
+    va_list va;
+    va_start(va, fmt);
+    fprintf(stderr, "qscripts-watchd: ");
+    vfprintf(stderr, fmt, va);
+    fputc('\n', stderr);
+    va_end(va);
+}
+
+static long long now_ms()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+//-------------------------------------------------------------------------
+// Output queued for a client that does not read it (for example, an IDA
+// instance busy running a long script) before it is disconnected
+static constexpr size_t MAX_CLIENT_BACKLOG = 1024 * 1024;
+
+struct client_t
+{
+    int fd = -1;
+    bool dead = false;      // to be disconnected
+    std::string inbuf;
+    std::string outbuf;     // not sent yet: the sockets are non-blocking
+    std::string active_script;
+    // Watched path -> (folder, file name)
+    std::map<std::string, std::pair<std::string, std::string>> watches;
+};
+
+// A watched folder: the subscribers of its files ("" subscribes to all the files)
+struct dir_watch_t
+{
+    int wd = -1;
+    std::map<std::string, std::set<client_t *>> subs;
+
+    // Polling backend: the last seen state of each file
+    struct file_state_t
+    {
+        long long mtime_ns;
+        long long size;
+        bool operator!=(const file_state_t &o) const { return mtime_ns != o.mtime_ns || size != o.size; }
+    };
+    std::map<std::string, file_state_t> states;
+};
+
+//-------------------------------------------------------------------------
+class watchd_t
+{
+    std::string sock_path;
+    int fd_listen = -1;
+    int fd_inotify = -1;
+    int poll_interval;
+    int idle_exit;
+    long long idle_since;
+
+    std::vector<std::unique_ptr<client_t>> clients;
+    std::map<std::string, dir_watch_t> dirs;
+    std::map<int, std::string> wd_to_dir;
+
+    static void split_path(const std::string &path, std::string &dir, std::string &name)
+    {
+        std::error_code ec;
+        if (fs::is_directory(path, ec))
+        {
+            dir = path;
+            name.clear();
+        }
+        else
+        {
+            fs::path p(path);
+            dir  = p.parent_path().string();
+            name = p.filename().string();
+        }
+    }
+
+    static bool stat_file(const std::string &path, dir_watch_t::file_state_t &st)
+    {
+        struct stat sb;
+        if (stat(path.c_str(), &sb) != 0)
+            return false;
+#ifdef __APPLE__
+        st.mtime_ns = (long long)sb.st_mtimespec.tv_sec * 1000000000 + sb.st_mtimespec.tv_nsec;
+#else
+        st.mtime_ns = (long long)sb.st_mtim.tv_sec * 1000000000 + sb.st_mtim.tv_nsec;
+#endif
+        st.size = (long long)sb.st_size;
+        return true;
+    }
+
+    // Takes the state of the watched files of a folder (polling backend)
+    void scan_dir(const std::string &dir, dir_watch_t &dw, std::map<std::string, dir_watch_t::file_state_t> &out)
+    {
+        out.clear();
+        dir_watch_t::file_state_t st;
+        if (dw.subs.count("") != 0)
+        {
+            std::error_code ec;
+            for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec))
+            {
+                std::string name = it->path().filename().string();
+                if (stat_file(it->path().string(), st))
+                    out[name] = st;
+            }
+        }
+        for (auto &kv : dw.subs)
+        {
+            if (!kv.first.empty() && stat_file(dir + "/" + kv.first, st))
+                out[kv.first] = st;
+        }
+    }
+
+    // Sends as much of the queued output as the socket takes without blocking
+    static void flush_client(client_t *c)
+    {
+        size_t sent = 0;
+        while (sent < c->outbuf.size())
+        {
+#ifdef MSG_NOSIGNAL
+            ssize_t n = send(c->fd, c->outbuf.data() + sent, c->outbuf.size() - sent, MSG_NOSIGNAL);
+#else
+            ssize_t n = send(c->fd, c->outbuf.data() + sent, c->outbuf.size() - sent, 0);
+#endif
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                break;
+            if (n <= 0)
+            {
+                c->dead = true;
+                break;
+            }
+            sent += size_t(n);
+        }
+        c->outbuf.erase(0, sent);
+    }
+
+    // Queues a message. Returns false if the client is (or was just found) gone.
+    static bool send_line(client_t *c, const char *cmd, const std::string &arg)
+    {
+        if (c->dead)
+            return false;
+
+        c->outbuf.append(cmd).append(" ").append(arg).append("\n");
+        flush_client(c);
+        if (c->outbuf.size() > MAX_CLIENT_BACKLOG)
+        {
+            log_msg("client not reading its messages: disconnecting it");
+            c->dead = true;
+        }
+        return !c->dead;
+    }
+
+    // Reports a change to the subscribers of the file and of its folder
+    void notify(const std::string &dir, const std::string &name)
+    {
+        auto p = dirs.find(dir);
+        if (p == dirs.end())
+            return;
+
+        std::string path = dir + "/" + name;
+        std::set<client_t *> targets;
+        for (const char *key : { name.c_str(), "" })
+        {
+            auto s = p->second.subs.find(key);
+            if (s != p->second.subs.end())
+                targets.insert(s->second.begin(), s->second.end());
+        }
+        for (auto *c : targets)
+            send_line(c, "changed", path);
+
+        if (!targets.empty())
+            log_msg("changed %s (%d client(s))", path.c_str(), int(targets.size()));
+    }
+
+    void add_watch(client_t *c, const std::string &path)
+    {
+        if (path.empty() || path[0] != '/' || c->watches.count(path) != 0)
+            return;
+
+        std::string dir, name;
+        split_path(path, dir, name);
+        c->watches[path] = { dir, name };
+        auto &dw = dirs[dir];
+        dw.subs[name].insert(c);
+
+#ifdef __linux__
+        if (fd_inotify != -1 && dw.wd == -1)
+        {
+            dw.wd = inotify_add_watch(
+                fd_inotify,
+                dir.c_str(),
+                IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO);
+            if (dw.wd != -1)
+                wd_to_dir[dw.wd] = dir;
+            else
+                log_msg("cannot watch %s: %s", dir.c_str(), strerror(errno));
+        }
+#endif
+        if (fd_inotify == -1)
+            scan_dir(dir, dw, dw.states);
+        log_msg("watch %s", path.c_str());
+    }
+
+    void remove_watch(client_t *c, const std::string &path)
+    {
+        auto w = c->watches.find(path);
+        if (w == c->watches.end())
+            return;
+
+        std::string dir  = w->second.first;
+        std::string name = w->second.second;
+        c->watches.erase(w);
+
+        auto p = dirs.find(dir);
+        if (p == dirs.end())
+            return;
+
+        auto &dw = p->second;
+        auto s = dw.subs.find(name);
+        if (s != dw.subs.end())
+        {
+            s->second.erase(c);
+            if (s->second.empty())
+                dw.subs.erase(s);
+        }
+        if (dw.subs.empty())
+        {
+#ifdef __linux__
+            if (dw.wd != -1)
+            {
+                inotify_rm_watch(fd_inotify, dw.wd);
+                wd_to_dir.erase(dw.wd);
+            }
+#endif
+            dirs.erase(p);
+        }
+    }
+
+    void clear_watches(client_t *c)
+    {
+        while (!c->watches.empty())
+            remove_watch(c, c->watches.begin()->first);
+    }
+
+    void drop_client(size_t idx)
+    {
+        client_t *c = clients[idx].get();
+        clear_watches(c);
+        close(c->fd);
+        clients.erase(clients.begin() + idx);
+        log_msg("client disconnected (%d left)", int(clients.size()));
+        if (clients.empty())
+            idle_since = now_ms();
+    }
+
+    void handle_message(client_t *c, const std::string &line)
+    {
+        std::string cmd, arg;
+        split_watchd_message(line, cmd, arg);
+        if (cmd == "watch")
+        {
+            add_watch(c, arg);
+        }
+        else if (cmd == "unwatch")
+        {
+            remove_watch(c, arg);
+        }
+        else if (cmd == "clear")
+        {
+            clear_watches(c);
+        }
+        else if (cmd == "active")
+        {
+            c->active_script = arg;
+        }
+        else if (cmd == "run")
+        {
+            int n = 0;
+            for (auto &other : clients)
+            {
+                if (other.get() != c && !arg.empty() && other->active_script == arg)
+                    n += send_line(other.get(), "run", arg) ? 1 : 0;
+            }
+            log_msg("run %s fanned out to %d client(s)", arg.c_str(), n);
+        }
+    }
+
+    // Returns false if the client is gone
+    bool read_client(client_t *c)
+    {
+        char buf[4096];
+        ssize_t n = read(c->fd, buf, sizeof(buf));
+        if (n <= 0)
+            return n < 0 && (errno == EINTR || errno == EAGAIN);
+
+        c->inbuf.append(buf, size_t(n));
+        size_t start = 0, nl;
+        while ((nl = c->inbuf.find('\n', start)) != std::string::npos)
+        {
+            if (nl > start)
+                handle_message(c, c->inbuf.substr(start, nl - start));
+            start = nl + 1;
+        }
+        c->inbuf.erase(0, start);
+        return true;
+    }
+
+#ifdef __linux__
+    void read_inotify()
+    {
+        alignas(inotify_event) char buf[16 * 1024];
+        ssize_t n = read(fd_inotify, buf, sizeof(buf));
+        for (char *p = buf; n > 0 && p < buf + n; )
+        {
+            auto *ev = (inotify_event *)p;
+            p += sizeof(inotify_event) + ev->len;
+
+            auto d = wd_to_dir.find(ev->wd);
+            if (d == wd_to_dir.end())
+                continue;
+
+            // The folder itself is gone: the kernel dropped the watch
+            if ((ev->mask & IN_IGNORED) != 0)
+            {
+                auto w = dirs.find(d->second);
+                if (w != dirs.end())
+                    w->second.wd = -1;
+                wd_to_dir.erase(d);
+                continue;
+            }
+            if (ev->len != 0)
+                notify(d->second, ev->name);
+        }
+    }
+#endif
+
+    // Polling backend: compares the watched files with their last seen state
+    void poll_dirs()
+    {
+        std::map<std::string, dir_watch_t::file_state_t> cur;
+        for (auto &kv : dirs)
+        {
+            auto &dw = kv.second;
+            scan_dir(kv.first, dw, cur);
+            for (auto &f : cur)
+            {
+                auto old = dw.states.find(f.first);
+                if (old == dw.states.end() || old->second != f.second)
+                    notify(kv.first, f.first);
+            }
+            for (auto &f : dw.states)
+            {
+                if (cur.find(f.first) == cur.end())
+                    notify(kv.first, f.first);
+            }
+            dw.states.swap(cur);
+        }
+    }
+
+public:
+    watchd_t(const std::string &path, int poll_ms, int idle_exit_secs)
+        : sock_path(path), poll_interval(poll_ms), idle_exit(idle_exit_secs), idle_since(now_ms())
+    {
+    }
+
+    bool start(bool force_polling)
+    {
+        // Refuse to replace a running daemon
+        sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        if (sock_path.size() >= sizeof(addr.sun_path))
+        {
+            fprintf(stderr, "qscripts-watchd: the socket path is too long\n");
+            return false;
+        }
+        strcpy(addr.sun_path, sock_path.c_str());
+
+        int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        bool running = probe != -1 && connect(probe, (sockaddr *)&addr, sizeof(addr)) == 0;
+        if (probe != -1)
+            close(probe);
+        if (running)
+        {
+            fprintf(stderr, "qscripts-watchd: already running on %s\n", sock_path.c_str());
+            return false;
+        }
+
+        unlink(sock_path.c_str());
+        fd_listen = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (   fd_listen == -1
+            || bind(fd_listen, (sockaddr *)&addr, sizeof(addr)) != 0
+            || chmod(sock_path.c_str(), 0600) != 0
+            || listen(fd_listen, 16) != 0)
+        {
+            fprintf(stderr, "qscripts-watchd: failed to listen on %s: %s\n", sock_path.c_str(), strerror(errno));
+            return false;
+        }
+        fcntl(fd_listen, F_SETFD, FD_CLOEXEC);
+
+#ifdef __linux__
+        if (!force_polling)
+        {
+            fd_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+            if (fd_inotify == -1)
+                log_msg("inotify is not available (%s): polling every %d ms", strerror(errno), poll_interval);
+        }
+#endif
+        log_msg("listening on %s (%s)", sock_path.c_str(), fd_inotify != -1 ? "inotify" : "polling");
+        return true;
+    }
+
+    void run(volatile sig_atomic_t &stop)
+    {
+        std::vector<pollfd> fds;
+        long long next_poll = now_ms() + poll_interval;
+        while (!stop)
+        {
+            if (idle_exit > 0 && clients.empty() && now_ms() - idle_since >= idle_exit * 1000LL)
+            {
+                log_msg("no clients for %d s, exiting", idle_exit);
+                break;
+            }
+
+            fds.clear();
+            fds.push_back({ fd_listen, POLLIN, 0 });
+            fds.push_back({ fd_inotify, POLLIN, 0 });
+            for (auto &c : clients)
+                fds.push_back({ c->fd, short(c->outbuf.empty() ? POLLIN : POLLIN | POLLOUT), 0 });
+
+            int timeout = fd_inotify != -1 ? 1000 : int(std::max(0LL, next_poll - now_ms()));
+            if (poll(fds.data(), nfds_t(fds.size()), timeout) < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                break;
+            }
+
+#ifdef __linux__
+            if (fds[1].revents != 0)
+                read_inotify();
+#endif
+            if (fd_inotify == -1 && now_ms() >= next_poll)
+            {
+                poll_dirs();
+                next_poll = now_ms() + poll_interval;
+            }
+
+            for (size_t i = 0; i < clients.size(); ++i)
+            {
+                client_t *c = clients[i].get();
+                short revents = fds[i + 2].revents;
+                if ((revents & POLLOUT) != 0 && !c->dead)
+                    flush_client(c);
+                if ((revents & ~POLLOUT) != 0 && !c->dead && !read_client(c))
+                    c->dead = true;
+            }
+
+            // Visit the clients backwards so they can be removed on the way
+            for (size_t i = clients.size(); i-- > 0; )
+            {
+                if (clients[i]->dead)
+                    drop_client(i);
+            }
+
+            if (fds[0].revents != 0)
+            {
+                int fd = accept(fd_listen, nullptr, nullptr);
+                if (fd != -1)
+                {
+                    fcntl(fd, F_SETFD, FD_CLOEXEC);
+                    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+#ifdef SO_NOSIGPIPE
+                    int one = 1;
+                    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+                    auto c = std::make_unique<client_t>();
+                    c->fd = fd;
+                    if (send_line(c.get(), "hello", std::to_string(WATCHD_PROTO_VERSION)))
+                    {
+                        clients.push_back(std::move(c));
+                        log_msg("client connected (%d total)", int(clients.size()));
+                    }
+                    else
+                    {
+                        close(fd);
+                    }
+                }
+            }
+        }
+    }
+
+    ~watchd_t()
+    {
+        for (auto &c : clients)
+            close(c->fd);
+        if (fd_inotify != -1)
+            close(fd_inotify);
+        if (fd_listen != -1)
+        {
+            close(fd_listen);
+            unlink(sock_path.c_str());
+        }
+    }
+};
+
+//-------------------------------------------------------------------------
+static volatile sig_atomic_t g_stop = 0;
+
+static void on_signal(int)
+{
+    g_stop = 1;
+}
+
+int main(int argc, char *argv[])
+{
+    std::string sock_path = get_watchd_socket_path();
+    int poll_ms = 250;
+    int idle_exit = 0;
+    bool detach = false, force_polling = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--socket" && i + 1 < argc)
+        {
+            sock_path = argv[++i];
+        }
+        else if (arg == "--poll" && i + 1 < argc)
+        {
+            poll_ms = atoi(argv[++i]);
+            if (poll_ms < 10)
+                poll_ms = 10;
+            force_polling = true;
+        }
+        else if (arg == "--idle-exit" && i + 1 < argc)
+        {
+            idle_exit = atoi(argv[++i]);
+        }
+        else if (arg == "--detach")
+        {
+            detach = true;
+        }
+        else if (arg == "-v")
+        {
+            g_verbose = true;
+        }
+        else
+        {
+            fprintf(stderr,
+                "Usage: %s [--socket path] [--poll ms] [--idle-exit secs] [--detach] [-v]\n"
+                "\n"
+                "  --socket path       listen on this socket (default: %s)\n"
+                "  --poll ms           poll the files instead of using inotify\n"
+                "  --idle-exit secs    exit after running that long without clients\n"
+                "  --detach            run in the background\n"
+                "  -v                  log the events to stderr\n",
+                argv[0],
+                get_watchd_socket_path().c_str());
+            return 2;
+        }
+    }
+
+    // The parent returns right away (and is reaped by whoever started it)
+    if (detach)
+    {
+        pid_t pid = fork();
+        if (pid < 0)
+            return 1;
+        if (pid > 0)
+            return 0;
+        setsid();
+        if (chdir("/") != 0)
+            return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    watchd_t watchd(sock_path, poll_ms, idle_exit);
+    if (!watchd.start(force_polling))
+        return 1;
+
+    watchd.run(g_stop);
+    return 0;
+}
@@ -0,0 +1,179 @@
+#pragma once
+
+//-------------------------------------------------------------------------
+// A bounded pool of child processes (see process.hpp).
+//
+// Jobs beyond the pool size are queued. The output of running jobs is
+// streamed to the output window from a timer on the main thread.
+static constexpr int WORKER_POLL_INTERVAL = 50;
+
+struct worker_job_t
+{
+    int id = 0;
+    qstring label;
+    qstring command;
+    qstring work_dir;
+    child_process_t proc;
+
+    // Called right before the process starts, e.g. to populate the work directory
+    std::function<bool(worker_job_t &job, qstring *errbuf)> prepare;
+
+    // Called once the job finished (or failed to start)
+    std::function<void(worker_job_t &job)> on_done;
+
+    // Called instead of on_done when the job is cancelled, once its process exited
+    std::function<void()> on_cancel;
+
+    // Optionally receives the output lines (instead of the output window)
+    std::function<void(worker_job_t &job, const char *line)> on_output;
+
+    // The process is terminated after this many seconds (0 for no limit)
+    int timeout_secs = 0;
+
+    bool start_failed = false;
+    qstring start_error;
+    bool timed_out = false;
+};
+using worker_job_ptr_t = std::unique_ptr<worker_job_t>;
+
+class worker_pool_t
+{
+    std::deque<worker_job_ptr_t> queued;
+    std::vector<worker_job_ptr_t> running;
+    qtimer_t timer = nullptr;
+    int max_jobs = 1;
+    int next_id = 1;
+
+    static int idaapi s_timer_cb(void *ud)
+    {
+        return ((worker_pool_t *)ud)->tick();
+    }
+
+    void ensure_timer()
+    {
+        if (timer == nullptr)
+            timer = register_timer(WORKER_POLL_INTERVAL, s_timer_cb, this);
+    }
+
+    void finish(worker_job_t &job)
+    {
+        if (job.on_done)
+            job.on_done(job);
+    }
+
+    void start_queued()
+    {
+        while (!queued.empty() && int(running.size()) < max_jobs)
+        {
+            worker_job_ptr_t job = std::move(queued.front());
+            queued.pop_front();
+
+            qstring &err = job->start_error;
+            if ((job->prepare && !job->prepare(*job, &err))
+              || !job->proc.start(job->command.c_str(), job->work_dir.c_str(), &err))
+            {
+                msg("QScripts: %s failed to start: %s\n", job->label.c_str(), err.c_str());
+                job->start_failed = true;
+                finish(*job);
+                continue;
+            }
+            running.push_back(std::move(job));
+        }
+    }
+
+    int tick()
+    {
+        for (size_t i = 0; i < running.size(); )
+        {
+            worker_job_t &job = *running[i];
+            bool exited = job.proc.poll_exit();
+            job.proc.read_output([&job](const char *line)
+            {
+                if (job.on_output)
+                    job.on_output(job, line);
+                else
+                    msg("[%s] %s\n", job.label.c_str(), line);
+            });
+
+            if (!exited)
+            {
+                if (job.timeout_secs > 0 && !job.timed_out && job.proc.elapsed_secs() > job.timeout_secs)
+                {
+                    // Reaped on a next tick
+                    job.timed_out = true;
+                    job.proc.terminate();
+                    msg("QScripts: %s timed out after %d s\n", job.label.c_str(), job.timeout_secs);
+                }
+                ++i;
+                continue;
+            }
+
+            worker_job_ptr_t done = std::move(running[i]);
+            running.erase(running.begin() + i);
+            finish(*done);
+        }
+
+        start_queued();
+        if (running.empty() && queued.empty())
+        {
+            timer = nullptr;
+            return -1;
+        }
+        return WORKER_POLL_INTERVAL;
+    }
+
+public:
+    void set_max_jobs(int n)
+    {
+        max_jobs = qmax(1, n);
+    }
+
+    int get_max_jobs() const { return max_jobs; }
+
+    // Queues a job and returns its ID
+    int submit(worker_job_ptr_t job)
+    {
+        job->id = next_id++;
+        int id = job->id;
+        queued.push_back(std::move(job));
+        start_queued();
+        ensure_timer();
+        return id;
+    }
+
+    // Drops the queued jobs and terminates the running ones
+    void cancel_all()
+    {
+        std::vector<worker_job_ptr_t> cancelled;
+        for (auto &job : queued)
+            cancelled.push_back(std::move(job));
+        for (auto &job : running)
+        {
+            job->proc.terminate();
+            msg("QScripts: %s cancelled\n", job->label.c_str());
+            cancelled.push_back(std::move(job));
+        }
+        queued.clear();
+        running.clear();
+
+        for (auto &job : cancelled)
+        {
+            // Destroying the job waits for its process to exit
+            auto on_cancel = std::move(job->on_cancel);
+            job.reset();
+            if (on_cancel)
+                on_cancel();
+        }
+    }
+
+    size_t running_count() const { return running.size(); }
+    size_t queued_count() const  { return queued.size(); }
+    bool is_busy() const         { return !running.empty() || !queued.empty(); }
+
+    ~worker_pool_t()
+    {
+        cancel_all();
+        if (timer != nullptr)
+            unregister_timer(timer);
+    }
+};